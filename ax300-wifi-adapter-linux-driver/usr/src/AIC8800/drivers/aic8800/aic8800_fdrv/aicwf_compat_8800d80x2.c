@@ -17,16 +17,17 @@ void rwnx_release_firmware_common(u32** buffer);
 int aicwf_set_rf_config_8800d80x2(struct rwnx_hw *rwnx_hw, struct mm_set_rf_calib_cfm *cfm)
 {
 	int ret = 0;
-
-	if ((ret = rwnx_send_txpwr_lvl_v4_req(rwnx_hw))) {
-		return -1;
-	}
-	if ((ret = rwnx_send_txpwr_lvl_adj_req(rwnx_hw))) {
+	struct rwnx_msg_batch batch;
+
+	/* txpwr settings only need their cfm status, calib needs them applied */
+	rwnx_msg_batch_begin(rwnx_hw, &batch);
+	ret = rwnx_send_txpwr_lvl_v4_req(rwnx_hw);
+	if (!ret)
+		ret = rwnx_send_txpwr_lvl_adj_req(rwnx_hw);
+	if (!ret)
+		ret = rwnx_send_txpwr_ofst2x_v2_req(rwnx_hw);
+	if (rwnx_msg_batch_end(rwnx_hw, &batch) || ret)
 		return -1;
-	}
-	if ((ret = rwnx_send_txpwr_ofst2x_v2_req(rwnx_hw))) {
-		return -1;
-	}
 	if ((ret = rwnx_send_rf_calib_req(rwnx_hw, cfm))) {
 		return -1;
 	}
@@ -2880,7 +2880,9 @@ void aicwf_patch_config_8800dc(struct rwnx_hw *rwnx_hw)
 
 
 
-int aicwf_set_rf_config_8800dc(struct rwnx_hw *rwnx_hw, struct mm_set_rf_calib_cfm *cfm){
+/* requests of aicwf_set_rf_config_8800dc() that only need their cfm status */
+static int aicwf_set_rf_tables_8800dc(struct rwnx_hw *rwnx_hw)
+{
 	int ret = 0;
 
 	if ((ret = rwnx_send_txpwr_lvl_req(rwnx_hw))) {
@@ -2923,7 +2925,21 @@ int aicwf_set_rf_config_8800dc(struct rwnx_hw *rwnx_hw, struct mm_set_rf_calib_c
 
 		if ((ret = rwnx_send_rf_config_req(rwnx_hw, 32,  0, (u8_l *)wifi_rxgain_table_24g_40m_8800dcdw, 256)))
 			return -1;
+	}
+
+	return 0;
+}
 
+int aicwf_set_rf_config_8800dc(struct rwnx_hw *rwnx_hw, struct mm_set_rf_calib_cfm *cfm){
+	int ret = 0;
+	struct rwnx_msg_batch batch;
+
+	rwnx_msg_batch_begin(rwnx_hw, &batch);
+	ret = aicwf_set_rf_tables_8800dc(rwnx_hw);
+	if (rwnx_msg_batch_end(rwnx_hw, &batch) || ret)
+		return -1;
+
+	if (testmode == FW_NORMAL_MODE) {
 		if ((ret = rwnx_send_rf_calib_req(rwnx_hw, cfm))) {
 			return -1;
 		}
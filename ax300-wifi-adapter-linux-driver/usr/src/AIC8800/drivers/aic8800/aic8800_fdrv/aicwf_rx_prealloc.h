@@ -4,8 +4,14 @@
 
 #ifdef CONFIG_PREALLOC_RX_SKB
 
+#include <linux/llist.h>
+
+struct aicwf_rxbuff_pool;
+
 struct rx_buff {
     struct list_head queue;
+    struct llist_node free_node;
+    struct aicwf_rxbuff_pool *pool;
     unsigned char *data;
     u32 len;
     uint8_t *start;
@@ -13,13 +19,11 @@ struct rx_buff {
     uint8_t *read;
 };
 
-struct aicwf_rx_buff_list {
-    struct list_head rxbuff_list;
-    atomic_t rxbuff_list_len;
-};
-
-extern struct rx_buff *aicwf_prealloc_rxbuff_alloc(spinlock_t *lock);
-extern void aicwf_prealloc_rxbuff_free(struct rx_buff *rxbuff, spinlock_t *lock);
+extern struct rx_buff *aicwf_prealloc_rxbuff_alloc(struct aicwf_rxbuff_pool *pool);
+extern void aicwf_prealloc_rxbuff_free(struct rx_buff *rxbuff);
+extern struct aicwf_rxbuff_pool *aicwf_prealloc_rxbuff_pool_get(void (*notify)(void *ctx), void *ctx);
+extern void aicwf_prealloc_rxbuff_pool_put(struct aicwf_rxbuff_pool *pool);
+extern int aicwf_prealloc_rxbuff_pool_size(struct aicwf_rxbuff_pool *pool);
 extern int aicwf_prealloc_init(void);
 extern void aicwf_prealloc_exit(void);
 extern int aicwf_rxbuff_size_get(void);
@@ -853,8 +853,10 @@ int aicwf_sdio_aggr(struct aicwf_tx_priv *tx_priv, struct sk_buff *pkt)
     tx_priv->aggr_buf->dev = pkt->dev;
 
     if(!txhdr->sw_hdr->need_cfm) {
-        kmem_cache_free(txhdr->sw_hdr->rwnx_vif->rwnx_hw->sw_txhdr_cache, txhdr->sw_hdr);
-        skb_pull(pkt, txhdr->sw_hdr->headroom);
+        u16 headroom = txhdr->sw_hdr->headroom;
+
+        rwnx_sw_txhdr_free(txhdr->sw_hdr->rwnx_vif->rwnx_hw, txhdr->sw_hdr);
+        skb_pull(pkt, headroom);
         consume_skb(pkt);
     }
 
@@ -1,27 +1,65 @@
 #include"aicwf_tcp_ack.h"
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/random.h>
 //#include"rwnx_tx.h"
 //#include "aicwf_tcp_ack.h"
 #include"rwnx_defs.h"
-extern int intf_tx(struct rwnx_hw *priv,struct msg_buf *msg);
-struct msg_buf *intf_tcp_alloc_msg(struct msg_buf *msg)
+extern int intf_tx(struct rwnx_hw *priv, struct sk_buff *skb);
+
+static int tcp_ack_flows = TCP_ACK_FLOWS;
+module_param(tcp_ack_flows, int, 0444);
+MODULE_PARM_DESC(tcp_ack_flows, "Max tx TCP flows tracked by the ack filter");
+
+/* called with ack_m->lock held */
+static struct sk_buff *tcp_ack_unhold(struct tcp_ack_flow *flow)
+{
+	struct sk_buff *skb = flow->held;
+
+	if (skb) {
+		flow->held = NULL;
+		list_del_init(&flow->held_list);
+	}
+	return skb;
+}
+
+static u32 tcp_ack_hash(struct tcp_ack_manage *ack_m, struct tcp_ack_msg *msg)
+{
+	return jhash_3words(msg->saddr, msg->daddr,
+			    ((u32)msg->source << 16) | msg->dest,
+			    ack_m->hash_seed) & ack_m->hash_mask;
+}
+
+static struct tcp_ack_flow *tcp_ack_lookup(struct tcp_ack_manage *ack_m,
+				struct tcp_ack_msg *msg, u32 hash)
 {
-	//printk("%s \n",__func__);
-	int len=sizeof(struct msg_buf) ;
-	msg = kzalloc(len , GFP_ATOMIC);
-	if(!msg)
-		printk("%s: alloc failed \n", __func__);
-	memset(msg,0,len);
-	return msg;
+	struct tcp_ack_flow *flow;
+
+	hlist_for_each_entry(flow, &ack_m->hash[hash], node) {
+		if (flow->ack_msg.dest == msg->dest &&
+		    flow->ack_msg.source == msg->source &&
+		    flow->ack_msg.saddr == msg->saddr &&
+		    flow->ack_msg.daddr == msg->daddr)
+			return flow;
+	}
+	return NULL;
 }
-						
-void intf_tcp_drop_msg(struct rwnx_hw *priv,
-					    struct msg_buf *msg)
+
+/* free the least recently used flow once idle, one per call */
+static void tcp_ack_age(struct tcp_ack_manage *ack_m)
 {
-	//printk("%s \n",__func__);
-	if (msg->skb)
-		dev_kfree_skb_any(msg->skb);
+	struct tcp_ack_flow *flow;
+
+	if (list_empty(&ack_m->lru))
+		return;
+	flow = list_first_entry(&ack_m->lru, struct tcp_ack_flow, lru);
+	if (flow->held || time_before(jiffies, flow->last_time + ack_m->timeout))
+		return;
 
-	kfree(msg);
+	hlist_del(&flow->node);
+	list_del(&flow->lru);
+	ack_m->nr_flows--;
+	kfree(flow);
 }
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0) 
@@ -30,174 +68,191 @@ void tcp_ack_timeout(unsigned long data)
 void tcp_ack_timeout(struct timer_list *t)
 #endif
 {
-	//printk("%s \n",__func__);
-	struct tcp_ack_info *ack_info;
-	struct msg_buf *msg;
-	struct tcp_ack_manage *ack_m = NULL;
+	struct tcp_ack_manage *ack_m;
+	struct tcp_ack_flow *flow, *tmp;
+	struct sk_buff_head list;
+	struct sk_buff *skb;
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0) 
-	ack_info = (struct tcp_ack_info *)data;
+	ack_m = (struct tcp_ack_manage *)data;
 #else
-	ack_info = container_of(t,struct tcp_ack_info,timer);
+	ack_m = container_of(t, struct tcp_ack_manage, timer);
 #endif
 
-	ack_m = container_of(ack_info, struct tcp_ack_manage,
-			     ack_info[ack_info->ack_info_num]);
-
-	write_seqlock_bh(&ack_info->seqlock);
-	msg = ack_info->msgbuf;
-	if (ack_info->busy && msg && !ack_info->in_send_msg) {
-		ack_info->msgbuf = NULL;
-		ack_info->drop_cnt = 0;
-		ack_info->in_send_msg = msg;
-		write_sequnlock_bh(&ack_info->seqlock);
-		intf_tx(ack_m->priv, msg);//send skb
-		//ack_info->in_send_msg = NULL;//add by dwx
-		//write_sequnlock_bh(&ack_info->seqlock);
-		//intf_tx(ack_m->priv, msg);
-		return;
+	__skb_queue_head_init(&list);
+
+	/* held is in deadline order */
+	spin_lock_bh(&ack_m->lock);
+	list_for_each_entry_safe(flow, tmp, &ack_m->held, held_list) {
+		if (time_before(jiffies, flow->deadline)) {
+			mod_timer(&ack_m->timer, flow->deadline);
+			break;
+		}
+		flow->drop_cnt = 0;
+		__skb_queue_tail(&list, tcp_ack_unhold(flow));
+		ack_m->stats.timeout++;
 	}
-	write_sequnlock_bh(&ack_info->seqlock);
+	spin_unlock_bh(&ack_m->lock);
+
+	while ((skb = __skb_dequeue(&list)))
+		intf_tx(ack_m->priv, skb);//send skb
 }
 
 void tcp_ack_init(struct rwnx_hw *priv)
 {
-	int i;
-	struct tcp_ack_info *ack_info;
+	u32 i;
 	struct tcp_ack_manage *ack_m = &priv->ack_m;
 
-	printk("========== tcp ack debug %s \n",__func__);
 	memset(ack_m, 0, sizeof(struct tcp_ack_manage));
 	ack_m->priv = priv;
 	spin_lock_init(&ack_m->lock);
+	INIT_LIST_HEAD(&ack_m->lru);
+	INIT_LIST_HEAD(&ack_m->held);
 	atomic_set(&ack_m->max_drop_cnt, TCP_ACK_DROP_CNT);
-	ack_m->last_time = jiffies;
 	ack_m->timeout = msecs_to_jiffies(ACK_OLD_TIME);
+	ack_m->ack_winsize = MIN_WIN;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0) 
+	setup_timer(&ack_m->timer, tcp_ack_timeout, (unsigned long)ack_m);
+#else
+	timer_setup(&ack_m->timer, tcp_ack_timeout, 0);
+#endif
 
-	for (i = 0; i < TCP_ACK_NUM; i++) {
-		ack_info = &ack_m->ack_info[i];
-		ack_info->ack_info_num = i;
-		seqlock_init(&ack_info->seqlock);
-		ack_info->last_time = jiffies;
-		ack_info->timeout = msecs_to_jiffies(ACK_OLD_TIME);
-
-		#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0) 
-			setup_timer(&ack_info->timer, tcp_ack_timeout,
-				    (unsigned long)ack_info);
-		#else
-			timer_setup(&ack_info->timer,tcp_ack_timeout,0);
-		#endif
+	ack_m->max_flows = clamp(tcp_ack_flows, 1, 1024);
+	ack_m->hash_mask = roundup_pow_of_two(ack_m->max_flows) - 1;
+	ack_m->hash = kcalloc(ack_m->hash_mask + 1, sizeof(*ack_m->hash), GFP_KERNEL);
+	if (!ack_m->hash) {
+		AICWFDBG(LOGERROR, "%s: no memory, filter disabled\n", __func__);
+		return;
 	}
+	for (i = 0; i <= ack_m->hash_mask; i++)
+		INIT_HLIST_HEAD(&ack_m->hash[i]);
+	get_random_bytes(&ack_m->hash_seed, sizeof(ack_m->hash_seed));
 
+	AICWFDBG(LOGINFO, "%s: %d flows\n", __func__, ack_m->max_flows);
 	atomic_set(&ack_m->enable, 1);
-	ack_m->ack_winsize = MIN_WIN;
 }
 
 void tcp_ack_deinit(struct rwnx_hw *priv)
 {
-	int i;
 	struct tcp_ack_manage *ack_m = &priv->ack_m;
-	struct msg_buf *drop_msg = NULL;
+	struct tcp_ack_flow *flow, *tmp;
+	struct sk_buff *skb;
 
 	printk("%s \n",__func__);
 	atomic_set(&ack_m->enable, 0);
+	del_timer_sync(&ack_m->timer);
 
-	for (i = 0; i < TCP_ACK_NUM; i++) {
-		drop_msg = NULL;
-
-		write_seqlock_bh(&ack_m->ack_info[i].seqlock);
-		del_timer(&ack_m->ack_info[i].timer);
-		drop_msg = ack_m->ack_info[i].msgbuf;
-		ack_m->ack_info[i].msgbuf = NULL;
-		write_sequnlock_bh(&ack_m->ack_info[i].seqlock);
-
-		if (drop_msg)
-			intf_tcp_drop_msg(priv, drop_msg);//drop skb
+	spin_lock_bh(&ack_m->lock);
+	list_for_each_entry_safe(flow, tmp, &ack_m->lru, lru) {
+		skb = tcp_ack_unhold(flow);
+		if (skb)
+			dev_kfree_skb_any(skb);//drop skb
+		hlist_del(&flow->node);
+		list_del(&flow->lru);
+		kfree(flow);
 	}
+	ack_m->nr_flows = 0;
+	spin_unlock_bh(&ack_m->lock);
+
+	kfree(ack_m->hash);
+	ack_m->hash = NULL;
 }
 
-int tcp_check_quick_ack(unsigned char *buf,
-				      struct tcp_ack_msg *msg)
+/* return the tcp header of an ipv4 tcp ack, NULL otherwise */
+static struct tcphdr *tcp_ack_hdr(unsigned char *buf, unsigned int plen,
+				struct iphdr **ip)
 {
 	int ip_hdr_len;
-	unsigned char *temp;
 	struct ethhdr *ethhdr;
 	struct iphdr *iphdr;
 	struct tcphdr *tcphdr;
 
+	if (plen < sizeof(struct ethhdr) + sizeof(struct iphdr))
+		return NULL;
 	ethhdr = (struct ethhdr *)buf;
 	if (ethhdr->h_proto != htons(ETH_P_IP))
-		return 0;
+		return NULL;
 	iphdr = (struct iphdr *)(ethhdr + 1);
 	if (iphdr->version != 4 || iphdr->protocol != IPPROTO_TCP)
-		return 0;
+		return NULL;
 	ip_hdr_len = iphdr->ihl * 4;
-	temp = (unsigned char *)(iphdr) + ip_hdr_len;
-	tcphdr = (struct tcphdr *)temp;
-	/* TCP_FLAG_ACK */
-	if (!(temp[13] & 0x10))
-		return 0;
+	if (ip_hdr_len < sizeof(struct iphdr) ||
+	    plen < sizeof(struct ethhdr) + ip_hdr_len + sizeof(struct tcphdr))
+		return NULL;
+	tcphdr = (struct tcphdr *)((unsigned char *)iphdr + ip_hdr_len);
+	if (!tcphdr->ack ||
+	    plen < sizeof(struct ethhdr) + ip_hdr_len + tcphdr->doff * 4)
+		return NULL;
+
+	*ip = iphdr;
+	return tcphdr;
+}
 
-	if (temp[13] & 0x8) {
-		msg->saddr = iphdr->daddr;
-		msg->daddr = iphdr->saddr;
-		msg->source = tcphdr->dest;
-		msg->dest = tcphdr->source;
-		msg->seq = ntohl(tcphdr->seq);
-		return 1;
-	}
+int tcp_check_quick_ack(unsigned char *buf, unsigned int plen,
+				      struct tcp_ack_msg *msg)
+{
+	struct iphdr *iphdr;
+	struct tcphdr *tcphdr;
+
+	tcphdr = tcp_ack_hdr(buf, plen, &iphdr);
+	if (!tcphdr || !tcphdr->psh)
+		return 0;
 
-	return 0;
+	/* reversed, to match the tx flow acking it */
+	msg->saddr = iphdr->daddr;
+	msg->daddr = iphdr->saddr;
+	msg->source = tcphdr->dest;
+	msg->dest = tcphdr->source;
+	msg->seq = ntohl(tcphdr->seq);
+	return 1;
 }
 
 int is_drop_tcp_ack(struct tcphdr *tcphdr, int tcp_tot_len,
 				unsigned short *win_scale)
 {
-	//printk("%s \n",__func__);
 	int drop = 1;
 	int len = tcphdr->doff * 4;
 	unsigned char *ptr;
 
-	if(tcp_tot_len > len) {
-		drop = 0;
-	} else {
-		len -= sizeof(struct tcphdr);
-		ptr = (unsigned char *)(tcphdr + 1);
-
-		while ((len > 0) && drop) {
-			int opcode = *ptr++;
-			int opsize;
-
-			switch (opcode) {
-			case TCPOPT_EOL:
-				break;
-			case TCPOPT_NOP:
-				len--;
-				continue;
-			default:
-				opsize = *ptr++;
-				if (opsize < 2)
-					break;
-				if (opsize > len)
-					break;
-
-				switch (opcode) {
-				/* TODO: Add other ignore opt */
-				case TCPOPT_TIMESTAMP:
-					break;
-				case TCPOPT_WINDOW:
-					if (*ptr < 15)
-						*win_scale = (1 << (*ptr));
-					//printk("%d\n",*win_scale);
-					break;
-				default:
-					drop = 2;
-				}
-
-				ptr += opsize - 2;
-				len -= opsize;
-			}
+	if (tcp_tot_len > len)
+		return 0;
+
+	len -= sizeof(struct tcphdr);
+	ptr = (unsigned char *)(tcphdr + 1);
+
+	while (len > 0) {
+		int opcode = *ptr++;
+		int opsize;
+
+		if (opcode == TCPOPT_EOL)
+			break;
+		if (opcode == TCPOPT_NOP) {
+			len--;
+			continue;
 		}
+		/* malformed, let it through untouched */
+		if (len < 2)
+			return 2;
+		opsize = *ptr++;
+		if (opsize < 2 || opsize > len)
+			return 2;
+
+		switch (opcode) {
+		/* TODO: Add other ignore opt */
+		case TCPOPT_TIMESTAMP:
+			break;
+		case TCPOPT_WINDOW:
+			if (*ptr < 15)
+				*win_scale = (1 << (*ptr));
+			drop = 2;
+			break;
+		default:
+			drop = 2;
+		}
+
+		ptr += opsize - 2;
+		len -= opsize;
 	}
 
 	return drop;
@@ -209,422 +264,165 @@ int is_drop_tcp_ack(struct tcphdr *tcphdr, int tcp_tot_len,
  *	2 for other ack whith more info
  */
 
-int tcp_check_ack(unsigned char *buf,
+int tcp_check_ack(unsigned char *buf, unsigned int plen,
 				struct tcp_ack_msg *msg,
 				unsigned short *win_scale)
 {
 	int ret;
-	int ip_hdr_len;
 	int tcp_tot_len;
-	unsigned char *temp;
-	struct ethhdr *ethhdr;
 	struct iphdr *iphdr;
 	struct tcphdr *tcphdr;
 
-	ethhdr =(struct ethhdr *)buf;
-	if (ethhdr->h_proto != htons(ETH_P_IP))
-		return 0;
-
-	iphdr = (struct iphdr *)(ethhdr + 1);
-	if (iphdr->version != 4 || iphdr->protocol != IPPROTO_TCP)
-		return 0;
-
-	ip_hdr_len = iphdr->ihl * 4;
-	temp = (unsigned char *)(iphdr) + ip_hdr_len;
-	tcphdr = (struct tcphdr *)temp;
-	/* TCP_FLAG_ACK */
-	if (!(temp[13] & 0x10))
+	tcphdr = tcp_ack_hdr(buf, plen, &iphdr);
+	if (!tcphdr)
 		return 0;
 
-	tcp_tot_len = ntohs(iphdr->tot_len) - ip_hdr_len;// tcp total len
+	tcp_tot_len = ntohs(iphdr->tot_len) - iphdr->ihl * 4;// tcp total len
 	ret = is_drop_tcp_ack(tcphdr, tcp_tot_len, win_scale);
-	//printk("is drop:%d \n",ret);
-
-	if (ret > 0) {
-		msg->saddr = iphdr->saddr;
-		msg->daddr = iphdr->daddr;
-		msg->source = tcphdr->source;
-		msg->dest = tcphdr->dest;
-		msg->seq = ntohl(tcphdr->ack_seq);
-		msg->win = ntohs(tcphdr->window);
-	}
-	
-	return ret;
-}
-
-/* return val: -1 for not match, others for match */
-int tcp_ack_match(struct tcp_ack_manage *ack_m,
-				struct tcp_ack_msg *ack_msg)
-{
-	int i, ret = -1;
-	unsigned start;
-	struct tcp_ack_info *ack_info;
-	struct tcp_ack_msg *ack;
-
-	for (i = 0; ((ret < 0) && (i < TCP_ACK_NUM)); i++) {
-		ack_info = &ack_m->ack_info[i];
-		do {
-			start = read_seqbegin(&ack_info->seqlock);
-			ret = -1;
-
-			ack = &ack_info->ack_msg;
-			if (ack_info->busy &&
-			    ack->dest == ack_msg->dest &&
-			    ack->source == ack_msg->source &&
-			    ack->saddr == ack_msg->saddr &&
-			    ack->daddr == ack_msg->daddr)
-				ret = i;
-		} while(read_seqretry(&ack_info->seqlock, start));
-	}
-
-	return ret;
-}
-
-
-void tcp_ack_update(struct tcp_ack_manage *ack_m)
-{
-	int i;
-	struct tcp_ack_info *ack_info;
-
-	if (time_after(jiffies, ack_m->last_time + ack_m->timeout)) {
-		spin_lock_bh(&ack_m->lock);
-		ack_m->last_time = jiffies;
-		for (i = TCP_ACK_NUM - 1; i >= 0; i--) {
-			ack_info = &ack_m->ack_info[i];
-			write_seqlock_bh(&ack_info->seqlock);
-			if (ack_info->busy &&
-			    time_after(jiffies, ack_info->last_time +
-				       ack_info->timeout)) {
-				ack_m->free_index = i;
-				ack_m->max_num--;
-				ack_info->busy = 0;
-			}
-			write_sequnlock_bh(&ack_info->seqlock);
-		}
-		spin_unlock_bh(&ack_m->lock);
-	}
-}
-
-/* return val: -1 for no index, others for index */
-int tcp_ack_alloc_index(struct tcp_ack_manage *ack_m)
-{
-	int i, ret = -1;
-	struct tcp_ack_info *ack_info;
-	unsigned start;
-
-	spin_lock_bh(&ack_m->lock);
-	if (ack_m->max_num == TCP_ACK_NUM) {
-		spin_unlock_bh(&ack_m->lock);
-		return -1;
-	}
-
-	if (ack_m->free_index >= 0) {
-		i = ack_m->free_index;
-		ack_m->free_index = -1;
-		ack_m->max_num++;
-		spin_unlock_bh(&ack_m->lock);
-		return i;
-	}
-
-	for (i = 0; ((ret < 0) && (i < TCP_ACK_NUM)); i++) {
-		ack_info = &ack_m->ack_info[i];
-		do {
-			start = read_seqbegin(&ack_info->seqlock);
-			ret = -1;
-			if (!ack_info->busy) {
-				ack_m->free_index = -1;
-				ack_m->max_num++;
-				ret = i;
-			}
-		} while(read_seqretry(&ack_info->seqlock, start));
-	}
-	spin_unlock_bh(&ack_m->lock);
-
-	return ret;
-}
-
-
-/* return val: 0 for not handle tx, 1 for handle tx */
-int tcp_ack_handle(struct msg_buf *new_msgbuf,
-			  struct tcp_ack_manage *ack_m,
-			  struct tcp_ack_info *ack_info,
-			  struct tcp_ack_msg *ack_msg,
-			  int type)
-{
-	int quick_ack = 0;
-	struct tcp_ack_msg *ack;
-	int ret = 0;
-	struct msg_buf *drop_msg = NULL;
-
-	//printk("%s %d",__func__,type);
-	write_seqlock_bh(&ack_info->seqlock);
-
-	ack_info->last_time = jiffies;
-	ack = &ack_info->ack_msg;
-
-	if (type == 2) {
-		if (U32_BEFORE(ack->seq, ack_msg->seq)) {
-			ack->seq = ack_msg->seq;
-			if (ack_info->psh_flag &&
-			    !U32_BEFORE(ack_msg->seq,
-					       ack_info->psh_seq)) {
-				ack_info->psh_flag = 0;
-			}
-
-			if (ack_info->msgbuf) {
-				//printk("%lx \n",ack_info->msgbuf);
-				drop_msg = ack_info->msgbuf;
-				ack_info->msgbuf = NULL;
-				del_timer(&ack_info->timer);
-			}else{
-				//printk("msgbuf is NULL \n");
-			}
-
-			ack_info->in_send_msg = NULL;
-			ack_info->drop_cnt = atomic_read(&ack_m->max_drop_cnt);
-		} else {
-			printk("%s before abnormal ack: %d, %d\n",
-			       __func__, ack->seq, ack_msg->seq);
-			drop_msg = new_msgbuf;
-			ret = 1;
-		}
-	} else if (U32_BEFORE(ack->seq, ack_msg->seq)) {
-		if (ack_info->msgbuf) {
-			drop_msg = ack_info->msgbuf;
-			ack_info->msgbuf = NULL;
-		}
-
-		if (ack_info->psh_flag &&
-		    !U32_BEFORE(ack_msg->seq, ack_info->psh_seq)) {
-			ack_info->psh_flag = 0;
-			quick_ack = 1;
-		} else {
-			ack_info->drop_cnt++;
-		}
-
-		ack->seq = ack_msg->seq;
-
-		if (quick_ack || (!ack_info->in_send_msg &&
-				  (ack_info->drop_cnt >=
-				   atomic_read(&ack_m->max_drop_cnt)))) {
-			ack_info->drop_cnt = 0;
-			ack_info->in_send_msg = new_msgbuf;
-			del_timer(&ack_info->timer);
-		} else {
-			ret = 1;
-			ack_info->msgbuf = new_msgbuf;
-			if (!timer_pending(&ack_info->timer))
-				mod_timer(&ack_info->timer,
-					  (jiffies + msecs_to_jiffies(5)));
-		}
-	} else {
-		printk("%s before ack: %d, %d\n",
-		       __func__, ack->seq, ack_msg->seq);
-		drop_msg = new_msgbuf;
-		ret = 1;
-	}
-
-	write_sequnlock_bh(&ack_info->seqlock);
-
-	if (drop_msg)
-		intf_tcp_drop_msg(ack_m->priv, drop_msg);// drop skb
-
-	return ret;
-}
-
-int tcp_ack_handle_new(struct msg_buf *new_msgbuf,
-			  struct tcp_ack_manage *ack_m,
-			  struct tcp_ack_info *ack_info,
-			  struct tcp_ack_msg *ack_msg,
-			  int type)
-{
-	int quick_ack = 0;
-	struct tcp_ack_msg *ack;
-	int ret = 0;
-	struct msg_buf *drop_msg = NULL;
-	//struct msg_buf * send_msg = NULL;
-	//printk("",);
-	write_seqlock_bh(&ack_info->seqlock);
-
-        ack_info->last_time = jiffies;
-        ack = &ack_info->ack_msg;
-
-	if(U32_BEFORE(ack->seq, ack_msg->seq)){
-		if (ack_info->msgbuf) {
-			drop_msg = ack_info->msgbuf;
-			ack_info->msgbuf = NULL;
-			//ack_info->drop_cnt++;
-		}
-
-		if (ack_info->psh_flag &&
-		    !U32_BEFORE(ack_msg->seq, ack_info->psh_seq)) {
-			ack_info->psh_flag = 0;
-			quick_ack = 1;
-		} else {
-			ack_info->drop_cnt++;
-		}
-
-		ack->seq = ack_msg->seq;
-
-		if(quick_ack || (!ack_info->in_send_msg &&
-				  (ack_info->drop_cnt >=
-				   atomic_read(&ack_m->max_drop_cnt)))){
-			ack_info->drop_cnt = 0;
-			//send_msg = new_msgbuf;
-			ack_info->in_send_msg = new_msgbuf;
-			del_timer(&ack_info->timer);
-		}else{
-			ret = 1;
-			ack_info->msgbuf = new_msgbuf;
-			if (!timer_pending(&ack_info->timer))
-				mod_timer(&ack_info->timer,
-					  (jiffies + msecs_to_jiffies(5)));
-		}
-		
-		//ret = 1;
-	}else {
-		printk("%s before ack: %d, %d\n",
-		       __func__, ack->seq, ack_msg->seq);
-		drop_msg = new_msgbuf;
-		ret = 1;
-	}
-
-	/*if(send_msg){
-		intf_tx(ack_m->priv,send_msg);
-		ack_info->in_send_msg=NULL;
-	}*/
-
-	//ack_info->in_send_msg=NULL;
-	
-	write_sequnlock_bh(&ack_info->seqlock);
+	if (!ret)
+		return 0;
 
-    	/*if(send_msg){
-            intf_tx(ack_m->priv,send_msg);
-            //ack_info->in_send_msg=NULL;
-    	}*/
+	/* never thin syn, fin, rst, urg or ecn signalling */
+	if (tcphdr->syn || tcphdr->fin || tcphdr->rst || tcphdr->urg ||
+	    tcphdr->ece || tcphdr->cwr)
+		ret = 2;
 
-	if (drop_msg)
-		intf_tcp_drop_msg(ack_m->priv, drop_msg);// drop skb
+	msg->saddr = iphdr->saddr;
+	msg->daddr = iphdr->daddr;
+	msg->source = tcphdr->source;
+	msg->dest = tcphdr->dest;
+	msg->seq = ntohl(tcphdr->ack_seq);
+	msg->win = ntohs(tcphdr->window);
 
 	return ret;
-
 }
 
 void filter_rx_tcp_ack(struct rwnx_hw *priv,
 			      unsigned char *buf, unsigned plen)
 {
-	int index;
 	struct tcp_ack_msg ack_msg;
-	struct tcp_ack_info *ack_info;
+	struct tcp_ack_flow *flow;
 	struct tcp_ack_manage *ack_m = &priv->ack_m;
 
 	if (!atomic_read(&ack_m->enable))
 		return;
 
-	if ((plen > MAX_TCP_ACK) ||
-	    !tcp_check_quick_ack(buf, &ack_msg))
+	if (!tcp_check_quick_ack(buf, plen, &ack_msg))
 		return;
 
-	index = tcp_ack_match(ack_m, &ack_msg);
-	if (index >= 0) {
-		ack_info = ack_m->ack_info + index;
-		write_seqlock_bh(&ack_info->seqlock);
-		ack_info->psh_flag = 1;
-		ack_info->psh_seq = ack_msg.seq;
-		write_sequnlock_bh(&ack_info->seqlock);
+	spin_lock_bh(&ack_m->lock);
+	flow = tcp_ack_lookup(ack_m, &ack_msg, tcp_ack_hash(ack_m, &ack_msg));
+	if (flow) {
+		flow->psh_flag = 1;
+		flow->psh_seq = ack_msg.seq;
 	}
+	spin_unlock_bh(&ack_m->lock);
 }
 
-/* return val: 0 for not filter, 1 for filter */
-int filter_send_tcp_ack(struct rwnx_hw *priv,
-			       struct msg_buf *msgbuf,
-			       unsigned char *buf, unsigned int plen)
+/* return val: 0 for not filter, 1 for filter (skb consumed) */
+int filter_send_tcp_ack(struct rwnx_hw *priv, struct sk_buff *skb)
 {
-//	printk("%s \n",__func__);
 	int ret = 0;
-	int index, drop;
+	int drop;
+	bool newer, quick, small_win;
 	unsigned short win_scale = 0;
-	unsigned int win = 0;
+	u32 hash;
 	struct tcp_ack_msg ack_msg;
-	struct tcp_ack_msg *ack;
-	struct tcp_ack_info *ack_info;
+	struct tcp_ack_flow *flow;
+	struct sk_buff *drop_skb = NULL, *send_skb = NULL;
 	struct tcp_ack_manage *ack_m = &priv->ack_m;
 
-	tcp_ack_update(ack_m);
-	drop = tcp_check_ack(buf, &ack_msg, &win_scale);
-//	printk("drop:%d win_scale:%d",drop,win_scale);
-	if (!drop && (0 == win_scale))
+	if (!atomic_read(&ack_m->enable) || skb_is_nonlinear(skb))
 		return 0;
 
-	index = tcp_ack_match(ack_m, &ack_msg);
-	if (index >= 0) {
-		ack_info = ack_m->ack_info + index;
-		if ((0 != win_scale) &&
-			(ack_info->win_scale != win_scale)) {
-			write_seqlock_bh(&ack_info->seqlock);
-			ack_info->win_scale = win_scale;
-			write_sequnlock_bh(&ack_info->seqlock);
-		}
+	drop = tcp_check_ack(skb->data, skb->len, &ack_msg, &win_scale);
+	if (!drop)
+		return 0;
 
-		if (drop > 0 && atomic_read(&ack_m->enable)) {
-			win = ack_info->win_scale * ack_msg.win;
-			if ((win_scale!=0) && (win < (ack_m->ack_winsize * SIZE_KB)))
-			{	
-				drop = 2;
-				printk("%d %d %d",win_scale,win,(ack_m->ack_winsize * SIZE_KB));
-			}
-			ret = tcp_ack_handle_new(msgbuf, ack_m, ack_info,
-						&ack_msg, drop);
-		}
+	hash = tcp_ack_hash(ack_m, &ack_msg);
 
+	spin_lock_bh(&ack_m->lock);
+	tcp_ack_age(ack_m);
+
+	flow = tcp_ack_lookup(ack_m, &ack_msg, hash);
+	if (!flow) {
+		/* first ack of a flow is sent as is */
+		if (ack_m->nr_flows < ack_m->max_flows)
+			flow = kzalloc(sizeof(*flow), GFP_ATOMIC);
+		if (!flow) {
+			ack_m->stats.no_flow++;
+			goto out;
+		}
+		INIT_LIST_HEAD(&flow->held_list);
+		flow->ack_msg = ack_msg;
+		flow->win_scale = win_scale ? win_scale : 1;
+		flow->drop_cnt = atomic_read(&ack_m->max_drop_cnt);
+		flow->last_time = jiffies;
+		hlist_add_head(&flow->node, &ack_m->hash[hash]);
+		list_add_tail(&flow->lru, &ack_m->lru);
+		ack_m->nr_flows++;
 		goto out;
 	}
 
-	index = tcp_ack_alloc_index(ack_m);
-	if (index >= 0) {
-		write_seqlock_bh(&ack_m->ack_info[index].seqlock);
-		ack_m->ack_info[index].busy = 1;
-		ack_m->ack_info[index].psh_flag = 0;
-		ack_m->ack_info[index].last_time = jiffies;
-		ack_m->ack_info[index].drop_cnt =
-			atomic_read(&ack_m->max_drop_cnt);
-		ack_m->ack_info[index].win_scale =
-			(win_scale != 0) ? win_scale : 1;
-		
-		//ack_m->ack_info[index].msgbuf = NULL;
-		//ack_m->ack_info[index].in_send_msg = NULL;
-		ack = &ack_m->ack_info[index].ack_msg;
-		ack->dest = ack_msg.dest;
-		ack->source = ack_msg.source;
-		ack->saddr = ack_msg.saddr;
-		ack->daddr = ack_msg.daddr;
-		ack->seq = ack_msg.seq;
-		write_sequnlock_bh(&ack_m->ack_info[index].seqlock);
+	flow->last_time = jiffies;
+	list_move_tail(&flow->lru, &ack_m->lru);
+	if (win_scale)
+		flow->win_scale = win_scale;
+
+	if (!U32_BEFORE(flow->ack_msg.seq, ack_msg.seq)) {
+		/* older than an ack already seen */
+		ack_m->stats.dropped++;
+		drop_skb = skb;
+		ret = 1;
+		goto out;
 	}
 
-out:
-	return ret;
-}
+	newer = flow->ack_msg.seq != ack_msg.seq;
+	flow->ack_msg.seq = ack_msg.seq;
+	flow->ack_msg.win = ack_msg.win;
 
-void move_tcpack_msg(struct rwnx_hw *priv,
-			    struct msg_buf *msg)
-{
-	struct tcp_ack_info *ack_info;
-	struct tcp_ack_manage *ack_m = &priv->ack_m;
-	int i = 0;
+	quick = flow->psh_flag && !U32_BEFORE(ack_msg.seq, flow->psh_seq);
+	if (quick)
+		flow->psh_flag = 0;
 
-	if (!atomic_read(&ack_m->enable))
-		return;
+	small_win = flow->win_scale * ack_msg.win < ack_m->ack_winsize * SIZE_KB;
 
-	//if (msg->len > MAX_TCP_ACK)
-	//	return;
+	/* duplicate acks are not thinned, fast retransmit counts them */
+	if (drop == 1 && newer && !quick && !small_win &&
+	    ++flow->drop_cnt < atomic_read(&ack_m->max_drop_cnt)) {
+		drop_skb = flow->held;
+		if (drop_skb) {
+			ack_m->stats.dropped++;
+		} else {
+			flow->deadline = jiffies +
+				max(1UL, msecs_to_jiffies(TCP_ACK_HOLD_MS));
+			list_add_tail(&flow->held_list, &ack_m->held);
+			if (!timer_pending(&ack_m->timer))
+				mod_timer(&ack_m->timer, flow->deadline);
+		}
+		flow->held = skb;
+		ack_m->stats.held++;
+		ret = 1;
+		goto out;
+	}
 
-	for (i = 0; i < TCP_ACK_NUM; i++) {
-		ack_info = &ack_m->ack_info[i];
-		write_seqlock_bh(&ack_info->seqlock);
-		if (ack_info->busy && (ack_info->in_send_msg == msg))
-			ack_info->in_send_msg = NULL;
-		write_sequnlock_bh(&ack_info->seqlock);
+	/* sent now, a held ack goes first unless this one covers it */
+	flow->drop_cnt = 0;
+	send_skb = tcp_ack_unhold(flow);
+	if (send_skb && newer) {
+		drop_skb = send_skb;
+		send_skb = NULL;
+		ack_m->stats.dropped++;
 	}
-}
+	ack_m->stats.sent++;
 
+out:
+	spin_unlock_bh(&ack_m->lock);
+
+	if (drop_skb)
+		dev_kfree_skb_any(drop_skb);// drop skb
+	if (send_skb)
+		intf_tx(priv, send_skb);
+
+	return ret;
+}
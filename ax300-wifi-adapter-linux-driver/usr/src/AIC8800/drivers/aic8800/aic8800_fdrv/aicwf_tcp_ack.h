@@ -10,9 +10,10 @@
 #include <linux/timer.h>
 
 
-#define TCP_ACK_NUM  32
-#define TCP_ACK_EXIT_VAL		0x800
+#define TCP_ACK_FLOWS		64
 #define TCP_ACK_DROP_CNT		10
+/* delay before a held ack is sent anyway */
+#define TCP_ACK_HOLD_MS		5
 
 #define ACK_OLD_TIME	4000
 #define U32_BEFORE(a, b)	((__s32)((__u32)a - (__u32)b) <= 0)
@@ -23,13 +24,6 @@
 #define SIZE_KB 1024
 
 
-struct msg_buf {
-	//struct list_head list;
-	struct sk_buff *skb;
-	struct rwnx_vif *rwnx_vif;
-	/* data just tx cmd use,not include the head */
-};
-
 struct tcp_ack_msg {
 	u16 source;
 	u16 dest;
@@ -39,42 +33,59 @@ struct tcp_ack_msg {
 	u16 win;
 };
 
-
-struct tcp_ack_info {
-	int ack_info_num;
-	int busy;
+/**
+ * struct tcp_ack_flow - One tx TCP flow whose pure acks are thinned
+ *
+ * @node: In tcp_ack_manage.hash
+ * @lru: In tcp_ack_manage.lru, most recently used last
+ * @held_list: In tcp_ack_manage.held while @held is set
+ * @held: Latest ack, not sent yet
+ * @deadline: When @held must be sent anyway
+ */
+struct tcp_ack_flow {
+	struct hlist_node node;
+	struct list_head lru;
+	struct list_head held_list;
+	struct sk_buff *held;
+	unsigned long deadline;
+	unsigned long last_time;
+	struct tcp_ack_msg ack_msg;
 	int drop_cnt;
 	int psh_flag;
 	u32 psh_seq;
+	/* 0 until seen in the handshake */
 	u16 win_scale;
-	/* seqlock for ack info */
-	seqlock_t seqlock;
-	unsigned long last_time;
-	unsigned long timeout;
-	struct timer_list timer;
-	struct msg_buf *msgbuf;
-	struct msg_buf *in_send_msg;
-	struct tcp_ack_msg ack_msg;
+};
+
+struct tcp_ack_stats {
+	u32 held;
+	u32 dropped;
+	u32 sent;
+	u32 timeout;
+	u32 no_flow;
 };
 
 struct tcp_ack_manage {
 	/* 1 filter */
 	atomic_t enable;
-	int max_num;
-	int free_index;
-	unsigned long last_time;
-	unsigned long timeout;
 	atomic_t max_drop_cnt;
-	/* lock for tcp ack alloc and free */
+	/* lock for flows and held acks */
 	spinlock_t lock;
 	struct rwnx_hw *priv;
-	struct tcp_ack_info ack_info[TCP_ACK_NUM];
+	struct hlist_head *hash;
+	u32 hash_mask;
+	u32 hash_seed;
+	int max_flows;
+	int nr_flows;
+	struct list_head lru;
+	struct list_head held;
+	struct timer_list timer;
+	unsigned long timeout;
 	/*size in KB*/
 	unsigned int ack_winsize;
+	struct tcp_ack_stats stats;
 };
 
-struct msg_buf *intf_tcp_alloc_msg(struct msg_buf *msg);
-
 void tcp_ack_init(struct rwnx_hw *priv);
 
 void tcp_ack_deinit(struct rwnx_hw *priv);
@@ -82,11 +93,10 @@ void tcp_ack_deinit(struct rwnx_hw *priv);
 
 int is_drop_tcp_ack(struct tcphdr *tcphdr, int tcp_tot_len, unsigned short *win_scale);
 
-int is_tcp_ack(struct sk_buff *skb, unsigned short *win_scale);
-
-int filter_send_tcp_ack(struct rwnx_hw *priv, struct msg_buf *msgbuf,unsigned char *buf, unsigned int plen);
+int filter_send_tcp_ack(struct rwnx_hw *priv, struct sk_buff *skb);
 
+/* buf is the ethernet header, plen the linear bytes from there (the skb is
+ * past eth_type_trans(), skb->len would count its frags and miss ETH_HLEN) */
 void filter_rx_tcp_ack(struct rwnx_hw *priv,unsigned char *buf, unsigned plen);
 
-void move_tcpack_msg(struct rwnx_hw *priv, struct msg_buf * msg);
 #endif
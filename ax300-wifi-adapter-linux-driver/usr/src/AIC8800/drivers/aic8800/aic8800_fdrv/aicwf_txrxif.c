@@ -35,6 +35,13 @@ void aicwf_tasklet_tx_process(struct aic_usb_dev *usb_dev);
 #endif
 extern bool aicwf_usb_rx_aggr;
 
+#ifdef CONFIG_USB_RX_RING
+/* the ring doorbell replaces rx_cnt, consumer keeps no shared counter */
+#define aicwf_rx_cnt_dec(rx_priv)
+#else
+#define aicwf_rx_cnt_dec(rx_priv)   atomic_dec(&(rx_priv)->rx_cnt)
+#endif
+
 #ifdef CONFIG_PREALLOC_RX_SKB
 void aicwf_rxframe_queue_init_2(struct rx_frame_queue *pq, int max_len)
 {
@@ -72,7 +79,7 @@ void rxbuff_queue_flush(struct aicwf_rx_priv* rx_priv)
 #if 0
         rxbuff_free(tempbuf);
 #else
-        aicwf_prealloc_rxbuff_free(tempbuf, &rx_priv->rxbuff_lock);
+        aicwf_prealloc_rxbuff_free(tempbuf);
 #endif
         pq->qcnt--;
     }
@@ -214,6 +221,12 @@ void aicwf_bus_deinit(struct device *dev)
 
 #ifdef AICWF_USB_SUPPORT
     usb = bus_if->bus_priv.usb;
+    //bustx owns the posted urb list, stop it before walking that list
+    if (bus_if->bustx_thread) {
+        complete_all(&bus_if->bustx_trgg);
+        kthread_stop(bus_if->bustx_thread);
+        bus_if->bustx_thread = NULL;
+    }
 	aicwf_usb_cancel_all_urbs(usb);//AIDEN
 
     if(g_rwnx_plat && g_rwnx_plat->enabled){
@@ -280,7 +293,8 @@ void aicwf_frame_tx(void *dev, struct sk_buff *skb)
 			aicwf_usb_tx_flowctrl(usbdev->rwnx_hw, true);
 		spin_unlock_irqrestore(&usbdev->tx_flow_lock, flags);
 		txhdr = (struct rwnx_txhdr *)skb->data;
-		kmem_cache_free(usbdev->rwnx_hw->sw_txhdr_cache, txhdr->sw_hdr);
+		rwnx_sw_txhdr_free(usbdev->rwnx_hw, txhdr->sw_hdr);
+        rwnx_tx_bql_done(skb);
         dev_kfree_skb(skb);
         return;
     }
@@ -463,6 +477,43 @@ int aicwf_tasklet_rxframes(struct aicwf_rx_priv *rx_priv)
 #endif
 
 extern bool rx_urb_sched;
+#if defined(AICWF_USB_SUPPORT) && defined(CONFIG_USB_RX_PAGE_FRAG)
+/*
+ * Carve one data frame out of a page backed rx urb skb. Only the first
+ * RX_PAGE_FRAG_HDR_LEN bytes are copied, the payload stays in the urb page and
+ * is attached as a fragment holding its own page reference. The page is
+ * pinned until every frame carved from it is freed, so each frame is charged
+ * its whole slot in the urb buffer and the last one the rest of the page.
+ */
+static struct sk_buff *aicwf_rx_frag_skb(struct sk_buff *skb, u8 *data, u16 len)
+{
+    struct sk_buff *skb_inblock;
+    struct page *page;
+    u16 hdr_len = len;
+    unsigned int truesize;
+
+    if (skb->head_frag && len > RX_PAGE_FRAG_HDR_LEN)
+        hdr_len = RX_PAGE_FRAG_HDR_LEN;
+
+    skb_inblock = __dev_alloc_skb(hdr_len + CCMP_OR_WEP_INFO, GFP_KERNEL);//8 is for ccmp mic or wep icv
+    if (skb_inblock == NULL)
+        return NULL;
+
+    memcpy(skb_put(skb_inblock, hdr_len), data, hdr_len);
+    if (hdr_len < len) {
+        page = virt_to_head_page(data);
+        get_page(page);
+        truesize = len;
+        if (skb->len - len < 2)
+            truesize = (u8 *)page_address(page) + (PAGE_SIZE << compound_order(page)) - data;
+        skb_add_rx_frag(skb_inblock, 0, page, data + hdr_len - (u8 *)page_address(page),
+                        len - hdr_len, truesize);
+    }
+
+    return skb_inblock;
+}
+#endif
+
 int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
 {
 #ifdef AICWF_SDIO_SUPPORT
@@ -546,7 +597,9 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
     return ret;
 #else //AICWF_USB_SUPPORT
     int ret = 0;
+#ifndef CONFIG_USB_RX_RING
     unsigned long flags = 0;
+#endif
 #ifndef CONFIG_PREALLOC_RX_SKB
     struct sk_buff *skb = NULL;/* Packet for event or data frames */
 #endif
@@ -564,6 +617,11 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
     struct rx_buff *buffer = NULL;
     if(aicwf_usb_rx_aggr){
         while (1) {
+#ifdef CONFIG_USB_RX_RING
+            buffer = aicwf_rx_ring_get(rx_priv->rx_ring);
+            if (buffer == NULL)
+                break;
+#else
             spin_lock_irqsave(&rx_priv->rxqlock, flags);
             if (!rx_priv->rxq.qcnt) {
                 usb_info("no more rxdata\n");
@@ -572,6 +630,7 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
             }
             buffer = rxbuff_dequeue(&rx_priv->rxq);
             spin_unlock_irqrestore(&rx_priv->rxqlock, flags);
+#endif
             
             if (buffer == NULL) {
                 txrx_err("skb_error\r\n");
@@ -587,8 +646,8 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
 #ifndef CONFIG_USB_RX_REASSEMBLE
                 if (pkt_len > buffer->len) {
                     AICWFDBG(LOGERROR, "%s pkt_len:%d buffer->len:%d\r\n", __func__, pkt_len, buffer->len);
-                    aicwf_prealloc_rxbuff_free(buffer, &rx_priv->rxbuff_lock);
-                    atomic_dec(&rx_priv->rx_cnt);
+                    aicwf_prealloc_rxbuff_free(buffer);
+                    aicwf_rx_cnt_dec(rx_priv);
                     return -EBADE;
                 }
 #endif
@@ -599,8 +658,8 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                     skb_inblock = __dev_alloc_skb(aggr_len + CCMP_OR_WEP_INFO, GFP_KERNEL);
                     if (skb_inblock == NULL) {
                         txrx_err("no more space! skip\n");
-                        aicwf_prealloc_rxbuff_free(buffer, &rx_priv->rxbuff_lock);
-                        atomic_dec(&rx_priv->rx_cnt);
+                        aicwf_prealloc_rxbuff_free(buffer);
+                        aicwf_rx_cnt_dec(rx_priv);
                         return -EBADE;
                     }
 
@@ -620,7 +679,7 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                     msg = kmalloc(aggr_len+4, GFP_KERNEL);
                     if(msg == NULL){
                         txrx_err("no more space for msg!\n");
-                        aicwf_prealloc_rxbuff_free(buffer, &rx_priv->rxbuff_lock);
+                        aicwf_prealloc_rxbuff_free(buffer);
                         return -EBADE;
                     }
                     memcpy(msg, data, aggr_len + 4);
@@ -639,15 +698,20 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                     kfree(msg);
                 }
             }
-            aicwf_prealloc_rxbuff_free(buffer, &rx_priv->rxbuff_lock);
+            aicwf_prealloc_rxbuff_free(buffer);
             if (rx_urb_sched) {
                 schedule_work(&rx_priv->usbdev->rx_urb_work);
                 rx_urb_sched = false;
             }
-            atomic_dec(&rx_priv->rx_cnt);
+            aicwf_rx_cnt_dec(rx_priv);
         }
     }else{
         while (1) {
+#ifdef CONFIG_USB_RX_RING
+            buffer = aicwf_rx_ring_get(rx_priv->rx_ring);
+            if (buffer == NULL)
+                break;
+#else
             spin_lock_irqsave(&rx_priv->rxqlock, flags);
             if (!rx_priv->rxq.qcnt) {
                 usb_info("no more rxdata\n");
@@ -656,6 +720,7 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
             }
             buffer = rxbuff_dequeue(&rx_priv->rxq);
             spin_unlock_irqrestore(&rx_priv->rxqlock, flags);
+#endif
 
             if (buffer == NULL) {
                 txrx_err("skb_error\r\n");
@@ -668,8 +733,8 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
 #ifndef CONFIG_USB_RX_REASSEMBLE
             if (pkt_len > buffer->len) {
                 AICWFDBG(LOGERROR, "%s pkt_len:%d buffer->len:%d\r\n", __func__, pkt_len, buffer->len);
-                aicwf_prealloc_rxbuff_free(buffer, &rx_priv->rxbuff_lock);
-                atomic_dec(&rx_priv->rx_cnt);
+                aicwf_prealloc_rxbuff_free(buffer);
+                aicwf_rx_cnt_dec(rx_priv);
                 continue;
             }
 #endif
@@ -677,8 +742,8 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                 skb_inblock = __dev_alloc_skb(pkt_len + RX_HWHRD_LEN + CCMP_OR_WEP_INFO, GFP_KERNEL);
                 if (skb_inblock == NULL) {
                     txrx_err("no more space! skip\n");
-                    aicwf_prealloc_rxbuff_free(buffer, &rx_priv->rxbuff_lock);
-                    atomic_dec(&rx_priv->rx_cnt);
+                    aicwf_prealloc_rxbuff_free(buffer);
+                    aicwf_rx_cnt_dec(rx_priv);
                     continue;
                 }
 
@@ -696,7 +761,7 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                 msg = kmalloc(aggr_len+4, GFP_KERNEL);
                 if(msg == NULL){
                     txrx_err("no more space for msg!\n");
-                    aicwf_prealloc_rxbuff_free(buffer, &rx_priv->rxbuff_lock);
+                    aicwf_prealloc_rxbuff_free(buffer);
                     return -EBADE;
                 }
                 memcpy(msg, data, aggr_len + 4);
@@ -713,17 +778,22 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                 kfree(msg);
             }
 
-            aicwf_prealloc_rxbuff_free(buffer, &rx_priv->rxbuff_lock);
+            aicwf_prealloc_rxbuff_free(buffer);
             if (rx_urb_sched) {
                 schedule_work(&rx_priv->usbdev->rx_urb_work);
                 rx_urb_sched = false;
             }
-            atomic_dec(&rx_priv->rx_cnt);
+            aicwf_rx_cnt_dec(rx_priv);
         }
     }
 #else
     if(aicwf_usb_rx_aggr){
         while (1) {
+#ifdef CONFIG_USB_RX_RING
+            skb = aicwf_rx_ring_get(rx_priv->rx_ring);
+            if (skb == NULL)
+                break;
+#else
             spin_lock_irqsave(&rx_priv->rxqlock, flags);
             if(aicwf_is_framequeue_empty(&rx_priv->rxq)) {
                 usb_info("no more rxdata\n");
@@ -732,6 +802,7 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
             }
             skb = aicwf_frame_dequeue(&rx_priv->rxq);
             spin_unlock_irqrestore(&rx_priv->rxqlock, flags);
+#endif
 
             if (skb == NULL) {
                 txrx_err("skb_error\r\n");
@@ -759,6 +830,14 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                 if((skb->data[2] & USB_TYPE_CFG) != USB_TYPE_CFG) { // type : data
                     aggr_len = pkt_len + RX_HWHRD_LEN;
                     adjust_len = aggr_len;
+#ifdef CONFIG_USB_RX_PAGE_FRAG
+                    skb_inblock = aicwf_rx_frag_skb(skb, data, aggr_len);
+                    if(skb_inblock == NULL){
+                        txrx_err("no more space! skip!\n");
+                        skb_pull(skb, adjust_len);
+                        continue;
+                    }
+#else
                     skb_inblock = __dev_alloc_skb(aggr_len + CCMP_OR_WEP_INFO, GFP_KERNEL);//8 is for ccmp mic or wep icv
                     if(skb_inblock == NULL){
                         txrx_err("no more space! skip!\n");
@@ -768,6 +847,7 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
 
                     skb_put(skb_inblock, aggr_len);
                     memcpy(skb_inblock->data, data, aggr_len);
+#endif
                     rwnx_rxdataind_aicwf(rx_priv->usbdev->rwnx_hw, skb_inblock, (void *)rx_priv);
 
                     ///TODO: here need to add rx data process
@@ -806,10 +886,15 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                 }
             }
             dev_kfree_skb(skb);
-            atomic_dec(&rx_priv->rx_cnt);
+            aicwf_rx_cnt_dec(rx_priv);
         }
     }else{
         while (1) {
+#ifdef CONFIG_USB_RX_RING
+            skb = aicwf_rx_ring_get(rx_priv->rx_ring);
+            if (skb == NULL)
+                break;
+#else
             spin_lock_irqsave(&rx_priv->rxqlock, flags);
             if(aicwf_is_framequeue_empty(&rx_priv->rxq)) {
                 usb_info("no more rxdata\n");
@@ -818,6 +903,7 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
             }
             skb = aicwf_frame_dequeue(&rx_priv->rxq);
             spin_unlock_irqrestore(&rx_priv->rxqlock, flags);
+#endif
 
             if (skb == NULL) {
                 txrx_err("skb_error\r\n");
@@ -831,7 +917,7 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
             if (pkt_len > skb->len) {
                 AICWFDBG(LOGERROR, "%s pkt_len:%d skb->len:%d\r\n", __func__, pkt_len, skb->len);
                 dev_kfree_skb(skb);
-                atomic_dec(&rx_priv->rx_cnt);
+                aicwf_rx_cnt_dec(rx_priv);
                 continue;
             }
 #endif
@@ -846,6 +932,16 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                 else
                     adjust_len = aggr_len;
 
+#ifdef CONFIG_USB_RX_SG
+                if (skb_is_nonlinear(skb)) {
+                    if (skb_linearize(skb)) {
+                        dev_kfree_skb(skb);
+                        aicwf_rx_cnt_dec(rx_priv);
+                        continue;
+                    }
+                    data = skb->data;
+                }
+#endif
                 msg = kmalloc(aggr_len+4, GFP_KERNEL);
                 if(msg == NULL){
                     txrx_err("no more space for msg!\n");
@@ -867,7 +963,7 @@ int aicwf_process_rxframes(struct aicwf_rx_priv *rx_priv)
                 kfree(msg);
                 dev_kfree_skb(skb);
             }
-            atomic_dec(&rx_priv->rx_cnt);
+            aicwf_rx_cnt_dec(rx_priv);
         }
     }
 #endif
@@ -995,7 +1091,211 @@ static struct recv_msdu *aicwf_rxframe_queue_init(struct list_head *q, int qsize
 
     return reqs;
 }
+
+static struct reord_ctrl_info *aicwf_reord_sta_pool_init(struct list_head *q, int num)
+{
+    int i;
+    struct reord_ctrl_info *infos;
+
+    infos = vmalloc(num * sizeof(struct reord_ctrl_info));
+    if (infos == NULL)
+        return NULL;
+
+    for (i = 0; i < num; i++)
+        list_add_tail(&infos[i].list, q);
+
+    return infos;
+}
+#endif
+#ifdef CONFIG_RX_NAPI
+int rx_napi_weight = 64;
+module_param(rx_napi_weight, int, 0);
+
+/* frames are handed to GRO from softirq, up to rx_napi_weight per poll */
+static int aicwf_rx_napi_poll(struct napi_struct *napi, int budget)
+{
+    struct aicwf_rx_priv *rx_priv = container_of(napi, struct aicwf_rx_priv, napi);
+    struct sk_buff *skb;
+    int done = 0;
+
+    while (done < budget && (skb = skb_dequeue(&rx_priv->napi_rxq)) != NULL) {
+        napi_gro_receive(napi, skb);
+        done++;
+    }
+
+    if (done < budget) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 19, 0)
+        napi_complete_done(napi, done);
+#else
+        napi_complete(napi);
+#endif
+        if (!skb_queue_empty(&rx_priv->napi_rxq))
+            napi_schedule(napi);
+    }
+
+    return done;
+}
+
+void aicwf_rx_napi_kick(struct aicwf_rx_priv *rx_priv)
+{
+    if (skb_queue_empty(&rx_priv->napi_rxq))
+        return;
+
+    /* softirq runs on local_bh_enable when called from thread context */
+    local_bh_disable();
+    napi_schedule(&rx_priv->napi);
+    local_bh_enable();
+}
+
+void aicwf_rx_napi_queue(struct aicwf_rx_priv *rx_priv, struct sk_buff *skb)
+{
+    skb_queue_tail(&rx_priv->napi_rxq, skb);
+    if (skb_queue_len(&rx_priv->napi_rxq) >= rx_napi_weight)
+        aicwf_rx_napi_kick(rx_priv);
+}
+
+static int aicwf_rx_napi_init(struct aicwf_rx_priv *rx_priv)
+{
+    if (rx_napi_weight <= 0)
+        rx_napi_weight = 64;
+
+    skb_queue_head_init(&rx_priv->napi_rxq);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+    rx_priv->napi_dev = alloc_netdev_dummy(0);
+#else
+    rx_priv->napi_dev = kzalloc(sizeof(struct net_device), GFP_KERNEL);
+    if (rx_priv->napi_dev)
+        init_dummy_netdev(rx_priv->napi_dev);
+#endif
+    if (!rx_priv->napi_dev)
+        return -ENOMEM;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+    netif_napi_add_weight(rx_priv->napi_dev, &rx_priv->napi, aicwf_rx_napi_poll, rx_napi_weight);
+#else
+    netif_napi_add(rx_priv->napi_dev, &rx_priv->napi, aicwf_rx_napi_poll, rx_napi_weight);
+#endif
+    napi_enable(&rx_priv->napi);
+    AICWFDBG(LOGINFO, "%s napi weight:%d\n", __func__, rx_napi_weight);
+
+    return 0;
+}
+
+static void aicwf_rx_napi_deinit(struct aicwf_rx_priv *rx_priv)
+{
+    if (!rx_priv->napi_dev)
+        return;
+
+    napi_disable(&rx_priv->napi);
+    netif_napi_del(&rx_priv->napi);
+    skb_queue_purge(&rx_priv->napi_rxq);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+    free_netdev(rx_priv->napi_dev);
+#else
+    kfree(rx_priv->napi_dev);
+#endif
+    rx_priv->napi_dev = NULL;
+}
+#endif
+
+#ifdef CONFIG_USB_RX_RING
+static void aicwf_rx_ring_flush(struct aicwf_rx_priv *rx_priv)
+{
+    void *buf;
+
+    while ((buf = aicwf_rx_ring_get(rx_priv->rx_ring)) != NULL) {
+#ifdef CONFIG_PREALLOC_RX_SKB
+        aicwf_prealloc_rxbuff_free((struct rx_buff *)buf);
+#else
+        dev_kfree_skb((struct sk_buff *)buf);
 #endif
+    }
+    vfree(rx_priv->rx_ring);
+    rx_priv->rx_ring = NULL;
+}
+
+#ifdef CONFIG_USB_RX_RING_BENCH
+#define RX_RING_BENCH_OPS       (1 << 20)
+#define RX_RING_BENCH_BURST     32 //buffers per simulated urb completion
+
+struct aicwf_rx_ring_bench {
+    struct aicwf_rx_ring ring;
+    struct tasklet_struct producer;
+    struct completion trgg;
+    unsigned long produced;
+    unsigned long doorbells;
+    unsigned long full;
+};
+
+/* producer runs in softirq context, like aicwf_usb_rx_complete */
+static void aicwf_rx_ring_bench_produce(unsigned long data)
+{
+    struct aicwf_rx_ring_bench *bench = (struct aicwf_rx_ring_bench *)data;
+    int i;
+
+    for (i = 0; i < RX_RING_BENCH_BURST && bench->produced < RX_RING_BENCH_OPS; i++) {
+        if (!aicwf_rx_ring_put(&bench->ring, (void *)(bench->produced + 1))) {
+            bench->full++;
+            break;
+        }
+        bench->produced++;
+    }
+
+    if (aicwf_rx_ring_doorbell(&bench->ring)) {
+        bench->doorbells++;
+        complete(&bench->trgg);
+    }
+
+    if (bench->produced < RX_RING_BENCH_OPS)
+        tasklet_schedule(&bench->producer);
+}
+
+/* consumer runs in the caller, like usb_busrx_thread. Triggered from debugfs */
+void aicwf_rx_ring_bench(void)
+{
+    struct aicwf_rx_ring_bench *bench;
+    unsigned long consumed = 0, errors = 0;
+    ktime_t start;
+    u64 ns;
+    void *buf;
+
+    bench = vmalloc(sizeof(struct aicwf_rx_ring_bench));
+    if (!bench)
+        return;
+
+    aicwf_rx_ring_init(&bench->ring);
+    tasklet_init(&bench->producer, aicwf_rx_ring_bench_produce, (unsigned long)bench);
+    init_completion(&bench->trgg);
+    bench->produced = 0;
+    bench->doorbells = 0;
+    bench->full = 0;
+
+    start = ktime_get();
+    tasklet_schedule(&bench->producer);
+    while (consumed < RX_RING_BENCH_OPS) {
+        buf = aicwf_rx_ring_get(&bench->ring);
+        if (buf == NULL) {
+            if (!wait_for_completion_timeout(&bench->trgg, HZ)) {
+                txrx_err("rx ring bench stalled at %lu\n", consumed);
+                break;
+            }
+            continue;
+        }
+        if ((unsigned long)buf != consumed + 1)
+            errors++;
+        consumed++;
+    }
+    ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+    tasklet_kill(&bench->producer);
+
+    AICWFDBG(LOGINFO, "rx ring bench: %lu ops, %llu ns/op, %lu doorbells, %lu full, %lu errors\n",
+        consumed, consumed ? div_u64(ns, consumed) : 0ULL,
+        bench->doorbells, bench->full, errors);
+    vfree(bench);
+}
+#endif
+#endif
+
 struct aicwf_rx_priv *aicwf_rx_init(void *arg)
 {
     struct aicwf_rx_priv* rx_priv;
@@ -1016,10 +1316,29 @@ struct aicwf_rx_priv *aicwf_rx_init(void *arg)
 #endif
     spin_lock_init(&rx_priv->rxqlock);
 #ifdef CONFIG_PREALLOC_RX_SKB
-	spin_lock_init(&rx_priv->rxbuff_lock);
-	//aicwf_prealloc_init();
+#ifdef AICWF_USB_SUPPORT
+	rx_priv->rxbuff_pool = aicwf_prealloc_rxbuff_pool_get(aicwf_usb_rxbuff_notify, rx_priv->usbdev);
+#else
+	rx_priv->rxbuff_pool = aicwf_prealloc_rxbuff_pool_get(NULL, NULL);
+#endif
+	if (!rx_priv->rxbuff_pool) {
+		kfree(rx_priv);
+		return NULL;
+	}
 #endif
     atomic_set(&rx_priv->rx_cnt, 0);
+#ifdef CONFIG_USB_RX_RING
+    rx_priv->rx_ring = vmalloc(sizeof(struct aicwf_rx_ring));
+    if (!rx_priv->rx_ring) {
+        txrx_err("no enough buffer for rx ring!\n");
+#ifdef CONFIG_PREALLOC_RX_SKB
+        aicwf_prealloc_rxbuff_pool_put(rx_priv->rxbuff_pool);
+#endif
+        kfree(rx_priv);
+        return NULL;
+    }
+    aicwf_rx_ring_init(rx_priv->rx_ring);
+#endif
 
 #ifdef CONFIG_USB_MSG_IN_EP
 	if(rx_priv->usbdev->msg_in_pipe){
@@ -1036,11 +1355,58 @@ struct aicwf_rx_priv *aicwf_rx_init(void *arg)
     rx_priv->recv_frames = aicwf_rxframe_queue_init(&rx_priv->rxframes_freequeue, MAX_REORD_RXFRAME);
     if (!rx_priv->recv_frames) {
         txrx_err("no enough buffer for free recv frame queue!\n");
+#ifdef CONFIG_USB_RX_RING
+        vfree(rx_priv->rx_ring);
+#endif
+#ifdef CONFIG_PREALLOC_RX_SKB
+        aicwf_prealloc_rxbuff_pool_put(rx_priv->rxbuff_pool);
+#endif
         kfree(rx_priv);
         return NULL;
     }
     spin_lock_init(&rx_priv->stas_reord_lock);
     INIT_LIST_HEAD(&rx_priv->stas_reord_list);
+    INIT_LIST_HEAD(&rx_priv->stas_reord_freeq);
+    spin_lock_init(&rx_priv->reord_expire_lock);
+    INIT_LIST_HEAD(&rx_priv->reord_expire_list);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,14,0)
+    init_timer(&rx_priv->reord_timer);
+    rx_priv->reord_timer.data = (ulong) rx_priv;
+    rx_priv->reord_timer.function = reord_timeout_handler;
+#else
+    timer_setup(&rx_priv->reord_timer, reord_timeout_handler, 0);
+#endif
+    rx_priv->reord_stas = aicwf_reord_sta_pool_init(&rx_priv->stas_reord_freeq, AICWF_REORD_STA_NUM);
+    if (!rx_priv->reord_stas) {
+        txrx_err("no enough buffer for reorder sta pool!\n");
+        vfree(rx_priv->recv_frames);
+#ifdef CONFIG_USB_RX_RING
+        vfree(rx_priv->rx_ring);
+#endif
+#ifdef CONFIG_PREALLOC_RX_SKB
+        aicwf_prealloc_rxbuff_pool_put(rx_priv->rxbuff_pool);
+#endif
+        kfree(rx_priv);
+        return NULL;
+    }
+#endif
+
+#ifdef CONFIG_RX_NAPI
+    if (aicwf_rx_napi_init(rx_priv)) {
+        txrx_err("rx napi init fail\n");
+#ifdef AICWF_RX_REORDER
+        vfree(rx_priv->recv_frames);
+        vfree(rx_priv->reord_stas);
+#endif
+#ifdef CONFIG_USB_RX_RING
+        vfree(rx_priv->rx_ring);
+#endif
+#ifdef CONFIG_PREALLOC_RX_SKB
+        aicwf_prealloc_rxbuff_pool_put(rx_priv->rxbuff_pool);
+#endif
+        kfree(rx_priv);
+        return NULL;
+    }
 #endif
 
     return rx_priv;
@@ -1063,6 +1429,8 @@ void aicwf_rx_deinit(struct aicwf_rx_priv* rx_priv)
 
 	AICWFDBG(LOGINFO, "%s Enter\n", __func__);
 	
+    //the timer walks the reorder contexts freed below
+    del_timer_sync(&rx_priv->reord_timer);
     list_for_each_entry_safe(reord_info, tmp,
         &rx_priv->stas_reord_list, list) {
         reord_deinit_sta(rx_priv, reord_info);
@@ -1118,15 +1486,24 @@ void aicwf_rx_deinit(struct aicwf_rx_priv* rx_priv)
 #else
 	aicwf_frame_queue_flush(&rx_priv->rxq);
 #endif
+#ifdef CONFIG_USB_RX_RING
+    aicwf_rx_ring_flush(rx_priv);
+#endif
+
+#ifdef CONFIG_RX_NAPI
+    aicwf_rx_napi_deinit(rx_priv);
+#endif
 
 #ifdef AICWF_RX_REORDER
     aicwf_recvframe_queue_deinit(&rx_priv->rxframes_freequeue);
     if (rx_priv->recv_frames)
         vfree(rx_priv->recv_frames);
+    if (rx_priv->reord_stas)
+        vfree(rx_priv->reord_stas);
 #endif
 
 #ifdef CONFIG_PREALLOC_RX_SKB
-	//aicwf_prealloc_exit();
+	aicwf_prealloc_rxbuff_pool_put(rx_priv->rxbuff_pool);
 #endif
     kfree(rx_priv);
 	AICWFDBG(LOGINFO, "%s Exit\n", __func__);
@@ -1144,6 +1521,7 @@ void aicwf_dev_skb_free(struct sk_buff *skb)
     if (!skb)
         return;
 
+    rwnx_tx_bql_done(skb);
     dev_kfree_skb_any(skb);
 }
 
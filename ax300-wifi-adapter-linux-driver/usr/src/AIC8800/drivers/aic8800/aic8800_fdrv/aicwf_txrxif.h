@@ -11,6 +11,7 @@
 
 #include <linux/skbuff.h>
 #include <linux/sched.h>
+#include <linux/hrtimer.h>
 #include "ipc_shared.h"
 #include "aicwf_rx_prealloc.h"
 #ifdef AICWF_SDIO_SUPPORT
@@ -32,6 +33,9 @@
 
 #define RX_HWHRD_LEN                60 //58->60 word allined
 #define CCMP_OR_WEP_INFO            8
+#ifdef CONFIG_USB_RX_PAGE_FRAG
+#define RX_PAGE_FRAG_HDR_LEN        256 //hwhdr + 80211/llc + ip/tcp hdr, copied to linear part
+#endif
 #define MAX_RXQLEN                  2000
 #define RX_ALIGNMENT                4
 
@@ -75,6 +79,67 @@ struct aicwf_bus_ops {
     int (*txmsg) (struct device * dev, u8 * msg, uint len);
 };
 
+#ifdef CONFIG_USB_RX_RING
+#define AICWF_RX_RING_SIZE          2048 //power of 2, >= MAX_RXQLEN
+
+/*
+ * Single producer (bulk-in urb completion, serialized per endpoint by the hcd)
+ * single consumer (busrx thread) ring of rx buffers. armed is set by the
+ * consumer before it sleeps, the producer rings busrx_trgg only when armed so
+ * wakeups are coalesced to one per idle period.
+ */
+struct aicwf_rx_ring {
+    u32 head ____cacheline_aligned_in_smp;
+    u32 tail ____cacheline_aligned_in_smp;
+    u32 armed;
+    void *slot[AICWF_RX_RING_SIZE] ____cacheline_aligned_in_smp;
+};
+
+static inline void aicwf_rx_ring_init(struct aicwf_rx_ring *ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+    ring->armed = 1;
+}
+
+static inline bool aicwf_rx_ring_put(struct aicwf_rx_ring *ring, void *buf)
+{
+    u32 head = ring->head;
+
+    if (head - smp_load_acquire(&ring->tail) >= AICWF_RX_RING_SIZE)
+        return false;
+
+    ring->slot[head & (AICWF_RX_RING_SIZE - 1)] = buf;
+    smp_store_release(&ring->head, head + 1);
+    return true;
+}
+
+/* called by the producer after put, true if the consumer must be woken */
+static inline bool aicwf_rx_ring_doorbell(struct aicwf_rx_ring *ring)
+{
+    smp_mb();
+    return READ_ONCE(ring->armed) && xchg(&ring->armed, 0);
+}
+
+static inline void *aicwf_rx_ring_get(struct aicwf_rx_ring *ring)
+{
+    u32 tail = ring->tail;
+    void *buf;
+
+    if (tail == smp_load_acquire(&ring->head)) {
+        WRITE_ONCE(ring->armed, 1);
+        smp_mb();
+        if (tail == smp_load_acquire(&ring->head))
+            return NULL;
+        WRITE_ONCE(ring->armed, 0);
+    }
+
+    buf = ring->slot[tail & (AICWF_RX_RING_SIZE - 1)];
+    smp_store_release(&ring->tail, tail + 1);
+    return buf;
+}
+#endif
+
 struct frame_queue {
     u16              num_prio;
     u16              hi_prio;
@@ -143,6 +208,17 @@ struct aicwf_tx_priv {
     struct frame_queue txq;
     spinlock_t txqlock;
     spinlock_t txdlock;
+
+    //open batch: one AC, closed when full, timed out or the bulk-out pipe idles
+    struct aicwf_usb_buf *aggr_usb_buf;
+    int aggr_ac;
+    ktime_t aggr_start;
+    struct hrtimer aggr_timer;
+    u32 aggr_batches;
+    u64 aggr_pkts;
+    u64 aggr_bytes;
+    u32 aggr_hist[6];               //frames per batch: 1, 2, 3-4, 5-8, 9-16, 17+
+    u32 aggr_flush[4];              //full, timeout, idle, ac switch
 #endif
 #endif//AICWF_USB_SUPPORT
     struct sk_buff *aggr_buf;
@@ -154,28 +230,40 @@ struct aicwf_tx_priv {
 
 #define DEFRAG_MAX_WAIT         40 //100
 #ifdef AICWF_RX_REORDER
-#define MAX_REORD_RXFRAME       250
+#define MAX_REORD_RXFRAME       512
 #define REORDER_UPDATE_TIME     500//50
 #define AICWF_REORDER_WINSIZE   64
+#define AICWF_REORDER_RING      256 //max window, HE BA; power of 2
 //SN_LESS(a, b) a-b<0 is ture
 #define SN_LESS(a, b)           (((a-b)&0x800)!=0)
 #define SN_EQUAL(a, b)          (a == b)
+//one reorder context per peer (AP mode) or per own interface (STA mode)
+#define AICWF_REORD_STA_NUM     (NX_REMOTE_STA_MAX + NX_VIRT_DEV_MAX)
+#define AICWF_REORD_STA_HASH    16
 
 struct reord_ctrl {
     struct aicwf_rx_priv *rx_priv;
     u8 enable;
+    u8 tid;
     u16 ind_sn;
-    u8 wsize_b;
+    u16 wsize_b;
+    u16 head_sn;    //oldest sn that may still sit in the ring
+    u16 reord_cnt;
     spinlock_t reord_list_lock;
-    struct list_head reord_list;
-    struct timer_list reord_timer;
-    struct work_struct reord_timer_work;
+    //pending frames at slot sn % AICWF_REORDER_RING, value is the recv_frames index
+    DECLARE_BITMAP(reord_bitmap, AICWF_REORDER_RING);
+    u16 reord_slot[AICWF_REORDER_RING];
+    //on rx_priv->reord_expire_list while frames wait for a hole
+    struct list_head expire_list;
+    unsigned long expire;
+    bool in_timeout;    //taken off the list by reord_timeout_handler, under reord_expire_lock
 };
 
 struct reord_ctrl_info {
     u8 mac_addr[6];
     struct reord_ctrl preorder_ctrl[8];
     struct list_head list;
+    struct reord_ctrl_info *hash_next;
 };
 
 struct recv_msdu {
@@ -193,8 +281,6 @@ struct recv_msdu {
     struct sk_buff *last_fwd_skb;
     struct sk_buff *first_resend_skb;
     struct sk_buff *last_resend_skb;
-    //for pending rx reorder list
-    struct list_head reord_pending_list;
     //for total frame list, when rxframe from busif, dequeue, when submit frame to net, enqueue
     struct list_head rxframe_list;
     struct reord_ctrl *preorder_ctrl;
@@ -218,6 +304,9 @@ struct aicwf_rx_priv {
 #else
 	struct frame_queue rxq;
 #endif
+#ifdef CONFIG_USB_RX_RING
+    struct aicwf_rx_ring *rx_ring;
+#endif
 #ifdef CONFIG_USB_RX_REASSEMBLE
     struct sk_buff *rx_reassemble_skb;
     u32 rx_reassemble_total_len;
@@ -245,12 +334,24 @@ struct aicwf_rx_priv {
     struct list_head stas_reord_list;
     spinlock_t stas_reord_lock;
     struct recv_msdu *recv_frames;
+    struct reord_ctrl_info *stas_reord_hash[AICWF_REORD_STA_HASH];
+    struct list_head stas_reord_freeq;
+    struct reord_ctrl_info *reord_stas;
+    //one expiry timer per device, scans the TIDs holding frames
+    spinlock_t reord_expire_lock;
+    struct list_head reord_expire_list;
+    struct timer_list reord_timer;
 #endif
 
 #ifdef CONFIG_PREALLOC_RX_SKB
-	spinlock_t rxbuff_lock;
+	struct aicwf_rxbuff_pool *rxbuff_pool;
 #endif
 
+#ifdef CONFIG_RX_NAPI
+    struct net_device *napi_dev;
+    struct napi_struct napi;
+    struct sk_buff_head napi_rxq;
+#endif
 };
 
 static inline int aicwf_bus_start(struct aicwf_bus *bus)
@@ -290,6 +391,13 @@ int aicwf_bus_init(uint bus_hdrlen, struct device *dev);
 void aicwf_bus_deinit(struct device *dev);
 void aicwf_tx_deinit(struct aicwf_tx_priv* tx_priv);
 void aicwf_rx_deinit(struct aicwf_rx_priv* rx_priv);
+#if defined(CONFIG_USB_RX_RING) && defined(CONFIG_USB_RX_RING_BENCH)
+void aicwf_rx_ring_bench(void);
+#endif
+#ifdef CONFIG_RX_NAPI
+void aicwf_rx_napi_queue(struct aicwf_rx_priv *rx_priv, struct sk_buff *skb);
+void aicwf_rx_napi_kick(struct aicwf_rx_priv *rx_priv);
+#endif
 struct aicwf_tx_priv* aicwf_tx_init(void *arg);
 struct aicwf_rx_priv* aicwf_rx_init(void *arg);
 void aicwf_frame_queue_init(struct frame_queue *pq, int num_prio, int max_len);
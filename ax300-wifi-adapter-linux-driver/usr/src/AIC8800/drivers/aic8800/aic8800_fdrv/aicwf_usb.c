@@ -49,13 +49,23 @@ int busrx_thread_prio = 1;
 module_param(busrx_thread_prio, int, 0);
 #endif
 
+int txrx_thread_cpu_policy = AICWF_THREAD_CPU_LEGACY;
+module_param(txrx_thread_cpu_policy, int, 0644);
+int bustx_thread_cpu = 2;
+module_param(bustx_thread_cpu, int, 0644);
+int busrx_thread_cpu = 1;
+module_param(busrx_thread_cpu, int, 0644);
+
 #ifdef CONFIG_USB_RX_AGGR
 bool aicwf_usb_rx_aggr = true;
 #else
 bool aicwf_usb_rx_aggr = false;
 #endif
-atomic_t rx_urb_cnt;
 bool rx_urb_sched = false;
+int aicwf_usb_rx_urbs_min = AICWF_USB_RX_URBS;
+module_param(aicwf_usb_rx_urbs_min, int, 0);
+int aicwf_usb_rx_urbs_max = 64;
+module_param(aicwf_usb_rx_urbs_max, int, 0);
 u32 aicwf_usb_max_pkt_size = AICWF_USB_MAX_PKT_SIZE;
 
 void aicwf_usb_tx_flowctrl(struct rwnx_hw *rwnx_hw, bool state)
@@ -72,35 +82,83 @@ void aicwf_usb_tx_flowctrl(struct rwnx_hw *rwnx_hw, bool state)
 	}
 }
 
-static struct aicwf_usb_buf *aicwf_usb_tx_dequeue(struct aic_usb_dev *usb_dev,
-    struct list_head *q, int *counter, spinlock_t *qlock)
+/*
+ * Tx urbs live on a lock-free free stack and a lock-free post queue.
+ * Completions push back without a lock; llist_del_first() still needs
+ * serialized consumers, so poppers share tx_free_lock among themselves.
+ */
+static struct aicwf_usb_buf *aicwf_usb_tx_free_get(struct aic_usb_dev *usb_dev)
 {
     unsigned long flags;
-    struct aicwf_usb_buf *usb_buf;
+    struct llist_node *node;
+
+    spin_lock_irqsave(&usb_dev->tx_free_lock, flags);
+    node = llist_del_first(&usb_dev->tx_free_stack);
+    spin_unlock_irqrestore(&usb_dev->tx_free_lock, flags);
+    atomic_inc(&usb_dev->tx_stat.free_get);
+    if (!node) {
+        atomic_inc(&usb_dev->tx_stat.free_empty);
+        return NULL;
+    }
+    atomic_dec(&usb_dev->tx_free_count);
+    return llist_entry(node, struct aicwf_usb_buf, tx_node);
+}
 
-    spin_lock_irqsave(qlock, flags);
-    if (list_empty(q)) {
-        usb_buf = NULL;
-    } else {
-        usb_buf = list_first_entry(q, struct aicwf_usb_buf, list);
-        list_del_init(&usb_buf->list);
-        if (counter)
-            (*counter)--;
-    }
-    spin_unlock_irqrestore(qlock, flags);
-    return usb_buf;
+static void aicwf_usb_tx_free_put(struct aic_usb_dev *usb_dev, struct aicwf_usb_buf *usb_buf)
+{
+#ifdef CONFIG_TX_BQL
+    //urb completed or buffer dropped, either way its bytes left the device queue
+    rwnx_tx_bql_complete(usb_dev->rwnx_hw, usb_buf->bql, ARRAY_SIZE(usb_buf->bql));
+#endif
+    llist_add(&usb_buf->tx_node, &usb_dev->tx_free_stack);
+    atomic_inc(&usb_dev->tx_free_count);
+    atomic_inc(&usb_dev->tx_stat.free_put);
+}
+
+static void aicwf_usb_tx_post(struct aic_usb_dev *usb_dev, struct aicwf_usb_buf *usb_buf)
+{
+    //count first, the bustx thread checks it before splicing
+    atomic_inc(&usb_dev->tx_post_count);
+    llist_add(&usb_buf->tx_node, &usb_dev->tx_post_queue);
+    atomic_inc(&usb_dev->tx_stat.post);
+}
+
+/* bustx only: leftovers of the last pass first, then everything posted since, in order */
+static struct llist_node *aicwf_usb_tx_post_take(struct aic_usb_dev *usb_dev)
+{
+    struct llist_node *batch = usb_dev->tx_post_batch;
+    struct llist_node **tail = &batch;
+    struct llist_node *node;
+
+    node = llist_del_all(&usb_dev->tx_post_queue);
+    if (node) {
+        usb_dev->tx_stat.splice++;
+        node = llist_reverse_order(node);
+    }
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = node;
+    usb_dev->tx_post_batch = NULL;
+    return batch;
 }
 
-static void aicwf_usb_tx_queue(struct aic_usb_dev *usb_dev,
-    struct list_head *q, struct aicwf_usb_buf *usb_buf, int *counter,
-    spinlock_t *qlock)
+/* stop the netdev queues when the free stack runs low, the lock is only taken then */
+static void aicwf_usb_tx_stop_check(struct aic_usb_dev *usb_dev)
 {
     unsigned long flags;
 
-    spin_lock_irqsave(qlock, flags);
-    list_add_tail(&usb_buf->list, q);
-    (*counter)++;
-    spin_unlock_irqrestore(qlock, flags);
+    if (atomic_read(&usb_dev->tx_free_count) >= AICWF_USB_TX_LOW_WATER)
+        return;
+
+    atomic_inc(&usb_dev->tx_stat.flow_lock);
+    spin_lock_irqsave(&usb_dev->tx_flow_lock, flags);
+    if (atomic_read(&usb_dev->tx_free_count) < AICWF_USB_TX_LOW_WATER) {
+        AICWFDBG(LOGDEBUG, "usb_dev->tx_free_count < AICWF_USB_TX_LOW_WATER:%d\r\n",
+            atomic_read(&usb_dev->tx_free_count));
+        usb_dev->tbusy = true;
+        aicwf_usb_tx_flowctrl(usb_dev->rwnx_hw, true);
+    }
+    spin_unlock_irqrestore(&usb_dev->tx_flow_lock, flags);
 }
 
 static struct aicwf_usb_buf *aicwf_usb_rx_buf_get(struct aic_usb_dev *usb_dev)
@@ -128,6 +186,59 @@ static void aicwf_usb_rx_buf_put(struct aic_usb_dev *usb_dev, struct aicwf_usb_b
     spin_unlock_irqrestore(&usb_dev->rx_free_lock, flags);
 }
 
+/*
+ * Called from bulk-in completion. Grow the posted depth when half of the
+ * anchor completed before being reposted, the shrink side is
+ * aicwf_usb_rx_urb_tune_work() so it also runs when no urb completes.
+ */
+static void aicwf_usb_rx_urb_tune(struct aic_usb_dev *usb_dev)
+{
+    int inflight = atomic_dec_return(&usb_dev->rx_urb_inflight);
+    int target = READ_ONCE(usb_dev->rx_urb_target);
+
+    atomic_inc(&usb_dev->rx_urb_window_cnt);
+    if (inflight > target / 2 || target >= usb_dev->rx_urbs_max)
+        return;
+
+    target = min(target + AICWF_USB_RX_URBS_STEP, usb_dev->rx_urbs_max);
+    usb_dev->rx_urb_grow++;
+    if (target > usb_dev->rx_urb_target_hwm)
+        usb_dev->rx_urb_target_hwm = target;
+    AICWFDBG(LOGDEBUG, "%s grow to %d, inflight %d\n", __func__, target, inflight);
+    WRITE_ONCE(usb_dev->rx_urb_target, target);
+    schedule_delayed_work(&usb_dev->rx_urb_tune_work, HZ);
+}
+
+/*
+ * Once per second while above the min depth: shrink one step when fewer
+ * completions than the target arrived. Urbs above the target are retired
+ * lazily by not being resubmitted.
+ */
+static void aicwf_usb_rx_urb_tune_work(struct work_struct *work)
+{
+    struct aic_usb_dev *usb_dev = container_of(to_delayed_work(work),
+                                               struct aic_usb_dev, rx_urb_tune_work);
+    int target = READ_ONCE(usb_dev->rx_urb_target);
+
+    if (atomic_xchg(&usb_dev->rx_urb_window_cnt, 0) < target &&
+        target > usb_dev->rx_urbs_min) {
+        target = max(target - AICWF_USB_RX_URBS_STEP, usb_dev->rx_urbs_min);
+        usb_dev->rx_urb_shrink++;
+        AICWFDBG(LOGDEBUG, "%s shrink to %d\n", __func__, target);
+        WRITE_ONCE(usb_dev->rx_urb_target, target);
+    }
+    if (target > usb_dev->rx_urbs_min && usb_dev->state == USB_UP_ST)
+        schedule_delayed_work(&usb_dev->rx_urb_tune_work, HZ);
+}
+
+static void aicwf_usb_rx_urb_posted(struct aic_usb_dev *usb_dev)
+{
+    int inflight = atomic_inc_return(&usb_dev->rx_urb_inflight);
+
+    if (inflight > usb_dev->rx_urb_inflight_hwm)
+        usb_dev->rx_urb_inflight_hwm = inflight;
+}
+
 #ifdef CONFIG_USB_MSG_IN_EP
 static struct aicwf_usb_buf *aicwf_usb_msg_rx_buf_get(struct aic_usb_dev *usb_dev)
 {
@@ -182,6 +293,7 @@ static void usb_txc_sta_flowctrl(struct aicwf_usb_buf *usb_buf, struct aic_usb_d
 	struct rwnx_sta *sta;
 	struct txdesc_api *hostdesc;
 	u8 sta_idx;
+	int pending;
 	if(usb_buf->cfm)
 		hostdesc = (struct txdesc_api *)((u8 *)usb_buf->skb + 4);
 	else
@@ -192,19 +304,21 @@ static void usb_txc_sta_flowctrl(struct aicwf_usb_buf *usb_buf, struct aic_usb_d
 		struct rwnx_vif *vif = NULL;
 		sta = &usb_dev->rwnx_hw->sta_table[sta_idx];
 		vif = usb_dev->rwnx_hw->vif_table[sta->vif_idx];
-		spin_lock_irqsave(&usb_dev->tx_flow_lock, flags);
-		atomic_dec(&usb_dev->rwnx_hw->sta_flowctrl[sta_idx].tx_pending_cnt);
+		pending = atomic_dec_return(&usb_dev->rwnx_hw->sta_flowctrl[sta_idx].tx_pending_cnt);
 		//printk("sta:%d, pending:%d, flowctrl=%d\n", sta->sta_idx, sta->tx_pending_cnt, sta->flowctrl);
-		if(RWNX_VIF_TYPE(vif) == NL80211_IFTYPE_AP) {
-			if(atomic_read(&usb_dev->rwnx_hw->sta_flowctrl[sta_idx].tx_pending_cnt) < AICWF_USB_FC_PERSTA_LOW_WATER &&
-							usb_dev->rwnx_hw->sta_flowctrl[sta_idx].flowctrl) {
+		//only a stopped sta draining below low water needs the lock
+		if(RWNX_VIF_TYPE(vif) == NL80211_IFTYPE_AP && pending < AICWF_USB_FC_PERSTA_LOW_WATER &&
+						READ_ONCE(usb_dev->rwnx_hw->sta_flowctrl[sta_idx].flowctrl)) {
+			atomic_inc(&usb_dev->tx_stat.flow_lock);
+			spin_lock_irqsave(&usb_dev->tx_flow_lock, flags);
+			if(usb_dev->rwnx_hw->sta_flowctrl[sta_idx].flowctrl) {
 				//AICWFDBG(LOGDEBUG, "sta 0x%x:0x%x, %d pending %d, wake\n", sta->mac_addr[4], sta->mac_addr[5], sta->sta_idx, atomic_read(&usb_dev->rwnx_hw->sta_flowctrl[sta_idx].tx_pending_cnt));
 				if(!usb_dev->tbusy)
 					rwnx_wake_sta_all_queues(sta, usb_dev->rwnx_hw);
 				usb_dev->rwnx_hw->sta_flowctrl[sta_idx].flowctrl = 0;
 			}
+			spin_unlock_irqrestore(&usb_dev->tx_flow_lock, flags);
 		}
-		spin_unlock_irqrestore(&usb_dev->tx_flow_lock, flags);
 	}
 #endif
 }
@@ -218,6 +332,7 @@ static void aicwf_usb_tx_complete(struct urb *urb)
     struct sk_buff *skb;
     #endif
 
+    WRITE_ONCE(usb_dev->tx_irq_cpu, raw_smp_processor_id());
 	usb_txc_sta_flowctrl(usb_buf, usb_dev);
 
 #ifdef CONFIG_USB_ALIGN_DATA
@@ -243,17 +358,34 @@ static void aicwf_usb_tx_complete(struct urb *urb)
     AICWFDBG(LOGDEBUG,"tx com %d\n", usb_buf->aggr_cnt);
     usb_buf->aggr_cnt = 0;
 #endif//CONFIG_USB_TX_AGGR
-    aicwf_usb_tx_queue(usb_dev, &usb_dev->tx_free_list, usb_buf,
-                    &usb_dev->tx_free_count, &usb_dev->tx_free_lock);
+    aicwf_usb_tx_free_put(usb_dev, usb_buf);
+#ifdef CONFIG_USB_TX_AGGR
+    //the pipe may have gone idle, let the open batch go out
+    if (READ_ONCE(usb_dev->tx_priv->aggr_usb_buf))
+        complete(&usb_dev->bus_if->bustx_trgg);
+#endif
+#ifdef CONFIG_RWNX_XMIT_MORE
+    //a burst may have been cut by a queue stop, bustx pushes its hwqs
+    if (usb_dev->rwnx_hw && READ_ONCE(usb_dev->rwnx_hw->xmit_batch.hwqs))
+        complete(&usb_dev->bus_if->bustx_trgg);
+#endif
+
+    //tbusy is only set with more than 3/4 of the urbs out, later completions recheck
+    if (!READ_ONCE(usb_dev->tbusy) ||
+        atomic_read(&usb_dev->tx_free_count) <= AICWF_USB_TX_HIGH_WATER)
+        return;
 
+    atomic_inc(&usb_dev->tx_stat.flow_lock);
     spin_lock_irqsave(&usb_dev->tx_flow_lock, flags);
-    if (usb_dev->tx_free_count > AICWF_USB_TX_HIGH_WATER) {
-        if (usb_dev->tbusy) {
-            usb_dev->tbusy = false;
-            aicwf_usb_tx_flowctrl(usb_dev->rwnx_hw, false);
-        }
+    if (usb_dev->tbusy) {
+        usb_dev->tbusy = false;
+        aicwf_usb_tx_flowctrl(usb_dev->rwnx_hw, false);
     }
     spin_unlock_irqrestore(&usb_dev->tx_flow_lock, flags);
+#ifdef RWNX_HWQ_BACKPRESSURE
+    //hwqs stopped at the backpressure go on from bustx
+    complete(&usb_dev->bus_if->bustx_trgg);
+#endif
 }
 
 void aicwf_usb_rx_submit_all_urb_(struct aic_usb_dev *usb_dev);
@@ -265,33 +397,32 @@ static void aicwf_usb_rx_complete(struct urb *urb)
     struct aic_usb_dev *usb_dev = usb_buf->usbdev;
     struct aicwf_rx_priv* rx_priv = usb_dev->rx_priv;
     struct rx_buff *rx_buff = NULL;
+#ifndef CONFIG_USB_RX_RING
     unsigned long flags = 0;
+#endif
 
     rx_buff = usb_buf->rx_buff;
     usb_buf->rx_buff = NULL;
+    WRITE_ONCE(usb_dev->rx_irq_cpu, raw_smp_processor_id());
 
-    atomic_dec(&rx_urb_cnt);
-    if(atomic_read(&rx_urb_cnt) < 10){
-        AICWFDBG(LOGDEBUG, "%s %d \r\n", __func__, atomic_read(&rx_urb_cnt));
-        //printk("%s %d \r\n", __func__, atomic_read(&rx_urb_cnt));
-    }
+    aicwf_usb_rx_urb_tune(usb_dev);
 
     if(!usb_dev->rwnx_hw){
-        aicwf_prealloc_rxbuff_free(rx_buff, &rx_priv->rxbuff_lock);
+        aicwf_prealloc_rxbuff_free(rx_buff);
         aicwf_usb_rx_buf_put(usb_dev, usb_buf);
         AICWFDBG(LOGERROR, "usb_dev->rwnx_hw is not ready \r\n");
         return;
     }
 
     if (urb->actual_length > urb->transfer_buffer_length) {
-        aicwf_prealloc_rxbuff_free(rx_buff, &rx_priv->rxbuff_lock);
+        aicwf_prealloc_rxbuff_free(rx_buff);
         aicwf_usb_rx_buf_put(usb_dev, usb_buf);
         aicwf_usb_rx_submit_all_urb_(usb_dev);
         return;
     }
 
     if (urb->status != 0 || !urb->actual_length) {
-        aicwf_prealloc_rxbuff_free(rx_buff, &rx_priv->rxbuff_lock);
+        aicwf_prealloc_rxbuff_free(rx_buff);
         aicwf_usb_rx_buf_put(usb_dev, usb_buf);
         if(urb->status < 0){
             AICWFDBG(LOGDEBUG, "%s urb->status:%d \r\n", __func__, urb->status);
@@ -316,6 +447,18 @@ static void aicwf_usb_rx_complete(struct urb *urb)
     }
 
     if (usb_dev->state == USB_UP_ST) {
+#ifdef CONFIG_USB_RX_RING
+        rx_buff->len = urb->actual_length;
+        if (!aicwf_rx_ring_put(rx_priv->rx_ring, rx_buff)) {
+            usb_err("rx_priv->rx_ring is over flow!!!\n");
+            aicwf_prealloc_rxbuff_free(rx_buff);
+            aicwf_usb_rx_buf_put(usb_dev, usb_buf);
+            aicwf_usb_rx_submit_all_urb_(usb_dev);
+            return;
+        }
+        if (aicwf_rx_ring_doorbell(rx_priv->rx_ring))
+            complete(&rx_priv->usbdev->bus_if->busrx_trgg);
+#else
         spin_lock_irqsave(&rx_priv->rxqlock, flags);
         //if (aicwf_usb_rx_aggr) {
             rx_buff->len = urb->actual_length;
@@ -325,7 +468,7 @@ static void aicwf_usb_rx_complete(struct urb *urb)
         if(!aicwf_rxbuff_enqueue(usb_dev->dev, &rx_priv->rxq, rx_buff)){
             spin_unlock_irqrestore(&rx_priv->rxqlock, flags);
             usb_err("rx_priv->rxq is over flow!!!\n");
-            aicwf_prealloc_rxbuff_free(rx_buff, &rx_priv->rxbuff_lock);
+            aicwf_prealloc_rxbuff_free(rx_buff);
             aicwf_usb_rx_buf_put(usb_dev, usb_buf);
             aicwf_usb_rx_submit_all_urb_(usb_dev);
             return;
@@ -336,32 +479,95 @@ static void aicwf_usb_rx_complete(struct urb *urb)
         if(atomic_read(&rx_priv->rx_cnt) == 1){
             complete(&rx_priv->usbdev->bus_if->busrx_trgg);
         }
+#endif
 
         aicwf_usb_rx_buf_put(usb_dev, usb_buf);
         aicwf_usb_rx_submit_all_urb_(usb_dev);
     } else {
-        aicwf_prealloc_rxbuff_free(rx_buff, &rx_priv->rxbuff_lock);
+        aicwf_prealloc_rxbuff_free(rx_buff);
         aicwf_usb_rx_buf_put(usb_dev, usb_buf);
     }
 }
 
 #else
+#ifdef CONFIG_USB_RX_SG
+/*
+ * Oversize frames are sent by the fw as several max_pkt_size transfers. A sg
+ * urb of AICWF_USB_MAX_AMSDU_PKT_SIZE receives them in one go, the pages are
+ * handed to the skb as frags so nothing is copied or reassembled.
+ * The urb only stops at a short packet, so the fw must end every frame with
+ * one (a ZLP when the frame is a max_pkt_size multiple), otherwise the next
+ * frames land in the same urb and are lost: hence the rx_sg_fw_zlp gate.
+ */
+static bool rx_sg_fw_zlp = false;
+module_param(rx_sg_fw_zlp, bool, 0444);
+MODULE_PARM_DESC(rx_sg_fw_zlp, "fw ends each bulk-in frame with a short packet, allows sg rx urbs");
+
+static struct sk_buff *aicwf_usb_rx_sg_prepare(struct aicwf_usb_buf *usb_buf)
+{
+    u32 len, remain = AICWF_USB_MAX_AMSDU_PKT_SIZE;
+    int i;
+
+    sg_init_table(usb_buf->sg, AICWF_USB_RX_SG_PAGES);
+    for (i = 0; i < AICWF_USB_RX_SG_PAGES; i++) {
+        if (!usb_buf->sg_page[i]) {
+            usb_buf->sg_page[i] = alloc_page(GFP_ATOMIC | __GFP_NOWARN);
+            if (!usb_buf->sg_page[i])
+                return NULL;
+        }
+        len = min_t(u32, remain, PAGE_SIZE);
+        sg_set_page(&usb_buf->sg[i], usb_buf->sg_page[i], len, 0);
+        remain -= len;
+    }
+
+    return __dev_alloc_skb(AICWF_USB_RX_SG_HDR_LEN + CCMP_OR_WEP_INFO, GFP_ATOMIC);
+}
+
+static void aicwf_usb_rx_sg_to_skb(struct aicwf_usb_buf *usb_buf, struct sk_buff *skb, u32 len)
+{
+    u32 off = min_t(u32, len, AICWF_USB_RX_SG_HDR_LEN);
+    u32 frag_len;
+    int i;
+
+    memcpy(skb_put(skb, off), page_address(usb_buf->sg_page[0]), off);
+    while (off < len) {
+        i = off / PAGE_SIZE;
+        frag_len = min_t(u32, len - off, PAGE_SIZE - off % PAGE_SIZE);
+        skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags, usb_buf->sg_page[i],
+                        off % PAGE_SIZE, frag_len, PAGE_SIZE);
+        usb_buf->sg_page[i] = NULL; //owned by the skb now
+        off += frag_len;
+    }
+}
+
+static void aicwf_usb_rx_sg_free(struct aicwf_usb_buf *usb_buf)
+{
+    int i;
+
+    for (i = 0; i < AICWF_USB_RX_SG_PAGES; i++) {
+        if (usb_buf->sg_page[i]) {
+            __free_page(usb_buf->sg_page[i]);
+            usb_buf->sg_page[i] = NULL;
+        }
+    }
+}
+#endif
+
 static void aicwf_usb_rx_complete(struct urb *urb)
 {
     struct aicwf_usb_buf *usb_buf = (struct aicwf_usb_buf *) urb->context;
     struct aic_usb_dev *usb_dev = usb_buf->usbdev;
     struct aicwf_rx_priv* rx_priv = usb_dev->rx_priv;
     struct sk_buff *skb = NULL;
+#ifndef CONFIG_USB_RX_RING
     unsigned long flags = 0;
+#endif
 
     skb = usb_buf->skb;
     usb_buf->skb = NULL;
+    WRITE_ONCE(usb_dev->rx_irq_cpu, raw_smp_processor_id());
 
-	atomic_dec(&rx_urb_cnt);
-	if(atomic_read(&rx_urb_cnt) < 10){
-		AICWFDBG(LOGDEBUG, "%s %d \r\n", __func__, atomic_read(&rx_urb_cnt));
-		//printk("%s %d \r\n", __func__, atomic_read(&rx_urb_cnt));
-	}
+	aicwf_usb_rx_urb_tune(usb_dev);
 
 	if(!usb_dev->rwnx_hw){
 		aicwf_dev_skb_free(skb);
@@ -411,10 +617,19 @@ static void aicwf_usb_rx_complete(struct urb *urb)
 
     if (usb_dev->state == USB_UP_ST) {
 
+#ifdef CONFIG_USB_RX_SG
+        if (usb_dev->rx_sg)
+            aicwf_usb_rx_sg_to_skb(usb_buf, skb, urb->actual_length);
+        else
+#endif
         skb_put(skb, urb->actual_length);
 
         if (aicwf_usb_rx_aggr) {
             skb->len = urb->actual_length;
+#ifdef CONFIG_USB_RX_SG
+        } else if (usb_dev->rx_sg) {
+            //the whole frame is in one sg transfer, nothing to reassemble
+#endif
         } else {
 #ifdef CONFIG_USB_RX_REASSEMBLE
             bool pkt_check = false;
@@ -542,6 +757,17 @@ static void aicwf_usb_rx_complete(struct urb *urb)
 #endif
         }
 
+#ifdef CONFIG_USB_RX_RING
+        if (!aicwf_rx_ring_put(rx_priv->rx_ring, skb)) {
+            usb_err("rx_priv->rx_ring is over flow!!!\n");
+            aicwf_dev_skb_free(skb);
+            aicwf_usb_rx_buf_put(usb_dev, usb_buf);
+            aicwf_usb_rx_submit_all_urb_(usb_dev);
+            return;
+        }
+        if (aicwf_rx_ring_doorbell(rx_priv->rx_ring))
+            complete(&rx_priv->usbdev->bus_if->busrx_trgg);
+#else
         spin_lock_irqsave(&rx_priv->rxqlock, flags);
         if(!aicwf_rxframe_enqueue(usb_dev->dev, &rx_priv->rxq, skb)){
             spin_unlock_irqrestore(&rx_priv->rxqlock, flags);
@@ -561,6 +787,7 @@ static void aicwf_usb_rx_complete(struct urb *urb)
 		}
 #else
         tasklet_schedule(&rx_priv->usbdev->recv_tasklet);
+#endif
 #endif
 		
         aicwf_usb_rx_buf_put(usb_dev, usb_buf);
@@ -752,7 +979,7 @@ static int aicwf_usb_submit_rx_urb(struct aic_usb_dev *usb_dev,
         aicwf_usb_rx_buf_put(usb_dev, usb_buf);
         return -1;
     }
-    rx_buff =  aicwf_prealloc_rxbuff_alloc(&usb_dev->rx_priv->rxbuff_lock);
+    rx_buff =  aicwf_prealloc_rxbuff_alloc(usb_dev->rx_priv->rxbuff_pool);
 	if (rx_buff == NULL) {
 		AICWFDBG(LOGERROR, "failed to alloc rxbuff\r\n");
 		aicwf_usb_rx_buf_put(usb_dev, usb_buf);
@@ -762,14 +989,15 @@ static int aicwf_usb_submit_rx_urb(struct aic_usb_dev *usb_dev,
 	rx_buff->len = 0;
 	rx_buff->start = rx_buff->data;
 	rx_buff->read = rx_buff->start;
-	rx_buff->end = rx_buff->data + aicwf_rxbuff_size_get();
+	rx_buff->end = rx_buff->data + aicwf_prealloc_rxbuff_pool_size(usb_dev->rx_priv->rxbuff_pool);
 
     usb_buf->rx_buff = rx_buff;
 
     usb_fill_bulk_urb(usb_buf->urb,
         usb_dev->udev,
         usb_dev->bulk_in_pipe,
-        rx_buff->data, aicwf_rxbuff_size_get(), aicwf_usb_rx_complete, usb_buf);
+        rx_buff->data, aicwf_prealloc_rxbuff_pool_size(usb_dev->rx_priv->rxbuff_pool),
+        aicwf_usb_rx_complete, usb_buf);
 
     usb_buf->usbdev = usb_dev;
 
@@ -778,18 +1006,79 @@ static int aicwf_usb_submit_rx_urb(struct aic_usb_dev *usb_dev,
     if (ret) {
         usb_err("usb submit rx urb fail:%d\n", ret);
         usb_unanchor_urb(usb_buf->urb);
-        aicwf_prealloc_rxbuff_free(rx_buff, &usb_dev->rx_priv->rxbuff_lock);
+        aicwf_prealloc_rxbuff_free(rx_buff);
         aicwf_usb_rx_buf_put(usb_dev, usb_buf);
 
         msleep(100);
 	    return -1;
     }else{
-    	atomic_inc(&rx_urb_cnt);
+    	aicwf_usb_rx_urb_posted(usb_dev);
 	}
     return 0;
 }
 
 #else
+#ifdef CONFIG_USB_RX_PAGE_FRAG
+/*
+ * Rx urb buffers are high order pages wrapped by build_skb, so data frames can
+ * be handed up as page fragments instead of copies. The pool holds one page
+ * reference, a page is reused once every skb pointing into it is released.
+ */
+static struct sk_buff *aicwf_usb_rx_page_skb_alloc(struct aic_usb_dev *usb_dev)
+{
+    struct page *page = NULL;
+    struct sk_buff *skb;
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&usb_dev->rx_page_lock, flags);
+    for (i = 0; i < usb_dev->rx_page_pool_size; i++) {
+        if (!usb_dev->rx_page_pool[i]) {
+            usb_dev->rx_page_pool[i] = alloc_pages(GFP_ATOMIC | __GFP_COMP | __GFP_NOWARN,
+                                                   usb_dev->rx_page_order);
+            if (!usb_dev->rx_page_pool[i])
+                break;
+        }
+        if (page_ref_count(usb_dev->rx_page_pool[i]) == 1) {
+            page = usb_dev->rx_page_pool[i];
+            get_page(page);
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&usb_dev->rx_page_lock, flags);
+
+    if (!page) {
+        /* pool exhausted, this page is simply freed by the stack */
+        page = alloc_pages(GFP_ATOMIC | __GFP_COMP | __GFP_NOWARN, usb_dev->rx_page_order);
+        if (!page)
+            return NULL;
+    }
+
+    skb = build_skb(page_address(page), PAGE_SIZE << usb_dev->rx_page_order);
+    if (!skb) {
+        put_page(page);
+        return NULL;
+    }
+
+    return skb;
+}
+
+static void aicwf_usb_rx_page_pool_free(struct aic_usb_dev *usb_dev)
+{
+    int i;
+
+    if (!usb_dev->rx_page_pool)
+        return;
+
+    for (i = 0; i < usb_dev->rx_page_pool_size; i++) {
+        if (usb_dev->rx_page_pool[i])
+            put_page(usb_dev->rx_page_pool[i]);
+    }
+    kfree(usb_dev->rx_page_pool);
+    usb_dev->rx_page_pool = NULL;
+}
+#endif
+
 static int aicwf_usb_submit_rx_urb(struct aic_usb_dev *usb_dev,
                 struct aicwf_usb_buf *usb_buf)
 {
@@ -805,11 +1094,20 @@ static int aicwf_usb_submit_rx_urb(struct aic_usb_dev *usb_dev,
         return -1;
     }
 
+#ifdef CONFIG_USB_RX_SG
+    if (usb_dev->rx_sg)
+        skb = aicwf_usb_rx_sg_prepare(usb_buf);
+    else
+#endif
+#ifdef CONFIG_USB_RX_PAGE_FRAG
+    skb = aicwf_usb_rx_page_skb_alloc(usb_dev);
+#else
     if(aicwf_usb_rx_aggr){
         skb = __dev_alloc_skb(AICWF_USB_AGGR_MAX_PKT_SIZE, GFP_ATOMIC/*GFP_KERNEL*/);
     } else {
         skb = __dev_alloc_skb(aicwf_usb_max_pkt_size, GFP_ATOMIC/*GFP_KERNEL*/);
     }
+#endif
     if (!skb) {
         aicwf_usb_rx_buf_put(usb_dev, usb_buf);
         return -1;
@@ -817,6 +1115,16 @@ static int aicwf_usb_submit_rx_urb(struct aic_usb_dev *usb_dev,
 
     usb_buf->skb = skb;
 
+#ifdef CONFIG_USB_RX_SG
+    if (usb_dev->rx_sg) {
+        usb_fill_bulk_urb(usb_buf->urb,
+            usb_dev->udev,
+            usb_dev->bulk_in_pipe,
+            NULL, AICWF_USB_MAX_AMSDU_PKT_SIZE, aicwf_usb_rx_complete, usb_buf);
+        usb_buf->urb->sg = usb_buf->sg;
+        usb_buf->urb->num_sgs = AICWF_USB_RX_SG_PAGES;
+    } else
+#endif
     if (aicwf_usb_rx_aggr) {
         usb_fill_bulk_urb(usb_buf->urb,
             usb_dev->udev,
@@ -843,7 +1151,7 @@ static int aicwf_usb_submit_rx_urb(struct aic_usb_dev *usb_dev,
         msleep(100);
         return -1;
     }else{
-        atomic_inc(&rx_urb_cnt);
+        aicwf_usb_rx_urb_posted(usb_dev);
     }
     return 0;
 }
@@ -859,7 +1167,8 @@ static void aicwf_usb_rx_submit_all_urb(struct aic_usb_dev *usb_dev)
         return;
     }
 
-    while((usb_buf = aicwf_usb_rx_buf_get(usb_dev)) != NULL) {
+    while (atomic_read(&usb_dev->rx_urb_inflight) < READ_ONCE(usb_dev->rx_urb_target) &&
+           (usb_buf = aicwf_usb_rx_buf_get(usb_dev)) != NULL) {
         if (aicwf_usb_submit_rx_urb(usb_dev, usb_buf)) {
             AICWFDBG(LOGERROR, "sub rx fail\n");
             return;
@@ -965,18 +1274,19 @@ static void aicwf_usb_msg_rx_prepare(struct aic_usb_dev *usb_dev)
 static void aicwf_usb_tx_prepare(struct aic_usb_dev *usb_dev)
 {
     struct aicwf_usb_buf *usb_buf;
+    struct llist_node *batch = aicwf_usb_tx_post_take(usb_dev);
 
-    while(!list_empty(&usb_dev->tx_post_list)){
-        usb_buf = aicwf_usb_tx_dequeue(usb_dev, &usb_dev->tx_post_list,
-            &usb_dev->tx_post_count, &usb_dev->tx_post_lock);
+    while (batch) {
+        usb_buf = llist_entry(batch, struct aicwf_usb_buf, tx_node);
+        batch = batch->next;
+        atomic_dec(&usb_dev->tx_post_count);
         #ifndef CONFIG_USB_TX_AGGR
         if(usb_buf->skb) {
             dev_kfree_skb(usb_buf->skb);
             usb_buf->skb = NULL;
         }
         #endif
-        aicwf_usb_tx_queue(usb_dev, &usb_dev->tx_free_list, usb_buf,
-                &usb_dev->tx_free_count, &usb_dev->tx_free_lock);
+        aicwf_usb_tx_free_put(usb_dev, usb_buf);
     }
 }
 
@@ -985,7 +1295,6 @@ int aicwf_usb_send_pkt(struct aic_usb_dev *usb_dev, u8 *buf, uint buf_len)
 {
     int ret = 0;
     struct aicwf_usb_buf *usb_buf;
-    unsigned long flags;
     bool need_cfm = false;
 
     if (usb_dev->state != USB_UP_ST) {
@@ -993,10 +1302,10 @@ int aicwf_usb_send_pkt(struct aic_usb_dev *usb_dev, u8 *buf, uint buf_len)
         return -EIO;
     }
 
-    usb_buf = aicwf_usb_tx_dequeue(usb_dev, &usb_dev->tx_free_list,
-                        &usb_dev->tx_free_count, &usb_dev->tx_free_lock);
+    usb_buf = aicwf_usb_tx_free_get(usb_dev);
     if (!usb_buf) {
-        AICWFDBG(LOGERROR, "free:%d, post:%d\n", usb_dev->tx_free_count, usb_dev->tx_post_count);
+        AICWFDBG(LOGERROR, "free:%d, post:%d\n", atomic_read(&usb_dev->tx_free_count),
+                 atomic_read(&usb_dev->tx_post_count));
         ret = -ENOMEM;
         goto flow_ctrl;
     }
@@ -1007,23 +1316,16 @@ int aicwf_usb_send_pkt(struct aic_usb_dev *usb_dev, u8 *buf, uint buf_len)
         usb_buf->cfm = true;
     else
         usb_buf->cfm = false;
-    AICWFDBG(LOGERROR, "%s len %d\n", __func__, buf_len);
-    print_hex_dump(KERN_ERR, "buf  ", DUMP_PREFIX_NONE, 16, 1, &buf[0], 32, false);
+    AICWFDBG(LOGTRACE, "%s len %d\n", __func__, buf_len);
     usb_fill_bulk_urb(usb_buf->urb, usb_dev->udev, usb_dev->bulk_out_pipe,
                 buf, buf_len, aicwf_usb_tx_complete, usb_buf);
     usb_buf->urb->transfer_flags |= URB_ZERO_PACKET;
 
-    aicwf_usb_tx_queue(usb_dev, &usb_dev->tx_post_list, usb_buf,
-                    &usb_dev->tx_post_count, &usb_dev->tx_post_lock);
+    aicwf_usb_tx_post(usb_dev, usb_buf);
     ret = 0;
 
     flow_ctrl:
-    spin_lock_irqsave(&usb_dev->tx_flow_lock, flags);
-    if (usb_dev->tx_free_count < AICWF_USB_TX_LOW_WATER) {
-        usb_dev->tbusy = true;
-        aicwf_usb_tx_flowctrl(usb_dev->rwnx_hw, true);
-    }
-    spin_unlock_irqrestore(&usb_dev->tx_flow_lock, flags);
+    aicwf_usb_tx_stop_check(usb_dev);
 
     return ret;
 }
@@ -1064,10 +1366,16 @@ int aicwf_usb_aggr(struct aicwf_tx_priv *tx_priv, struct sk_buff *pkt)
     }
 
     tx_priv->aggr_buf->dev = pkt->dev;
+#ifdef CONFIG_TX_BQL
+    //in flight until the batch urb completes
+    rwnx_tx_bql_take(pkt, tx_priv->aggr_usb_buf->bql, ARRAY_SIZE(tx_priv->aggr_usb_buf->bql));
+#endif
 
     if(!txhdr->sw_hdr->need_cfm) {
-        kmem_cache_free(txhdr->sw_hdr->rwnx_vif->rwnx_hw->sw_txhdr_cache, txhdr->sw_hdr);
-        skb_pull(pkt, txhdr->sw_hdr->headroom);
+        u16 headroom = txhdr->sw_hdr->headroom;
+
+        rwnx_sw_txhdr_free(txhdr->sw_hdr->rwnx_vif->rwnx_hw, txhdr->sw_hdr);
+        skb_pull(pkt, headroom);
         consume_skb(pkt);
     }
 
@@ -1075,90 +1383,215 @@ int aicwf_usb_aggr(struct aicwf_tx_priv *tx_priv, struct sk_buff *pkt)
     return 0;
 }
 
+int aicwf_usb_tx_aggr_num = 10;
+int aicwf_usb_tx_aggr_us = 200;
+module_param(aicwf_usb_tx_aggr_num, int, 0660);
+module_param(aicwf_usb_tx_aggr_us, int, 0660);
+
+enum {
+    AICWF_USB_AGGR_FULL,
+    AICWF_USB_AGGR_TIMEOUT,
+    AICWF_USB_AGGR_IDLE,
+    AICWF_USB_AGGR_AC,
+};
+
+static inline u32 aicwf_usb_aggr_pkt_len(struct sk_buff *pkt)
+{
+    struct rwnx_txhdr *txhdr = (struct rwnx_txhdr *)pkt->data;
+
+    return roundup(8 + sizeof(struct txdesc_api) + pkt->len - txhdr->sw_hdr->headroom, TX_ALIGNMENT);
+}
+
+/* highest AC with frames queued, -1 if none. txqlock held */
+static int aicwf_usb_aggr_pick_ac(struct frame_queue *txq)
+{
+    int tid, ac = -1;
+
+    for (tid = 0; tid < txq->num_prio; tid++) {
+        if (!skb_queue_empty(&txq->queuelist[tid]) && rwnx_tid2hwq[tid] > ac)
+            ac = rwnx_tid2hwq[tid];
+    }
+
+    return ac;
+}
+
+/* next frame of the batch AC if it still fits, *full tells why none came back */
+static struct sk_buff *aicwf_usb_aggr_dequeue(struct aicwf_tx_priv *tx_priv, u32 room, bool *full)
+{
+    struct frame_queue *txq = &tx_priv->txq;
+    struct sk_buff *pkt = NULL;
+    int tid;
+
+    *full = false;
+    spin_lock_bh(&tx_priv->txqlock);
+    for (tid = txq->num_prio - 1; tid >= 0; tid--) {
+        if (rwnx_tid2hwq[tid] != tx_priv->aggr_ac || skb_queue_empty(&txq->queuelist[tid]))
+            continue;
+        pkt = skb_peek(&txq->queuelist[tid]);
+        if (aicwf_usb_aggr_pkt_len(pkt) > room) {
+            *full = true;
+            pkt = NULL;
+            break;
+        }
+        __skb_unlink(pkt, &txq->queuelist[tid]);
+        txq->qcnt--;
+        atomic_dec(&tx_priv->tx_pktcnt);
+        break;
+    }
+    spin_unlock_bh(&tx_priv->txqlock);
+
+    return pkt;
+}
+
+static enum hrtimer_restart aicwf_usb_aggr_timeout(struct hrtimer *timer)
+{
+    struct aicwf_tx_priv *tx_priv = container_of(timer, struct aicwf_tx_priv, aggr_timer);
+
+    complete(&tx_priv->usbdev->bus_if->bustx_trgg);
+    return HRTIMER_NORESTART;
+}
+
+static void aicwf_usb_aggr_init(struct aicwf_tx_priv *tx_priv)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 15, 0)
+    hrtimer_setup(&tx_priv->aggr_timer, aicwf_usb_aggr_timeout, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+    hrtimer_init(&tx_priv->aggr_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    tx_priv->aggr_timer.function = aicwf_usb_aggr_timeout;
+#endif
+}
+
+/* drop the open batch on bus stop, its frames are already consumed */
+static void aicwf_usb_aggr_abort(struct aic_usb_dev *usbdev)
+{
+    struct aicwf_tx_priv *tx_priv = usbdev->tx_priv;
+    struct aicwf_usb_buf *usb_buf;
+
+    if (!tx_priv)
+        return;
+
+    hrtimer_cancel(&tx_priv->aggr_timer);
+    usb_buf = tx_priv->aggr_usb_buf;
+    if (usb_buf) {
+        WRITE_ONCE(tx_priv->aggr_usb_buf, NULL);
+        usb_buf->aggr_cnt = 0;
+        aicwf_usb_tx_free_put(usbdev, usb_buf);
+    }
+}
+
+/*
+ * Build one batch. Returns 1 when a batch was posted, 0 when it is kept open
+ * waiting for more frames, <0 on error.
+ */
 int aicwf_usb_send(struct aicwf_tx_priv *tx_priv)
 {
     struct sk_buff *pkt;
     struct sk_buff *tx_buf;
     struct aic_usb_dev *usbdev = tx_priv->usbdev;
-    struct aicwf_usb_buf *usb_buf;
+    struct aicwf_usb_buf *usb_buf = tx_priv->aggr_usb_buf;
     u8* buf;
-    int ret = 0;
+    int ret = 1;
     int curr_len = 0;
-    unsigned long flags;
-
-    if (aicwf_is_framequeue_empty(&tx_priv->txq)) {
-        ret = -1;
-        AICWFDBG(LOGERROR, "no buf to send\n");
-        return ret;
-    }
+    int reason, ac, timeout_us;
+    s64 waited_us;
+    bool full;
 
     if (usbdev->state != USB_UP_ST) {
         AICWFDBG(LOGERROR, "usb state is not up!\n");
+        aicwf_usb_aggr_abort(usbdev);
         ret = -ENODEV;
         return ret;
     }
-    usb_buf = aicwf_usb_tx_dequeue(usbdev, &usbdev->tx_free_list,
-                        &usbdev->tx_free_count, &usbdev->tx_free_lock);
+
     if (!usb_buf) {
-        AICWFDBG(LOGERROR, "free:%d, post:%d\n", usbdev->tx_free_count, usbdev->tx_post_count);
-        ret = -ENOMEM;
-        return ret;
+        spin_lock_bh(&tx_priv->txqlock);
+        ac = aicwf_usb_aggr_pick_ac(&tx_priv->txq);
+        spin_unlock_bh(&tx_priv->txqlock);
+        if (ac < 0)
+            return 0;
+
+        usb_buf = aicwf_usb_tx_free_get(usbdev);
+        if (!usb_buf) {
+            AICWFDBG(LOGERROR, "free:%d, post:%d\n", atomic_read(&usbdev->tx_free_count),
+                     atomic_read(&usbdev->tx_post_count));
+            ret = -ENOMEM;
+            return ret;
+        }
+
+        usb_buf->aggr_cnt = 0;
+        tx_priv->aggr_ac = ac;
+        tx_priv->aggr_start = ktime_get();
+        tx_priv->head = usb_buf->skb->data;
+        tx_priv->tail = usb_buf->skb->data;
+        WRITE_ONCE(tx_priv->aggr_usb_buf, usb_buf);
     }
 
-    usb_buf->aggr_cnt = 0;
-    spin_lock_bh(&usbdev->tx_priv->txdlock);
-    tx_priv->head = usb_buf->skb->data;
-    tx_priv->tail = usb_buf->skb->data;
-
-    while (!aicwf_is_framequeue_empty(&usbdev->tx_priv->txq)) {
-        if (usbdev->state != USB_UP_ST) {
-            AICWFDBG(LOGERROR, "usb state is not up, break!\n");
-            ret = -ENODEV;
+    //txdlock is held per frame only, the queue lock only around each dequeue
+    while (1) {
+        if (usb_buf->aggr_cnt >= max(READ_ONCE(aicwf_usb_tx_aggr_num), 1)) {
+            full = true;
             break;
         }
-
-        if (usb_buf->aggr_cnt == 10) {
+        pkt = aicwf_usb_aggr_dequeue(tx_priv, MAX_USB_AGGR_TXPKT_LEN - (tx_priv->tail - tx_priv->head), &full);
+        if (!pkt)
             break;
-        }
-        spin_lock_bh(&usbdev->tx_priv->txqlock);
-        pkt = aicwf_frame_dequeue(&usbdev->tx_priv->txq);
-        if (pkt == NULL) {
-            AICWFDBG(LOGERROR, "txq no pkt\n");
-            spin_unlock_bh(&usbdev->tx_priv->txqlock);
-            ret = -1;
-            return ret;
-        }
-        atomic_dec(&usbdev->tx_priv->tx_pktcnt);
-        spin_unlock_bh(&usbdev->tx_priv->txqlock);
-        if(tx_priv==NULL || tx_priv->tail==NULL || pkt==NULL) {
-            AICWFDBG(LOGERROR, "null error\n");
-        }
+        spin_lock_bh(&tx_priv->txdlock);
         aicwf_usb_aggr(tx_priv, pkt);
+        spin_unlock_bh(&tx_priv->txdlock);
         usb_buf->aggr_cnt++;
     }
 
+    if (full) {
+        reason = AICWF_USB_AGGR_FULL;
+    } else {
+        spin_lock_bh(&tx_priv->txqlock);
+        ac = aicwf_usb_aggr_pick_ac(&tx_priv->txq);
+        spin_unlock_bh(&tx_priv->txqlock);
+        timeout_us = READ_ONCE(aicwf_usb_tx_aggr_us);
+        waited_us = ktime_us_delta(ktime_get(), tx_priv->aggr_start);
+
+        if (ac >= 0) {
+            reason = AICWF_USB_AGGR_AC;
+        } else if (usb_buf->aggr_cnt && AICWF_USB_TX_URBS - atomic_read(&usbdev->tx_free_count) <= 1) {
+            //nothing else posted or in flight, holding the frames only adds latency
+            reason = AICWF_USB_AGGR_IDLE;
+        } else if (timeout_us <= 0 || waited_us >= timeout_us) {
+            reason = AICWF_USB_AGGR_TIMEOUT;
+        } else {
+            hrtimer_start(&tx_priv->aggr_timer, ns_to_ktime((timeout_us - waited_us) * NSEC_PER_USEC),
+                          HRTIMER_MODE_REL);
+            return 0;
+        }
+    }
+
+    if (!usb_buf->aggr_cnt) {
+        //woken with nothing for this AC, e.g. only other ACs queued
+        aicwf_usb_aggr_abort(usbdev);
+        return 1;
+    }
+
+    hrtimer_try_to_cancel(&tx_priv->aggr_timer);
+    WRITE_ONCE(tx_priv->aggr_usb_buf, NULL);
+
     tx_buf = usb_buf->skb;
     buf = tx_buf->data;
 
     curr_len = tx_priv->tail - tx_priv->head;
 
-    AICWFDBG(LOGTRACE, "%s len %d, cnt %d\n", __func__,curr_len, usb_buf->aggr_cnt);
-    tx_buf->len = tx_priv->tail - tx_priv->head;
-    spin_unlock_bh(&usbdev->tx_priv->txdlock);
+    tx_priv->aggr_batches++;
+    tx_priv->aggr_pkts += usb_buf->aggr_cnt;
+    tx_priv->aggr_bytes += curr_len;
+    tx_priv->aggr_hist[min(fls(usb_buf->aggr_cnt - 1), 5)]++;
+    tx_priv->aggr_flush[reason]++;
+
+    AICWFDBG(LOGTRACE, "%s len %d, cnt %d, reason %d\n", __func__, curr_len, usb_buf->aggr_cnt, reason);
+    tx_buf->len = curr_len;
     usb_fill_bulk_urb(usb_buf->urb, usbdev->udev, usbdev->bulk_out_pipe,
                 buf, curr_len, aicwf_usb_tx_complete, usb_buf);
     usb_buf->urb->transfer_flags |= URB_ZERO_PACKET;
 
-    aicwf_usb_tx_queue(usbdev, &usbdev->tx_post_list, usb_buf,
-                    &usbdev->tx_post_count, &usbdev->tx_post_lock);
-
-    flow_ctrl:
-    spin_lock_irqsave(&usbdev->tx_flow_lock, flags);
-    if (usbdev->tx_free_count < AICWF_USB_TX_LOW_WATER) {
-        usbdev->tbusy = true;
-        aicwf_usb_tx_flowctrl(usbdev->rwnx_hw, true);
-    }
-    spin_unlock_irqrestore(&usbdev->tx_flow_lock, flags);
+    aicwf_usb_tx_post(usbdev, usb_buf);
+    aicwf_usb_tx_stop_check(usbdev);
 
     return ret;
 }
@@ -1168,56 +1601,67 @@ int aicwf_usb_send(struct aicwf_tx_priv *tx_priv)
 static void aicwf_usb_tx_process(struct aic_usb_dev *usb_dev)
 {
     struct aicwf_usb_buf *usb_buf;
+    struct llist_node *batch;
+    u32 cnt;
     int ret = 0;
-    u8* data = NULL;
 
 #ifdef CONFIG_USB_TX_AGGR
-    if (!aicwf_is_framequeue_empty(&usb_dev->tx_priv->txq)) {
-        if (aicwf_usb_send(usb_dev->tx_priv)) {
-            AICWFDBG(LOGERROR, "%s no buf send\n", __func__);
-        }
+    while (!aicwf_is_framequeue_empty(&usb_dev->tx_priv->txq) || usb_dev->tx_priv->aggr_usb_buf) {
+        if (aicwf_usb_send(usb_dev->tx_priv) <= 0)
+            break;
     }
 #endif
 
-    while(!list_empty(&usb_dev->tx_post_list)) {
-
-        if (usb_dev->state != USB_UP_ST) {
-            usb_err("usb state is not up!\n");
-            return;
-        }
-
-        usb_buf = aicwf_usb_tx_dequeue(usb_dev, &usb_dev->tx_post_list,
-                        &usb_dev->tx_post_count, &usb_dev->tx_post_lock);
-        if(!usb_buf) {
-            usb_err("can not get usb_buf from tx_post_list!\n");
-            return;
-        }
-        data = usb_buf->skb->data;
+    //splice everything posted so far and submit it in one pass, no lock per urb
+    while ((batch = aicwf_usb_tx_post_take(usb_dev)) != NULL) {
+        cnt = 0;
+        while (batch) {
+            if (usb_dev->state != USB_UP_ST) {
+                usb_err("usb state is not up!\n");
+                usb_dev->tx_post_batch = batch;
+                return;
+            }
 
-        ret = usb_submit_urb(usb_buf->urb, GFP_KERNEL);
-        if (ret) {
-            AICWFDBG(LOGERROR, "aicwf_usb_bus_tx usb_submit_urb FAILED err:%d\n", ret);
-            #ifdef CONFIG_USB_TX_AGGR
-            aicwf_usb_tx_queue(usb_dev, &usb_dev->tx_post_list, usb_buf,
-                    &usb_dev->tx_post_count, &usb_dev->tx_post_lock);
-            break;
-            #else
-            goto fail;
-            #endif
-        }
+            usb_buf = llist_entry(batch, struct aicwf_usb_buf, tx_node);
+            //the node is reused by the completion as soon as the urb is submitted
+            batch = batch->next;
+            atomic_dec(&usb_dev->tx_post_count);
+
+            ret = usb_submit_urb(usb_buf->urb, GFP_KERNEL);
+            if (ret) {
+                AICWFDBG(LOGERROR, "aicwf_usb_bus_tx usb_submit_urb FAILED err:%d\n", ret);
+                usb_dev->tx_stat.submit_err++;
+                #ifdef CONFIG_USB_TX_AGGR
+                //keep the batch order, retry on the next wakeup
+                usb_buf->tx_node.next = batch;
+                usb_dev->tx_post_batch = &usb_buf->tx_node;
+                atomic_inc(&usb_dev->tx_post_count);
+                goto out;
+                #else
+                goto fail;
+                #endif
+            }
 
-        continue;
+            cnt++;
+            continue;
 #ifndef CONFIG_USB_TX_AGGR
 fail:
-        usb_txc_sta_flowctrl(usb_buf, usb_dev);
-        dev_kfree_skb(usb_buf->skb);
-        usb_buf->skb = NULL;
-        aicwf_usb_tx_queue(usb_dev, &usb_dev->tx_free_list, usb_buf,
-                    &usb_dev->tx_free_count, &usb_dev->tx_free_lock);
-		if (ret == -ENODEV) {
-			break;
-		}
+            usb_txc_sta_flowctrl(usb_buf, usb_dev);
+            dev_kfree_skb(usb_buf->skb);
+            usb_buf->skb = NULL;
+            aicwf_usb_tx_free_put(usb_dev, usb_buf);
+            if (ret == -ENODEV) {
+                usb_dev->tx_post_batch = batch;
+                goto out;
+            }
 #endif
+        }
+out:
+        usb_dev->tx_stat.submit += cnt;
+        if (cnt > usb_dev->tx_stat.batch_max)
+            usb_dev->tx_stat.batch_max = cnt;
+        if (usb_dev->tx_post_batch)
+            break;
     }
 }
 
@@ -1245,11 +1689,74 @@ static inline void aic_thread_wait_stop(void)
 }
 
 
+/* cpu the policy asks for, -1 for none. Not checked against the online cpus */
+static int aicwf_thread_target_cpu(int pinned_cpu, int irq_cpu)
+{
+    int cpu;
+
+    switch (READ_ONCE(txrx_thread_cpu_policy)) {
+    case AICWF_THREAD_CPU_LEGACY:
+        cpu = 1;
+        break;
+    case AICWF_THREAD_CPU_SPLIT:
+        cpu = pinned_cpu;
+        break;
+    case AICWF_THREAD_CPU_FOLLOW_IRQ:
+        cpu = irq_cpu;
+        break;
+    default:
+        cpu = -1;
+        break;
+    }
+
+    return cpu < 0 ? -1 : cpu;
+}
+
+/* (re)bind the calling thread when the policy or its target cpu changed */
+static void aicwf_thread_place(const char *name, struct aicwf_thread_stat *stat,
+                               int pinned_cpu, int irq_cpu)
+{
+    int want = aicwf_thread_target_cpu(pinned_cpu, irq_cpu);
+    int cpu = want;
+    int ret;
+
+    if (cpu >= nr_cpu_ids || (cpu >= 0 && !cpu_online(cpu)))
+        cpu = -1;
+    if (want != stat->want_cpu) {
+        if (want >= 0 && cpu < 0)
+            AICWFDBG(LOGINFO, "%s cpu %d not online, left unbound\n", name, want);
+        stat->want_cpu = want;
+    }
+
+    if (cpu == stat->bound_cpu)
+        return;
+
+    if (cpu < 0)
+        ret = set_cpus_allowed_ptr(current, cpu_possible_mask);
+    else
+        ret = set_cpus_allowed_ptr(current, cpumask_of(cpu));
+    AICWFDBG(LOGDEBUG, "%s bind cpu %d -> %d, ret %d\n", name, stat->bound_cpu, cpu, ret);
+    stat->bound_cpu = cpu;
+}
+
+static void aicwf_thread_account(struct aicwf_thread_stat *stat, u64 start_ns)
+{
+    int cpu = raw_smp_processor_id();
+
+    stat->wakeups++;
+    stat->busy_ns += ktime_get_ns() - start_ns;
+    if (cpu != stat->cpu) {
+        if (stat->cpu >= 0)
+            stat->migrations++;
+        stat->cpu = cpu;
+    }
+}
+
 int usb_bustx_thread(void *data)
 {
     struct aicwf_bus *bus = (struct aicwf_bus *)data;
     struct aic_usb_dev *usbdev = bus->bus_priv.usb;
-    int set_cpu_ret = 0;
+    u64 start_ns;
 
 #ifdef CONFIG_THREAD_INFO_IN_TASK
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0))
@@ -1258,9 +1765,9 @@ int usb_bustx_thread(void *data)
     AICWFDBG(LOGINFO, "%s the cpu is:%d\n", __func__, current->cpu);
 #endif
 #endif
-    set_cpu_ret = set_cpus_allowed_ptr(current, cpumask_of(1));
+    aicwf_thread_place("bustx", &usbdev->tx_thread_stat, bustx_thread_cpu,
+                       READ_ONCE(usbdev->tx_irq_cpu));
 #ifdef CONFIG_THREAD_INFO_IN_TASK
-    AICWFDBG(LOGINFO, "%s set_cpu_ret is:%d\n", __func__, set_cpu_ret);
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0))
 	AICWFDBG(LOGINFO, "%s change cpu to:%d\n", __func__, current->thread_info.cpu);
 #else
@@ -1297,12 +1804,21 @@ int usb_bustx_thread(void *data)
 				AICWFDBG(LOGINFO, "usb bustx thread will to stop\n");
                 break;
 			}
+            start_ns = ktime_get_ns();
+            aicwf_thread_place("bustx", &usbdev->tx_thread_stat, bustx_thread_cpu,
+                               READ_ONCE(usbdev->tx_irq_cpu));
+            if (usbdev->rwnx_hw) {
+                rwnx_xmit_batch_flush(usbdev->rwnx_hw);
+                rwnx_hwq_resume(usbdev->rwnx_hw);
+            }
             #ifdef CONFIG_USB_TX_AGGR
-            if ((usbdev->tx_post_count > 0) || !aicwf_is_framequeue_empty(&usbdev->tx_priv->txq))
+            if ((atomic_read(&usbdev->tx_post_count) > 0) || !aicwf_is_framequeue_empty(&usbdev->tx_priv->txq) ||
+                usbdev->tx_priv->aggr_usb_buf)
             #else
-            if (usbdev->tx_post_count > 0)
+            if (atomic_read(&usbdev->tx_post_count) > 0)
             #endif
                 aicwf_usb_tx_process(usbdev);
+            aicwf_thread_account(&usbdev->tx_thread_stat, start_ns);
         }
     }
 
@@ -1316,7 +1832,8 @@ int usb_busrx_thread(void *data)
 {
     struct aicwf_rx_priv *rx_priv = (struct aicwf_rx_priv *)data;
     struct aicwf_bus *bus_if = rx_priv->usbdev->bus_if;
-    int set_cpu_ret = 0;
+    struct aic_usb_dev *usbdev = rx_priv->usbdev;
+    u64 start_ns;
     
 #ifdef CONFIG_THREAD_INFO_IN_TASK
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0))
@@ -1325,9 +1842,9 @@ int usb_busrx_thread(void *data)
     AICWFDBG(LOGINFO, "%s the cpu is:%d\n", __func__, current->cpu);
 #endif
 #endif
-    set_cpu_ret = set_cpus_allowed_ptr(current, cpumask_of(1));
+    aicwf_thread_place("busrx", &usbdev->rx_thread_stat, busrx_thread_cpu,
+                       READ_ONCE(usbdev->rx_irq_cpu));
 #ifdef CONFIG_THREAD_INFO_IN_TASK
-    AICWFDBG(LOGINFO, "%s set_cpu_ret is:%d\n", __func__, set_cpu_ret);
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0))
 	AICWFDBG(LOGINFO, "%s change cpu to:%d\n", __func__, current->thread_info.cpu);
 #else
@@ -1364,7 +1881,14 @@ int usb_busrx_thread(void *data)
 				break;
             }
 			//rx_priv->rx_thread_working = 1;//AIDEN
+            start_ns = ktime_get_ns();
+            aicwf_thread_place("busrx", &usbdev->rx_thread_stat, busrx_thread_cpu,
+                               READ_ONCE(usbdev->rx_irq_cpu));
             aicwf_process_rxframes(rx_priv);
+#ifdef CONFIG_RX_NAPI
+            aicwf_rx_napi_kick(rx_priv);
+#endif
+            aicwf_thread_account(&usbdev->rx_thread_stat, start_ns);
         }
     }
 
@@ -1505,6 +2029,35 @@ exit:
 }
 
 
+static void aicwf_usb_free_buf(struct aicwf_usb_buf *usb_buf)
+{
+    #ifdef CONFIG_USB_TX_AGGR
+    if (usb_buf->skb) {
+        dev_kfree_skb(usb_buf->skb);
+    }
+    #endif
+    #ifdef CONFIG_USB_RX_SG
+    aicwf_usb_rx_sg_free(usb_buf);
+    #endif
+    #ifdef CONFIG_USB_TX_SG
+    kfree(usb_buf->tx_hdr);
+    usb_buf->tx_hdr = NULL;
+    #endif
+    usb_free_urb(usb_buf->urb);
+    #if defined CONFIG_USB_NO_TRANS_DMA_MAP
+    // free dma buf if needed
+    if (usb_buf->data_buf) {
+        #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 35))
+        usb_free_coherent(usb_buf->usbdev->udev, DATA_BUF_MAX, usb_buf->data_buf, usb_buf->data_dma_trans_addr);
+        #else
+        usb_buffer_free(usb_buf->usbdev->udev, DATA_BUF_MAX, usb_buf->data_buf, usb_buf->data_dma_trans_addr);
+        #endif
+        usb_buf->data_buf = NULL;
+        usb_buf->data_dma_trans_addr = 0x0;
+    }
+    #endif
+}
+
 static void aicwf_usb_free_urb(struct list_head *q, spinlock_t *qlock)
 {
     struct aicwf_usb_buf *usb_buf, *tmp;
@@ -1518,36 +2071,34 @@ static void aicwf_usb_free_urb(struct list_head *q, spinlock_t *qlock)
             spin_lock_irqsave(qlock, flags);
             break;
         }
-        #ifdef CONFIG_USB_TX_AGGR
-        if (usb_buf->skb) {
-            dev_kfree_skb(usb_buf->skb);
-        }
-        #endif
-        usb_free_urb(usb_buf->urb);
-        #if defined CONFIG_USB_NO_TRANS_DMA_MAP
-        // free dma buf if needed
-        if (usb_buf->data_buf) {
-            #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 35))
-            usb_free_coherent(usb_buf->usbdev->udev, DATA_BUF_MAX, usb_buf->data_buf, usb_buf->data_dma_trans_addr);
-            #else
-            usb_buffer_free(usb_buf->usbdev->udev, DATA_BUF_MAX, usb_buf->data_buf, usb_buf->data_dma_trans_addr);
-            #endif
-            usb_buf->data_buf = NULL;
-            usb_buf->data_dma_trans_addr = 0x0;
-        }
-        #endif
+        aicwf_usb_free_buf(usb_buf);
         list_del_init(&usb_buf->list);
         spin_lock_irqsave(qlock, flags);
     }
     spin_unlock_irqrestore(qlock, flags);
 }
 
+static void aicwf_usb_free_tx_urb(struct aic_usb_dev *usb_dev)
+{
+    struct aicwf_usb_buf *usb_buf, *tmp;
+    struct llist_node *node = llist_del_all(&usb_dev->tx_free_stack);
+
+    llist_for_each_entry_safe(usb_buf, tmp, node, tx_node) {
+        if (!usb_buf->urb) {
+            usb_err("bad usb_buf\n");
+            break;
+        }
+        aicwf_usb_free_buf(usb_buf);
+        atomic_dec(&usb_dev->tx_free_count);
+    }
+}
+
 static int aicwf_usb_alloc_rx_urb(struct aic_usb_dev *usb_dev)
 {
     int i;
 
-	AICWFDBG(LOGINFO, "%s AICWF_USB_RX_URBS:%d \r\n", __func__, AICWF_USB_RX_URBS);
-    for (i = 0; i < AICWF_USB_RX_URBS; i++) {
+	AICWFDBG(LOGINFO, "%s rx urbs:%d-%d \r\n", __func__, usb_dev->rx_urbs_min, usb_dev->rx_urbs_max);
+    for (i = 0; i < usb_dev->rx_urbs_max; i++) {
         struct aicwf_usb_buf *usb_buf = &usb_dev->usb_rx_buf[i];
 
         usb_buf->usbdev = usb_dev;
@@ -1587,6 +2138,15 @@ static int aicwf_usb_alloc_tx_urb(struct aic_usb_dev *usb_dev)
         #ifdef CONFIG_USB_TX_AGGR
         usb_buf->skb = dev_alloc_skb(MAX_USB_AGGR_TXPKT_LEN);
         #endif
+        #ifdef CONFIG_USB_TX_SG
+        if (usb_dev->tx_sg) {
+            usb_buf->tx_hdr = kzalloc(AICWF_USB_TX_SG_BUF_LEN, GFP_KERNEL);
+            if (!usb_buf->tx_hdr) {
+                usb_err("could not allocate tx sg header\n");
+                goto err;
+            }
+        }
+        #endif
         #if defined CONFIG_USB_NO_TRANS_DMA_MAP
         // alloc dma buf
         #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 35))
@@ -1599,13 +2159,12 @@ static int aicwf_usb_alloc_tx_urb(struct aic_usb_dev *usb_dev)
             goto err;
         }
         #endif
-        list_add_tail(&usb_buf->list, &usb_dev->tx_free_list);
-        (usb_dev->tx_free_count)++;
+        aicwf_usb_tx_free_put(usb_dev, usb_buf);
     }
     return 0;
 
 err:
-    aicwf_usb_free_urb(&usb_dev->tx_free_list, &usb_dev->tx_free_lock);
+    aicwf_usb_free_tx_urb(usb_dev);
     return -ENOMEM;
 }
 
@@ -1662,6 +2221,7 @@ static void usb_tx_flow_ctrl(struct rwnx_txhdr *txhdr, struct aic_usb_dev *usb_d
 	struct rwnx_sta *sta;
 	u8 sta_idx;
 	unsigned long flags;
+	int pending;
 
 	//printk("txdata: sta %d\n", txhdr->sw_hdr->desc.host.staid);
 	sta_idx = txhdr->sw_hdr->desc.host.staid;
@@ -1669,19 +2229,18 @@ static void usb_tx_flow_ctrl(struct rwnx_txhdr *txhdr, struct aic_usb_dev *usb_d
 		struct rwnx_vif *vif = NULL;
 		sta = &rwnx_hw->sta_table[sta_idx];
 		vif = rwnx_hw->vif_table[sta->vif_idx];
-		spin_lock_irqsave(&usb_dev->tx_flow_lock, flags);
-		atomic_inc(&rwnx_hw->sta_flowctrl[sta_idx].tx_pending_cnt);
+		pending = atomic_inc_return(&rwnx_hw->sta_flowctrl[sta_idx].tx_pending_cnt);
 		//printk("sta %d pending %d >= 64, flowctrl=%d\n", sta->sta_idx, sta->tx_pending_cnt, sta->flowctrl);
-		if(RWNX_VIF_TYPE(vif) == NL80211_IFTYPE_AP) {
-			if((atomic_read(&rwnx_hw->sta_flowctrl[sta_idx].tx_pending_cnt) >= AICWF_USB_FC_PERSTA_HIGH_WATER && rwnx_hw->sta_flowctrl[sta_idx].flowctrl == 0) ||
-										rwnx_hw->sta_flowctrl[sta_idx].flowctrl) {
-				//AICWFDBG(LOGDEBUG, "sta 0x%x:0x%x, %d pending %d, stop\n", sta->mac_addr[4], sta->mac_addr[5], sta->sta_idx, atomic_read(&rwnx_hw->sta_flowctrl[sta_idx].tx_pending_cnt));
-				if(!usb_dev->tbusy)
-					rwnx_stop_sta_all_queues(sta, usb_dev->rwnx_hw);
-				rwnx_hw->sta_flowctrl[sta_idx].flowctrl = 1;
-			}
+		if(RWNX_VIF_TYPE(vif) == NL80211_IFTYPE_AP &&
+		   (pending >= AICWF_USB_FC_PERSTA_HIGH_WATER || READ_ONCE(rwnx_hw->sta_flowctrl[sta_idx].flowctrl))) {
+			atomic_inc(&usb_dev->tx_stat.flow_lock);
+			spin_lock_irqsave(&usb_dev->tx_flow_lock, flags);
+			//AICWFDBG(LOGDEBUG, "sta 0x%x:0x%x, %d pending %d, stop\n", sta->mac_addr[4], sta->mac_addr[5], sta->sta_idx, atomic_read(&rwnx_hw->sta_flowctrl[sta_idx].tx_pending_cnt));
+			if(!usb_dev->tbusy)
+				rwnx_stop_sta_all_queues(sta, usb_dev->rwnx_hw);
+			rwnx_hw->sta_flowctrl[sta_idx].flowctrl = 1;
+			spin_unlock_irqrestore(&usb_dev->tx_flow_lock, flags);
 		}
-		spin_unlock_irqrestore(&usb_dev->tx_flow_lock, flags);
 	}
 #endif
 }
@@ -1719,6 +2278,50 @@ static int aicwf_usb_bus_txdata(struct device *dev, struct sk_buff *pkt)
 }
 
 #else
+#ifdef CONFIG_USB_TX_SG
+#define AICWF_USB_TX_SG_HDR_LEN (4 + sizeof(struct txdesc_api))
+//header, then zeroed padding up to TX_ALIGNMENT plus the short packet byte
+#define AICWF_USB_TX_SG_BUF_LEN (AICWF_USB_TX_SG_HDR_LEN + TX_ALIGNMENT + 1)
+
+/* usb header and txdesc come from the urb's own buffer, the payload is mapped from the skb */
+static void aicwf_usb_tx_sg_fill(struct aic_usb_dev *usb_dev, struct aicwf_usb_buf *usb_buf,
+                                 struct sk_buff *skb, bool need_cfm)
+{
+    struct rwnx_txhdr *txhdr = (struct rwnx_txhdr *)skb->data;
+    u8 *hdr = usb_buf->tx_hdr;
+    u16 headroom = txhdr->sw_hdr->headroom;
+    u32 payload_len = skb->len - headroom;
+    u32 buf_len = AICWF_USB_TX_SG_HDR_LEN + payload_len;
+    u32 pad_len = 0;
+
+    memcpy(&hdr[4], (u8 *)(long)&txhdr->sw_hdr->desc, sizeof(struct txdesc_api));
+    //same framing as the copy path: only confirmed frames are padded
+    if (need_cfm && (buf_len & (TX_ALIGNMENT - 1))) {
+        pad_len = roundup(buf_len, TX_ALIGNMENT) - buf_len;
+        buf_len += pad_len;
+    }
+    hdr[0] = (buf_len & 0xff);
+    hdr[1] = ((buf_len >> 8) & 0x0f);
+    hdr[2] = 0x01; //data
+    hdr[3] = 0; //reserved
+#ifndef CONFIG_USE_USB_ZERO_PACKET
+    if ((buf_len % 512) == 0)
+        pad_len++;
+#endif
+
+    sg_init_table(usb_buf->tx_sg, pad_len ? 3 : 2);
+    sg_set_buf(&usb_buf->tx_sg[0], hdr, AICWF_USB_TX_SG_HDR_LEN);
+    sg_set_buf(&usb_buf->tx_sg[1], &skb->data[headroom], payload_len);
+    if (pad_len)
+        sg_set_buf(&usb_buf->tx_sg[2], &hdr[AICWF_USB_TX_SG_HDR_LEN], pad_len);
+
+    usb_fill_bulk_urb(usb_buf->urb, usb_dev->udev, usb_dev->bulk_out_pipe,
+                NULL, AICWF_USB_TX_SG_HDR_LEN + payload_len + pad_len, aicwf_usb_tx_complete, usb_buf);
+    usb_buf->urb->sg = usb_buf->tx_sg;
+    usb_buf->urb->num_sgs = pad_len ? 3 : 2;
+}
+#endif
+
 static int aicwf_usb_bus_txdata(struct device *dev, struct sk_buff *skb)
 {
     u8 *buf;
@@ -1726,7 +2329,6 @@ static int aicwf_usb_bus_txdata(struct device *dev, struct sk_buff *skb)
     u16 adjust_len = 0;
     struct aicwf_usb_buf *usb_buf;
     int ret = 0;
-    unsigned long flags;
     struct aicwf_bus *bus_if = dev_get_drvdata(dev);
     struct aic_usb_dev *usb_dev = bus_if->bus_priv.usb;
     struct rwnx_txhdr *txhdr = (struct rwnx_txhdr *)skb->data;
@@ -1742,23 +2344,44 @@ static int aicwf_usb_bus_txdata(struct device *dev, struct sk_buff *skb)
 
     if (usb_dev->state != USB_UP_ST) {
         usb_err("usb state is not up!\n");
-        kmem_cache_free(rwnx_hw->sw_txhdr_cache, txhdr->sw_hdr);
+        rwnx_sw_txhdr_free(rwnx_hw, txhdr->sw_hdr);
+        rwnx_tx_bql_done(skb);
         dev_kfree_skb_any(skb);
         return -EIO;
     }
 
-    usb_buf = aicwf_usb_tx_dequeue(usb_dev, &usb_dev->tx_free_list,
-                        &usb_dev->tx_free_count, &usb_dev->tx_free_lock);
+    usb_buf = aicwf_usb_tx_free_get(usb_dev);
     if (!usb_buf) {
-        usb_err("free:%d, post:%d\n", usb_dev->tx_free_count, usb_dev->tx_post_count);
-        kmem_cache_free(rwnx_hw->sw_txhdr_cache, txhdr->sw_hdr);
+        usb_err("free:%d, post:%d\n", atomic_read(&usb_dev->tx_free_count),
+                atomic_read(&usb_dev->tx_post_count));
+        rwnx_sw_txhdr_free(rwnx_hw, txhdr->sw_hdr);
+        rwnx_tx_bql_done(skb);
         dev_kfree_skb_any(skb);
         ret = -ENOMEM;
         goto flow_ctrl;
     }
+#ifdef CONFIG_TX_BQL
+    rwnx_tx_bql_take(skb, usb_buf->bql, ARRAY_SIZE(usb_buf->bql));
+#endif
 
     usb_tx_flow_ctrl(txhdr, usb_dev, rwnx_hw);
 
+#ifdef CONFIG_USB_TX_SG
+    if (usb_dev->tx_sg && !skb_is_nonlinear(skb)) {
+        need_cfm = txhdr->sw_hdr->need_cfm;
+        aicwf_usb_tx_sg_fill(usb_dev, usb_buf, skb, need_cfm);
+        //a confirmed skb stays with the cfm path, nothing to free on urb completion
+        if (!need_cfm)
+            rwnx_sw_txhdr_free(rwnx_hw, txhdr->sw_hdr);
+        usb_buf->skb = need_cfm ? NULL : skb;
+        usb_buf->usbdev = usb_dev;
+        usb_buf->cfm = need_cfm;
+        goto post;
+    }
+    usb_buf->urb->sg = NULL;
+    usb_buf->urb->num_sgs = 0;
+#endif
+
     if (txhdr->sw_hdr->need_cfm) {
         need_cfm = true;
         #if defined CONFIG_USB_NO_TRANS_DMA_MAP
@@ -1787,7 +2410,7 @@ static int aicwf_usb_bus_txdata(struct device *dev, struct sk_buff *skb)
         skb_pull(skb, txhdr->sw_hdr->headroom);
         skb_push(skb, sizeof(struct txdesc_api));
         memcpy(&skb->data[0], (u8 *)(long)&txhdr->sw_hdr->desc, sizeof(struct txdesc_api));
-        kmem_cache_free(rwnx_hw->sw_txhdr_cache, txhdr->sw_hdr);
+        rwnx_sw_txhdr_free(rwnx_hw, txhdr->sw_hdr);
 
         skb_push(skb, sizeof(usb_header));
         usb_header[0] =((skb->len) & 0xff);
@@ -1864,12 +2487,14 @@ static int aicwf_usb_bus_txdata(struct device *dev, struct sk_buff *skb)
     usb_buf->urb->transfer_dma = usb_buf->data_dma_trans_addr;
     usb_buf->urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
     #endif
+#ifdef CONFIG_USB_TX_SG
+post:
+#endif
 #ifdef CONFIG_USE_USB_ZERO_PACKET
     usb_buf->urb->transfer_flags |= URB_ZERO_PACKET;
 #endif
 
-    aicwf_usb_tx_queue(usb_dev, &usb_dev->tx_post_list, usb_buf,
-                    &usb_dev->tx_post_count, &usb_dev->tx_post_lock);
+    aicwf_usb_tx_post(usb_dev, usb_buf);
 
 #ifdef CONFIG_TX_TASKLET
 	tasklet_schedule(&usb_dev->xmit_tasklet);
@@ -1880,14 +2505,7 @@ static int aicwf_usb_bus_txdata(struct device *dev, struct sk_buff *skb)
     ret = 0;
 
     flow_ctrl:
-    spin_lock_irqsave(&usb_dev->tx_flow_lock, flags);
-    if (usb_dev->tx_free_count < AICWF_USB_TX_LOW_WATER) {
-		AICWFDBG(LOGDEBUG, "usb_dev->tx_free_count < AICWF_USB_TX_LOW_WATER:%d\r\n",
-			usb_dev->tx_free_count);
-        usb_dev->tbusy = true;
-        aicwf_usb_tx_flowctrl(usb_dev->rwnx_hw, true);
-    }
-    spin_unlock_irqrestore(&usb_dev->tx_flow_lock, flags);
+    aicwf_usb_tx_stop_check(usb_dev);
 
     return ret;
 }
@@ -1904,6 +2522,9 @@ static int aicwf_usb_bus_start(struct device *dev)
 
     usb_dev->rx_prepare_ready = false;
     aicwf_usb_tx_prepare(usb_dev);
+#ifdef CONFIG_USB_TX_AGGR
+    aicwf_usb_aggr_abort(usb_dev);
+#endif
 #ifdef CONFIG_USB_MSG_IN_EP
 	if(usb_dev->msg_in_pipe){
 		aicwf_usb_msg_rx_prepare(usb_dev);
@@ -1921,41 +2542,44 @@ static int aicwf_usb_bus_start(struct device *dev)
 
 static void aicwf_usb_cancel_all_urbs_(struct aic_usb_dev *usb_dev)
 {
-    struct aicwf_usb_buf *usb_buf, *tmp;
-    unsigned long flags;
+    struct aicwf_usb_buf *usb_buf;
+    struct llist_node *chain[2];
+    int i;
 
     if (usb_dev->msg_out_urb)
         usb_kill_urb(usb_dev->msg_out_urb);
 
-    spin_lock_irqsave(&usb_dev->tx_post_lock, flags);
-    list_for_each_entry_safe(usb_buf, tmp, &usb_dev->tx_post_list, list) {
-        spin_unlock_irqrestore(&usb_dev->tx_post_lock, flags);
-        if (!usb_buf->urb) {
-            usb_err("bad usb_buf\n");
-            spin_lock_irqsave(&usb_dev->tx_post_lock, flags);
-            break;
-        }
-        usb_kill_urb(usb_buf->urb);
-        #if defined CONFIG_USB_NO_TRANS_DMA_MAP
-        // free dma buf if needed
-        if (usb_buf->data_buf) {
-            #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 35))
-            usb_free_coherent(usb_buf->usbdev->udev, DATA_BUF_MAX, usb_buf->data_buf, usb_buf->data_dma_trans_addr);
-            #else
-            usb_buffer_free(usb_buf->usbdev->udev, DATA_BUF_MAX, usb_buf->data_buf, usb_buf->data_dma_trans_addr);
+    //bustx is stopped, take the posted urbs so a late post cannot race the walk
+    chain[0] = usb_dev->tx_post_batch;
+    usb_dev->tx_post_batch = NULL;
+    chain[1] = llist_del_all(&usb_dev->tx_post_queue);
+    atomic_set(&usb_dev->tx_post_count, 0);
+    for (i = 0; i < 2; i++) {
+        llist_for_each_entry(usb_buf, chain[i], tx_node) {
+            if (!usb_buf->urb) {
+                usb_err("bad usb_buf\n");
+                goto rx;
+            }
+            usb_kill_urb(usb_buf->urb);
+            #if defined CONFIG_USB_NO_TRANS_DMA_MAP
+            // free dma buf if needed
+            if (usb_buf->data_buf) {
+                #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 35))
+                usb_free_coherent(usb_buf->usbdev->udev, DATA_BUF_MAX, usb_buf->data_buf, usb_buf->data_dma_trans_addr);
+                #else
+                usb_buffer_free(usb_buf->usbdev->udev, DATA_BUF_MAX, usb_buf->data_buf, usb_buf->data_dma_trans_addr);
+                #endif
+                usb_buf->data_buf = NULL;
+                usb_buf->data_dma_trans_addr = 0x0;
+            } else {
+                usb_err("bad usb dma buf\n");
+                goto rx;
+            }
             #endif
-            usb_buf->data_buf = NULL;
-            usb_buf->data_dma_trans_addr = 0x0;
-        } else {
-            usb_err("bad usb dma buf\n");
-            spin_lock_irqsave(&usb_dev->tx_post_lock, flags);
-            break;
         }
-        #endif
-        spin_lock_irqsave(&usb_dev->tx_post_lock, flags);
     }
-    spin_unlock_irqrestore(&usb_dev->tx_post_lock, flags);
 
+rx:
     usb_kill_anchored_urbs(&usb_dev->rx_submitted);
 #ifdef CONFIG_USB_MSG_IN_EP
 	if(usb_dev->msg_in_pipe){
@@ -1992,8 +2616,15 @@ static void aicwf_usb_bus_stop(struct device *dev)
 static void aicwf_usb_deinit(struct aic_usb_dev *usbdev)
 {
     cancel_work_sync(&usbdev->rx_urb_work);
+    cancel_delayed_work_sync(&usbdev->rx_urb_tune_work);
+#ifdef CONFIG_USB_TX_AGGR
+    aicwf_usb_aggr_abort(usbdev);
+#endif
     aicwf_usb_free_urb(&usbdev->rx_free_list, &usbdev->rx_free_lock);
-    aicwf_usb_free_urb(&usbdev->tx_free_list, &usbdev->tx_free_lock);
+    aicwf_usb_free_tx_urb(usbdev);
+#ifdef CONFIG_USB_RX_PAGE_FRAG
+    aicwf_usb_rx_page_pool_free(usbdev);
+#endif
 #ifdef CONFIG_USB_MSG_IN_EP
 	if(usbdev->msg_in_pipe){
 		cancel_work_sync(&usbdev->msg_rx_urb_work);
@@ -2011,6 +2642,16 @@ static void aicwf_usb_rx_urb_work(struct work_struct *work)
     aicwf_usb_rx_submit_all_urb(usb_dev);
 }
 
+#ifdef CONFIG_PREALLOC_RX_SKB
+/* rxbuff pool ran dry earlier and has buffers again, repost the idle urbs */
+void aicwf_usb_rxbuff_notify(void *ctx)
+{
+    struct aic_usb_dev *usb_dev = (struct aic_usb_dev *)ctx;
+
+    schedule_work(&usb_dev->rx_urb_work);
+}
+#endif
+
 #ifdef CONFIG_USB_MSG_IN_EP
 static void aicwf_usb_msg_rx_urb_work(struct work_struct *work)
 {
@@ -2027,6 +2668,14 @@ static int aicwf_usb_init(struct aic_usb_dev *usb_dev)
     usb_dev->tbusy = false;
     usb_dev->state = USB_DOWN_ST;
 
+    usb_dev->tx_irq_cpu = -1;
+    usb_dev->rx_irq_cpu = -1;
+    memset(&usb_dev->tx_thread_stat, 0, sizeof(usb_dev->tx_thread_stat));
+    memset(&usb_dev->rx_thread_stat, 0, sizeof(usb_dev->rx_thread_stat));
+    usb_dev->tx_thread_stat.cpu = usb_dev->tx_thread_stat.bound_cpu = -1;
+    usb_dev->rx_thread_stat.cpu = usb_dev->rx_thread_stat.bound_cpu = -1;
+    usb_dev->tx_thread_stat.want_cpu = usb_dev->rx_thread_stat.want_cpu = -1;
+
     init_waitqueue_head(&usb_dev->msg_wait);
     init_usb_anchor(&usb_dev->rx_submitted);
 #ifdef CONFIG_USB_MSG_IN_EP
@@ -2036,7 +2685,6 @@ static int aicwf_usb_init(struct aic_usb_dev *usb_dev)
 #endif
 
     spin_lock_init(&usb_dev->tx_free_lock);
-    spin_lock_init(&usb_dev->tx_post_lock);
     spin_lock_init(&usb_dev->rx_free_lock);
     spin_lock_init(&usb_dev->tx_flow_lock);
 #ifdef CONFIG_USB_MSG_IN_EP
@@ -2044,20 +2692,50 @@ static int aicwf_usb_init(struct aic_usb_dev *usb_dev)
 		spin_lock_init(&usb_dev->msg_rx_free_lock);
 	}
 #endif
+#ifdef CONFIG_USB_RX_PAGE_FRAG
+    spin_lock_init(&usb_dev->rx_page_lock);
+    usb_dev->rx_page_pool_size = usb_dev->rx_urbs_max * AICWF_USB_RX_PAGE_PER_URB;
+    usb_dev->rx_page_pool = kcalloc(usb_dev->rx_page_pool_size, sizeof(struct page *), GFP_KERNEL);
+    if (!usb_dev->rx_page_pool) {
+        usb_err("rx page pool alloc failed\n");
+        return -ENOMEM;
+    }
+    usb_dev->rx_page_order = get_order(SKB_DATA_ALIGN(aicwf_usb_rx_aggr ?
+                                       AICWF_USB_AGGR_MAX_PKT_SIZE : aicwf_usb_max_pkt_size) +
+                                       SKB_DATA_ALIGN(sizeof(struct skb_shared_info)));
+#endif
+#ifdef CONFIG_USB_RX_SG
+    //fall back to max_pkt_size urbs (and reassembly) if the hcd can't do sg or the fw may merge frames
+    usb_dev->rx_sg = rx_sg_fw_zlp && !aicwf_usb_rx_aggr &&
+                     usb_dev->udev->bus->sg_tablesize >= AICWF_USB_RX_SG_PAGES;
+    AICWFDBG(LOGINFO, "%s rx sg:%d\n", __func__, usb_dev->rx_sg);
+#endif
+#ifdef CONFIG_USB_TX_SG
+    //header/payload/padding entries are not maxpacket multiples, needs an hcd without sg constraints
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 14, 0)
+    usb_dev->tx_sg = usb_dev->udev->bus->no_sg_constraint && usb_dev->udev->bus->sg_tablesize >= 3;
+#else
+    usb_dev->tx_sg = false;
+#endif
+    AICWFDBG(LOGINFO, "%s tx sg:%d\n", __func__, usb_dev->tx_sg);
+#endif
 
     INIT_LIST_HEAD(&usb_dev->rx_free_list);
-    INIT_LIST_HEAD(&usb_dev->tx_free_list);
-    INIT_LIST_HEAD(&usb_dev->tx_post_list);
+    init_llist_head(&usb_dev->tx_free_stack);
+    init_llist_head(&usb_dev->tx_post_queue);
+    usb_dev->tx_post_batch = NULL;
 #ifdef CONFIG_USB_MSG_IN_EP
 	if(usb_dev->msg_in_pipe){
 		INIT_LIST_HEAD(&usb_dev->msg_rx_free_list);
 	}
 #endif
 
-	atomic_set(&rx_urb_cnt, 0);
+    atomic_set(&usb_dev->rx_urb_inflight, 0);
+    atomic_set(&usb_dev->rx_urb_window_cnt, 0);
 
-    usb_dev->tx_free_count = 0;
-    usb_dev->tx_post_count = 0;
+    atomic_set(&usb_dev->tx_free_count, 0);
+    atomic_set(&usb_dev->tx_post_count, 0);
+    memset(&usb_dev->tx_stat, 0, sizeof(usb_dev->tx_stat));
 
     ret =  aicwf_usb_alloc_rx_urb(usb_dev);
     if (ret) {
@@ -2085,6 +2763,7 @@ static int aicwf_usb_init(struct aic_usb_dev *usb_dev)
     }
 
     INIT_WORK(&usb_dev->rx_urb_work, aicwf_usb_rx_urb_work);
+    INIT_DELAYED_WORK(&usb_dev->rx_urb_tune_work, aicwf_usb_rx_urb_tune_work);
 #ifdef CONFIG_USB_MSG_IN_EP
 	if(usb_dev->msg_in_pipe){
 		INIT_WORK(&usb_dev->msg_rx_urb_work, aicwf_usb_msg_rx_urb_work);
@@ -2410,20 +3089,24 @@ static int aicwf_usb_probe(struct usb_interface *intf, const struct usb_device_i
 
     usb_dev = kzalloc(sizeof(struct aic_usb_dev), GFP_ATOMIC);
 
-    AICWFDBG(LOGDEBUG, "%s usb_dev:%d usb_tx_buf:%d usb_rx_buf:%d\r\n", 
-        __func__, 
-        (int)sizeof(struct aic_usb_dev),
-        (int)sizeof(struct aicwf_usb_buf) * AICWF_USB_TX_URBS,
-        (int)sizeof(struct aicwf_usb_buf) * AICWF_USB_RX_URBS);
-
-
     if (!usb_dev) {
         AICWFDBG(LOGERROR, "%s usb_dev kzalloc fail\r\n", __func__);
         return -ENOMEM;
     }
 
+    usb_dev->rx_urbs_max = clamp(aicwf_usb_rx_urbs_max, 1, AICWF_USB_RX_URBS_MAX);
+    usb_dev->rx_urbs_min = clamp(aicwf_usb_rx_urbs_min, 1, usb_dev->rx_urbs_max);
+    usb_dev->rx_urb_target = usb_dev->rx_urbs_min;
+    usb_dev->rx_urb_target_hwm = usb_dev->rx_urbs_min;
+
+    AICWFDBG(LOGDEBUG, "%s usb_dev:%d usb_tx_buf:%d usb_rx_buf:%d\r\n", 
+        __func__, 
+        (int)sizeof(struct aic_usb_dev),
+        (int)sizeof(struct aicwf_usb_buf) * AICWF_USB_TX_URBS,
+        (int)sizeof(struct aicwf_usb_buf) * usb_dev->rx_urbs_max);
+
     usb_dev->usb_tx_buf = vmalloc(sizeof(struct aicwf_usb_buf) * AICWF_USB_TX_URBS);
-    usb_dev->usb_rx_buf = vmalloc(sizeof(struct aicwf_usb_buf) * AICWF_USB_RX_URBS);
+    usb_dev->usb_rx_buf = vmalloc(sizeof(struct aicwf_usb_buf) * usb_dev->rx_urbs_max);
 
     if(!usb_dev->usb_tx_buf || !usb_dev->usb_rx_buf){
         if(usb_dev->usb_tx_buf){
@@ -2447,7 +3130,7 @@ static int aicwf_usb_probe(struct usb_interface *intf, const struct usb_device_i
 
     memset(usb_dev->usb_rx_buf, 
         0, 
-        (int)(sizeof(struct aicwf_usb_buf) * AICWF_USB_RX_URBS));
+        (int)(sizeof(struct aicwf_usb_buf) * usb_dev->rx_urbs_max));
 
 
     usb_dev->udev = usb;
@@ -2509,6 +3192,7 @@ static int aicwf_usb_probe(struct usb_interface *intf, const struct usb_device_i
     aicwf_frame_queue_init(&tx_priv->txq, 8, TXQLEN);
     spin_lock_init(&tx_priv->txqlock);
     spin_lock_init(&tx_priv->txdlock);
+    aicwf_usb_aggr_init(tx_priv);
 #endif
 
     ret = aicwf_bus_init(0, dev);
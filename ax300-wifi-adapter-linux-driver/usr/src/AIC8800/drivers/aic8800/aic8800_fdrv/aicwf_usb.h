@@ -10,7 +10,12 @@
 #define _AICWF_USB_H_
 
 #include <linux/usb.h>
+#include <linux/scatterlist.h>
+#include <linux/llist.h>
 #include "rwnx_cmds.h"
+#ifdef CONFIG_TX_BQL
+#include "rwnx_tx.h"
+#endif
 
 #ifdef AICWF_USB_SUPPORT
 
@@ -67,6 +72,8 @@ enum AICWF_IC{
 
 
 #define AICWF_USB_RX_URBS               (20)//(200)
+#define AICWF_USB_RX_URBS_MAX           (200)
+#define AICWF_USB_RX_URBS_STEP          (4)
 #ifdef CONFIG_USB_MSG_IN_EP
 #define AICWF_USB_MSG_RX_URBS           (100)
 #endif
@@ -86,8 +93,15 @@ enum AICWF_IC{
 #define AICWF_USB_MSG_MAX_PKT_SIZE      (2048)
 #define AICWF_USB_MAX_PKT_SIZE          (2048)
 #define AICWF_USB_MAX_AMSDU_PKT_SIZE    (2048*6)
+#ifdef CONFIG_USB_RX_SG
+#define AICWF_USB_RX_SG_PAGES           DIV_ROUND_UP(AICWF_USB_MAX_AMSDU_PKT_SIZE, PAGE_SIZE)
+#define AICWF_USB_RX_SG_HDR_LEN         256 //copied to the skb linear part
+#endif
 #define AICWF_USB_FC_PERSTA_HIGH_WATER		64
 #define AICWF_USB_FC_PERSTA_LOW_WATER		16
+#ifdef CONFIG_USB_RX_PAGE_FRAG
+#define AICWF_USB_RX_PAGE_PER_URB       2   //page pool entries per allocated rx urb
+#endif
 
 
 typedef enum {
@@ -104,13 +118,48 @@ enum aicwf_usb_state {
     USB_SLEEP_ST
 };
 
+enum aicwf_thread_cpu_policy {
+    AICWF_THREAD_CPU_LEGACY,        //tx and rx threads both on cpu1
+    AICWF_THREAD_CPU_UNBOUND,       //let the scheduler place them
+    AICWF_THREAD_CPU_SPLIT,         //tx on bustx_thread_cpu, rx on busrx_thread_cpu
+    AICWF_THREAD_CPU_FOLLOW_IRQ,    //follow the cpu completing the bulk urbs
+    AICWF_THREAD_CPU_MAX
+};
+
+struct aicwf_thread_stat {
+    u64 wakeups;
+    u64 busy_ns;
+    u64 migrations;
+    int cpu;                        //cpu of the last wakeup
+    int bound_cpu;                  //-1 when unbound
+    int want_cpu;                   //cpu the policy asked for, -1 for none
+};
+
+//urb path counters, lock round-trips are the ones taken per packet
+struct aicwf_usb_tx_stat {
+    atomic_t free_get;              //tx_free_lock round-trips
+    atomic_t free_put;              //lock-free, from tx completion
+    atomic_t free_empty;
+    atomic_t post;                  //lock-free
+    atomic_t flow_lock;             //tx_flow_lock round-trips
+    u32 splice;                     //bustx only from here on
+    u32 submit;
+    u32 submit_err;
+    u32 batch_max;
+};
+
 struct aicwf_usb_buf {
     struct list_head list;
+    struct llist_node tx_node;      //tx free stack or post queue
     struct aic_usb_dev *usbdev;
     struct urb *urb;
     struct sk_buff *skb;
 #ifdef CONFIG_PREALLOC_RX_SKB
     struct rx_buff *rx_buff;
+#endif
+#ifdef CONFIG_USB_RX_SG
+    struct scatterlist sg[AICWF_USB_RX_SG_PAGES];
+    struct page *sg_page[AICWF_USB_RX_SG_PAGES];
 #endif
     #ifdef CONFIG_USB_NO_TRANS_DMA_MAP
     u8 *data_buf;
@@ -120,7 +169,19 @@ struct aicwf_usb_buf {
     #ifdef CONFIG_USB_TX_AGGR
     u8 aggr_cnt;
     #endif
+#ifdef CONFIG_TX_BQL
+    /* completed at urb completion (or when the buffer is dropped) */
+    #ifdef CONFIG_USB_TX_AGGR
+    struct rwnx_tx_bql bql[NX_VIRT_DEV_MAX];    //one AC per batch, one queue per vif
+    #else
+    struct rwnx_tx_bql bql[1];
+    #endif
+#endif
 	u8* usb_align_data;
+#ifdef CONFIG_USB_TX_SG
+    struct scatterlist tx_sg[3];    //usb header + txdesc, payload, padding
+    u8 *tx_hdr;
+#endif
 };
 
 struct aic_usb_dev {
@@ -144,16 +205,16 @@ struct aic_usb_dev {
 #endif
 
     spinlock_t rx_free_lock;
-    spinlock_t tx_free_lock;
-    spinlock_t tx_post_lock;
+    spinlock_t tx_free_lock;        //serializes free stack pops only
     spinlock_t tx_flow_lock;
 #ifdef CONFIG_USB_MSG_IN_EP
 	spinlock_t msg_rx_free_lock;
 #endif
 
     struct list_head rx_free_list;
-    struct list_head tx_free_list;
-    struct list_head tx_post_list;
+    struct llist_head tx_free_stack;
+    struct llist_head tx_post_queue;
+    struct llist_node *tx_post_batch; //spliced but not yet submitted, bustx only
 #ifdef CONFIG_USB_MSG_IN_EP
 	struct list_head msg_rx_free_list;
 #endif
@@ -167,8 +228,9 @@ struct aic_usb_dev {
 	uint msg_in_pipe;
 #endif
 
-    int tx_free_count;
-    int tx_post_count;
+    atomic_t tx_free_count;
+    atomic_t tx_post_count;
+    struct aicwf_usb_tx_stat tx_stat;
     bool rx_prepare_ready;
 #if 0
     struct aicwf_usb_buf usb_tx_buf[AICWF_USB_TX_URBS];
@@ -196,6 +258,32 @@ struct aic_usb_dev {
 #ifdef CONFIG_TX_TASKLET//AIDEN tasklet
 	struct tasklet_struct xmit_tasklet;
 #endif
+#ifdef CONFIG_USB_RX_PAGE_FRAG
+    spinlock_t rx_page_lock;
+    struct page **rx_page_pool;
+    int rx_page_pool_size;
+    u32 rx_page_order;
+#endif
+#ifdef CONFIG_USB_RX_SG
+    bool rx_sg;                     //bulk-in posted as sg urbs of AICWF_USB_MAX_AMSDU_PKT_SIZE
+#endif
+#ifdef CONFIG_USB_TX_SG
+    bool tx_sg;                     //hcd takes unaligned sg entries on bulk-out
+#endif
+    int tx_irq_cpu;
+    int rx_irq_cpu;
+    int rx_urbs_min;
+    int rx_urbs_max;                //number of rx urbs allocated
+    int rx_urb_target;              //current posted bulk-in depth
+    int rx_urb_target_hwm;
+    atomic_t rx_urb_inflight;       //bulk-in urbs of this device in the anchor
+    int rx_urb_inflight_hwm;
+    u32 rx_urb_grow;
+    u32 rx_urb_shrink;
+    atomic_t rx_urb_window_cnt;     //completions since the last tune work
+    struct delayed_work rx_urb_tune_work;
+    struct aicwf_thread_stat tx_thread_stat;
+    struct aicwf_thread_stat rx_thread_stat;
 	u16 chipid;
     bool tbusy;
 	u16_l vid;
@@ -210,6 +298,16 @@ int usb_msg_busrx_thread(void *data);
 #endif
 int usb_bustx_thread(void *data);
 int usb_busrx_thread(void *data);
+#ifdef CONFIG_PREALLOC_RX_SKB
+void aicwf_usb_rxbuff_notify(void *ctx);
+#endif
+extern int txrx_thread_cpu_policy;
+extern int bustx_thread_cpu;
+extern int busrx_thread_cpu;
+#ifdef CONFIG_USB_TX_AGGR
+extern int aicwf_usb_tx_aggr_num;
+extern int aicwf_usb_tx_aggr_us;
+#endif
 
 
 extern void aicwf_hostif_ready(void);
@@ -30,7 +30,64 @@
  */
 extern int aicwf_sdio_writeb(struct aic_sdio_dev *sdiodev, uint regaddr, u8 val);
 
-void rwnx_cmd_free(struct rwnx_cmd *cmd);
+static int cmd_slot_get(struct rwnx_cmd_mgr *cmd_mgr)
+{
+    int i;
+
+    do {
+        i = find_first_zero_bit(cmd_mgr->cmd_used, RWNX_CMD_ARRAY_SIZE);
+        if (i >= RWNX_CMD_ARRAY_SIZE)
+            return -1;
+    } while (test_and_set_bit(i, cmd_mgr->cmd_used));
+
+    return i;
+}
+
+/* Waits for a free slot when flags allow blocking, NULL (-EBUSY) otherwise */
+struct rwnx_cmd *rwnx_cmd_malloc(struct rwnx_cmd_mgr *cmd_mgr, gfp_t flags)
+{
+    struct rwnx_cmd *cmd;
+    int i, inuse;
+
+    i = cmd_slot_get(cmd_mgr);
+    if (i < 0 && gfpflags_allow_blocking(flags)) {
+        cmd_mgr->cmd_waits++;
+        wait_event_timeout(cmd_mgr->cmd_wait, (i = cmd_slot_get(cmd_mgr)) >= 0,
+                           msecs_to_jiffies(RWNX_80211_CMD_TIMEOUT_MS));
+    }
+    if (i < 0) {
+        cmd_mgr->cmd_busy++;
+        AICWFDBG(LOGERROR, "%s all %d cmds in use\n", __func__, RWNX_CMD_ARRAY_SIZE);
+        return NULL;
+    }
+
+    inuse = atomic_inc_return(&cmd_mgr->cmd_inuse);
+    if (inuse > cmd_mgr->cmd_peak)
+        cmd_mgr->cmd_peak = inuse;
+
+    cmd = &cmd_mgr->cmd_array[i];
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->array_id = i;
+    cmd->cmd_mgr = cmd_mgr;
+    AICWFDBG(LOGTRACE, "%s cmd_array[%d]:%p\n", __func__, i, cmd);
+
+    return cmd;
+}
+
+void rwnx_cmd_free(struct rwnx_cmd *cmd)
+{
+    struct rwnx_cmd_mgr *cmd_mgr = cmd->cmd_mgr;
+
+    AICWFDBG(LOGTRACE, "%s cmd_array[%d]:%p\n", __func__, cmd->array_id, cmd);
+    if (WARN_ON(!test_bit(cmd->array_id, cmd_mgr->cmd_used)))
+        return;
+
+    atomic_dec(&cmd_mgr->cmd_inuse);
+    clear_bit_unlock(cmd->array_id, cmd_mgr->cmd_used);
+    smp_mb();
+    if (waitqueue_active(&cmd_mgr->cmd_wait))
+        wake_up(&cmd_mgr->cmd_wait);
+}
 
 static void cmd_dump(const struct rwnx_cmd *cmd)
 {
@@ -67,6 +124,12 @@ static void cmd_complete(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd)
 
 int cmd_mgr_queue_force_defer(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd)
 {
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+    /* every push is already deferred to cmd_wq, just don't wait */
+    cmd->flags |= RWNX_CMD_FLAG_NONBLOCK;
+    cmd->e2a_msg = NULL;
+    return cmd_mgr->queue(cmd_mgr, cmd);
+#else
     bool defer_push = false;
 
     RWNX_DBG(RWNX_FN_ENTRY_STR);
@@ -115,11 +178,280 @@ int cmd_mgr_queue_force_defer(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd
 
     WAKE_CMD_WORK(cmd_mgr);
     return 0;
+#endif
 }
 
 void rwnx_msg_free_(struct lmac_msg *msg);
 
 
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+struct cmd_mgr_done {
+    rwnx_cmd_done_fct done;
+    int result;
+    void *cfm;
+    void *arg;
+};
+
+static void *cmd_mgr_bus_dev(struct rwnx_cmd_mgr *cmd_mgr)
+{
+#ifdef AICWF_SDIO_SUPPORT
+    return container_of(cmd_mgr, struct aic_sdio_dev, cmd_mgr);
+#else
+    return container_of(cmd_mgr, struct aic_usb_dev, cmd_mgr);
+#endif
+}
+
+static struct rwnx_hw *cmd_mgr_hw(struct rwnx_cmd_mgr *cmd_mgr)
+{
+#ifdef AICWF_SDIO_SUPPORT
+    return container_of(cmd_mgr, struct aic_sdio_dev, cmd_mgr)->rwnx_hw;
+#else
+    return container_of(cmd_mgr, struct aic_usb_dev, cmd_mgr)->rwnx_hw;
+#endif
+}
+
+/* called with cmd_mgr->lock held */
+static void cmd_mgr_dequeue(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd)
+{
+    list_del(&cmd->list);
+    cmd_mgr->queue_sz--;
+    if (cmd_mgr->queue_sz == 0)
+        rwnx_wakeup_unlock(cmd_mgr_hw(cmd_mgr)->ws_tx);
+}
+
+static void cmd_mgr_release(struct rwnx_cmd *cmd)
+{
+    /* only still set if the cmd was never pushed */
+    kfree(cmd->a2e_msg);
+    cmd->a2e_msg = NULL;
+    rwnx_cmd_free(cmd);
+}
+
+/* detach the async completion of cmd, to be run once the lock is dropped */
+static void cmd_mgr_take_done(struct rwnx_cmd *cmd, struct cmd_mgr_done *d)
+{
+    d->done = cmd->done;
+    d->result = cmd->result;
+    d->cfm = cmd->e2a_msg;
+    d->arg = cmd->done_arg;
+    cmd->done = NULL;
+    cmd->e2a_msg = NULL;
+}
+
+static void cmd_mgr_run_done(struct rwnx_cmd_mgr *cmd_mgr,
+                             struct cmd_mgr_done *d, int nb)
+{
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        if (d[i].done)
+            d[i].done(cmd_mgr_hw(cmd_mgr), d[i].result, d[i].cfm, d[i].arg);
+    }
+}
+
+static void cmd_mgr_arm_timeout(struct rwnx_cmd_mgr *cmd_mgr, unsigned long deadline)
+{
+    long delay = (long)(deadline - jiffies);
+
+    /* no-op if pending, the pending one is never later */
+    queue_delayed_work(cmd_mgr->cmd_wq, &cmd_mgr->tmoWork, delay > 0 ? delay : 0);
+}
+
+/* Every request is pushed from cmd_wq, in queue order. The caller only waits
+ * for its own cfm, so up to max_queue_sz requests are in flight */
+static int cmd_mgr_queue(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd)
+{
+    bool nonblock;
+    int ret;
+
+#ifdef CREATE_TRACE_POINTS
+    trace_msg_send(cmd->id);
+#endif
+    /* callers in softirq (traffic ind from the tx path) cannot wait */
+    if (!(cmd->flags & RWNX_CMD_FLAG_NONBLOCK) &&
+        (in_softirq() || cmd->a2e_msg->id == ME_TRAFFIC_IND_REQ
+    #ifdef AICWF_ARP_OFFLOAD
+         || cmd->a2e_msg->id == MM_SET_ARPOFFLOAD_REQ
+    #endif
+        )) {
+        cmd->flags |= RWNX_CMD_FLAG_NONBLOCK;
+        cmd->e2a_msg = NULL;
+    }
+
+    spin_lock_bh(&cmd_mgr->lock);
+    if (cmd_mgr->state != RWNX_CMD_MGR_STATE_INITED) {
+        printk(KERN_CRIT"cmd queue crashed\n");
+        ret = -EPIPE;
+        goto fail;
+    }
+    if (cmd_mgr->queue_sz >= cmd_mgr->max_queue_sz) {
+        printk(KERN_CRIT"Too many cmds (%d) already queued\n",
+               cmd_mgr->max_queue_sz);
+        ret = -ENOMEM;
+        goto fail;
+    }
+
+    cmd->flags |= RWNX_CMD_FLAG_WAIT_PUSH;
+    if (cmd->flags & RWNX_CMD_FLAG_REQ_CFM)
+        cmd->flags |= RWNX_CMD_FLAG_WAIT_CFM;
+
+    cmd->tkn    = cmd_mgr->next_tkn++;
+    cmd->result = -EINTR;
+
+    nonblock = cmd->flags & RWNX_CMD_FLAG_NONBLOCK;
+    if (!nonblock)
+        init_completion(&cmd->complete);
+
+    list_add_tail(&cmd->list, &cmd_mgr->cmds);
+    if (cmd_mgr->queue_sz == 0)
+        rwnx_wakeup_lock(cmd_mgr_hw(cmd_mgr)->ws_tx);
+    cmd_mgr->queue_sz++;
+    spin_unlock_bh(&cmd_mgr->lock);
+
+    WAKE_CMD_WORK(cmd_mgr);
+
+    /* owned by the manager from here */
+    if (nonblock)
+        return 0;
+
+    if (wait_for_completion_killable(&cmd->complete))
+        AICWFDBG(LOGERROR, "%s: %s interrupted\n", __func__, RWNX_ID2STR(cmd->id));
+
+    spin_lock_bh(&cmd_mgr->lock);
+    ret = (cmd->flags & RWNX_CMD_FLAG_DONE) ? cmd->result : -EINTR;
+    if ((cmd->flags & (RWNX_CMD_FLAG_WAIT_PUSH | RWNX_CMD_FLAG_WAIT_CFM)) ==
+        RWNX_CMD_FLAG_WAIT_CFM) {
+        /* pushed but no cfm yet: keep it so a late cfm is not taken for
+         * the one of a later request with the same reqid */
+        cmd->flags |= RWNX_CMD_FLAG_ORPHAN | RWNX_CMD_FLAG_DONE;
+        cmd->e2a_msg = NULL;
+        cmd->deadline = jiffies + msecs_to_jiffies(RWNX_80211_CMD_TIMEOUT_MS);
+        cmd_mgr_arm_timeout(cmd_mgr, cmd->deadline);
+        cmd = NULL;
+    } else {
+        cmd_mgr_dequeue(cmd_mgr, cmd);
+    }
+    spin_unlock_bh(&cmd_mgr->lock);
+
+    if (cmd)
+        cmd_mgr_release(cmd);
+    return ret;
+
+fail:
+    cmd->result = ret;
+    spin_unlock_bh(&cmd_mgr->lock);
+    cmd_mgr_release(cmd);
+    return ret;
+}
+
+void cmd_mgr_task_process(struct work_struct *work)
+{
+    struct rwnx_cmd_mgr *cmd_mgr = container_of(work, struct rwnx_cmd_mgr, cmdWork);
+    unsigned long tout = msecs_to_jiffies(RWNX_80211_CMD_TIMEOUT_MS);
+    struct rwnx_cmd *cur, *next;
+    struct lmac_msg *msg;
+
+    RWNX_DBG(RWNX_FN_ENTRY_STR);
+
+    while (1) {
+        next = NULL;
+        spin_lock_bh(&cmd_mgr->lock);
+        list_for_each_entry(cur, &cmd_mgr->cmds, list) {
+            if (cur->flags & RWNX_CMD_FLAG_WAIT_PUSH) {
+                next = cur;
+                break;
+            }
+        }
+        if (next == NULL) {
+            spin_unlock_bh(&cmd_mgr->lock);
+            break;
+        }
+
+        /* next may be freed once unlocked, only msg is used below */
+        msg = next->a2e_msg;
+        next->a2e_msg = NULL;
+        next->flags &= ~RWNX_CMD_FLAG_WAIT_PUSH;
+        next->deadline = jiffies + tout;
+        if (!(next->flags & RWNX_CMD_FLAG_WAIT_CFM)) {
+            next->result = 0;
+            if (next->flags & RWNX_CMD_FLAG_NONBLOCK) {
+                cmd_mgr_dequeue(cmd_mgr, next);
+                cmd_mgr_release(next);
+            } else {
+                next->flags |= RWNX_CMD_FLAG_DONE;
+                complete(&next->complete);
+            }
+        }
+        spin_unlock_bh(&cmd_mgr->lock);
+
+        AICWFDBG(LOGTRACE, "push:id=%x, param_len=%u\n", msg->id, msg->param_len);
+        aicwf_set_cmd_tx(cmd_mgr_bus_dev(cmd_mgr), msg, sizeof(struct lmac_msg) + msg->param_len);
+        kfree(msg);
+
+        queue_delayed_work(cmd_mgr->cmd_wq, &cmd_mgr->tmoWork, tout);
+    }
+}
+
+/* per request cfm timeout, the other requests in flight are left alone */
+static void cmd_mgr_timeout_process(struct work_struct *work)
+{
+    struct rwnx_cmd_mgr *cmd_mgr = container_of(to_delayed_work(work),
+                                                struct rwnx_cmd_mgr, tmoWork);
+    struct cmd_mgr_done done[RWNX_CMD_MAX_QUEUED];
+    struct rwnx_cmd *cur, *nxt;
+    unsigned long next = 0;
+    bool rearm = false;
+    int nb_done = 0;
+
+    spin_lock_bh(&cmd_mgr->lock);
+    list_for_each_entry_safe(cur, nxt, &cmd_mgr->cmds, list) {
+        /* pushed in list order */
+        if (cur->flags & RWNX_CMD_FLAG_WAIT_PUSH)
+            break;
+        /* signalled, its waiter owns it */
+        if ((cur->flags & (RWNX_CMD_FLAG_DONE | RWNX_CMD_FLAG_ORPHAN)) ==
+            RWNX_CMD_FLAG_DONE)
+            continue;
+
+        if (time_before(jiffies, cur->deadline)) {
+            if (!rearm || time_before(cur->deadline, next))
+                next = cur->deadline;
+            rearm = true;
+            continue;
+        }
+
+        if (cur->flags & RWNX_CMD_FLAG_ORPHAN) {
+            cmd_mgr_dequeue(cmd_mgr, cur);
+            cmd_mgr_release(cur);
+            continue;
+        }
+
+        printk(KERN_CRIT"%s cmd timed-out cmd_mgr->queue_sz:%d\n", __func__, cmd_mgr->queue_sz);
+        cur->result = -ETIMEDOUT;
+        cmd_dump(cur);
+        if (++cmd_mgr->timeouts >= RWNX_CMD_CRASH_TIMEOUTS)
+            cmd_mgr->state = RWNX_CMD_MGR_STATE_CRASHED;
+
+        if (cur->flags & RWNX_CMD_FLAG_NONBLOCK) {
+            if (nb_done < ARRAY_SIZE(done))
+                cmd_mgr_take_done(cur, &done[nb_done++]);
+            cur->flags |= RWNX_CMD_FLAG_ORPHAN | RWNX_CMD_FLAG_DONE;
+            cur->deadline = jiffies + msecs_to_jiffies(RWNX_80211_CMD_TIMEOUT_MS);
+            if (!rearm || time_before(cur->deadline, next))
+                next = cur->deadline;
+            rearm = true;
+        } else {
+            cur->flags |= RWNX_CMD_FLAG_DONE;
+            complete(&cur->complete);
+        }
+    }
+    if (rearm)
+        cmd_mgr_arm_timeout(cmd_mgr, next);
+    spin_unlock_bh(&cmd_mgr->lock);
+
+    cmd_mgr_run_done(cmd_mgr, done, nb_done);
+}
+#else
 static int cmd_mgr_queue(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd)
 {
 	int ret = 0;
@@ -269,6 +601,11 @@ static int cmd_mgr_queue(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd)
                 cmd_complete(cmd_mgr, cmd);
             }
 			ret = -ETIMEDOUT;
+            //the sender frees the slot on error, it must not stay queued
+            list_del_init(&cmd->list);
+            cmd_mgr->queue_sz--;
+            if (cmd_mgr->queue_sz == 0)
+                rwnx_wakeup_unlock(usbdev->rwnx_hw->ws_tx);
             spin_unlock_bh(&cmd_mgr->lock);
         }
 		else{
@@ -289,6 +626,7 @@ static int cmd_mgr_queue(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd)
     }
     return ret;
 }
+#endif /* CONFIG_RWNX_CMD_PIPELINE */
 
 /**
  *
@@ -336,6 +674,7 @@ static int cmd_mgr_llind(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd)
     return 0;
 }
 
+#ifndef CONFIG_RWNX_CMD_PIPELINE
 void cmd_mgr_task_process(struct work_struct *work)
 {
     struct rwnx_cmd_mgr *cmd_mgr = container_of(work, struct rwnx_cmd_mgr, cmdWork);
@@ -351,6 +690,8 @@ void cmd_mgr_task_process(struct work_struct *work)
         list_for_each_entry(cur, &cmd_mgr->cmds, list) {
             if (cur->flags & RWNX_CMD_FLAG_WAIT_PUSH) { //just judge the first
                     next = cur;
+                    //taken under the lock, cmd_mgr_drain frees only unpushed cmds
+                    next->flags &= ~RWNX_CMD_FLAG_WAIT_PUSH;
             }
             break;
         }
@@ -366,7 +707,6 @@ void cmd_mgr_task_process(struct work_struct *work)
 	    #ifdef AICWF_USB_SUPPORT
     	    struct aic_usb_dev *usbdev = container_of(cmd_mgr, struct aic_usb_dev, cmd_mgr);
 	    #endif
-            next->flags &= ~RWNX_CMD_FLAG_WAIT_PUSH;
 
             //printk("cmd_process, cmd->id=%d, tkn=%d\r\n",next->reqid, next->tkn);
             //rwnx_ipc_msg_push(rwnx_hw, next, RWNX_CMD_A2EMSG_LEN(next->a2e_msg));
@@ -379,16 +719,26 @@ void cmd_mgr_task_process(struct work_struct *work)
 
             tout = msecs_to_jiffies(RWNX_80211_CMD_TIMEOUT_MS * cmd_mgr->queue_sz);
             if (!wait_for_completion_killable_timeout(&next->complete, tout)) {
+                bool nonblock = next->flags & RWNX_CMD_FLAG_NONBLOCK;
+
                 printk(KERN_CRIT"%s cmd timed-out cmd_mgr->queue_sz:%d\n", __func__, cmd_mgr->queue_sz);
                 cmd_dump(next);
                 spin_lock_bh(&cmd_mgr->lock);
                 //AIDEN  workaround  
                 cmd_mgr->state = RWNX_CMD_MGR_STATE_CRASHED;
+                //deferred cmds have no waiter, nor a slot owner besides this work
+                list_del_init(&next->list);
+                cmd_mgr->queue_sz--;
+                if (cmd_mgr->queue_sz == 0)
+                    rwnx_wakeup_unlock(usbdev->rwnx_hw->ws_tx);
                 if (!(next->flags & RWNX_CMD_FLAG_DONE)) {
                     next->result = -ETIMEDOUT;
                     cmd_complete(cmd_mgr, next);
                 }
                 spin_unlock_bh(&cmd_mgr->lock);
+                //cmd_complete() already freed a nonblock one
+                if (!nonblock)
+                    rwnx_cmd_free(next);
             } else {
 				spin_lock_bh(&cmd_mgr->lock);
 				list_del(&next->list);
@@ -403,6 +753,7 @@ void cmd_mgr_task_process(struct work_struct *work)
     }
 
 }
+#endif /* CONFIG_RWNX_CMD_PIPELINE */
 
 
 static int cmd_mgr_run_callback(struct rwnx_hw *rwnx_hw, struct rwnx_cmd *cmd,
@@ -442,6 +793,9 @@ static int cmd_mgr_msgind(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd_e2amsg *
 #endif
     struct rwnx_cmd *cmd, *pos;
     bool found = false;
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+    struct cmd_mgr_done done = { NULL };
+#endif
 
    // RWNX_DBG(RWNX_FN_ENTRY_STR);
 #ifdef CREATE_TRACE_POINTS
@@ -450,6 +804,11 @@ static int cmd_mgr_msgind(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd_e2amsg *
     AICWFDBG(LOGTRACE, "%s cmd->id=%d\n", __func__, msg->id);
     spin_lock_bh(&cmd_mgr->lock);
     list_for_each_entry_safe(cmd, pos, &cmd_mgr->cmds, list) {
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+        /* cfms come back in push order */
+        if (cmd->flags & RWNX_CMD_FLAG_WAIT_PUSH)
+            break;
+#endif
         if (cmd->reqid == msg->id &&
             (cmd->flags & RWNX_CMD_FLAG_WAIT_CFM)) {
 
@@ -466,6 +825,19 @@ static int cmd_mgr_msgind(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd_e2amsg *
                 if (cmd->e2a_msg && msg->param_len)
                     memcpy(cmd->e2a_msg, &msg->param, msg->param_len);
 
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+                cmd_mgr->timeouts = 0;
+                if (cmd->flags & (RWNX_CMD_FLAG_NONBLOCK | RWNX_CMD_FLAG_ORPHAN)) {
+                    /* an async one that timed out already had its done */
+                    if (!(cmd->flags & RWNX_CMD_FLAG_ORPHAN)) {
+                        cmd->result = 0;
+                        cmd_mgr_take_done(cmd, &done);
+                    }
+                    cmd_mgr_dequeue(cmd_mgr, cmd);
+                    cmd_mgr_release(cmd);
+                    break;
+                }
+#endif
                 if (RWNX_CMD_WAIT_COMPLETE(cmd->flags))
                     cmd_complete(cmd_mgr, cmd);
 
@@ -475,6 +847,9 @@ static int cmd_mgr_msgind(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd_e2amsg *
     }
     spin_unlock_bh(&cmd_mgr->lock);
 
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+    cmd_mgr_run_done(cmd_mgr, &done, 1);
+#endif
     if (!found)
         cmd_mgr_run_callback(rwnx_hw, NULL, msg, cb);
 
@@ -498,6 +873,38 @@ static void cmd_mgr_print(struct rwnx_cmd_mgr *cmd_mgr)
     spin_unlock_bh(&cmd_mgr->lock);
 }
 
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+static void cmd_mgr_drain(struct rwnx_cmd_mgr *cmd_mgr)
+{
+    struct cmd_mgr_done done[RWNX_CMD_MAX_QUEUED];
+    struct rwnx_cmd *cur, *nxt;
+    int nb_done = 0;
+
+    RWNX_DBG(RWNX_FN_ENTRY_STR);
+
+    cancel_delayed_work_sync(&cmd_mgr->tmoWork);
+
+    spin_lock_bh(&cmd_mgr->lock);
+    cmd_mgr->state = RWNX_CMD_MGR_STATE_CRASHED;
+    list_for_each_entry_safe(cur, nxt, &cmd_mgr->cmds, list) {
+        cur->result = -EPIPE;
+        if (cur->flags & (RWNX_CMD_FLAG_NONBLOCK | RWNX_CMD_FLAG_ORPHAN)) {
+            if (!(cur->flags & RWNX_CMD_FLAG_ORPHAN) && nb_done < ARRAY_SIZE(done))
+                cmd_mgr_take_done(cur, &done[nb_done++]);
+            cmd_mgr_dequeue(cmd_mgr, cur);
+            cmd_mgr_release(cur);
+        } else if (!(cur->flags & RWNX_CMD_FLAG_DONE)) {
+            /* its waiter dequeues and frees it */
+            cur->flags &= ~(RWNX_CMD_FLAG_WAIT_PUSH | RWNX_CMD_FLAG_WAIT_CFM);
+            cur->flags |= RWNX_CMD_FLAG_DONE;
+            complete(&cur->complete);
+        }
+    }
+    spin_unlock_bh(&cmd_mgr->lock);
+
+    cmd_mgr_run_done(cmd_mgr, done, nb_done);
+}
+#else
 static void cmd_mgr_drain(struct rwnx_cmd_mgr *cmd_mgr)
 {
     struct rwnx_cmd *cur, *nxt;
@@ -506,10 +913,18 @@ static void cmd_mgr_drain(struct rwnx_cmd_mgr *cmd_mgr)
 
     spin_lock_bh(&cmd_mgr->lock);
     list_for_each_entry_safe(cur, nxt, &cmd_mgr->cmds, list) {
-        list_del(&cur->list);
+        //a woken waiter dequeues it again, keep the entry self linked
+        list_del_init(&cur->list);
         //cmd_mgr->queue_sz--;
-        if (!(cur->flags & RWNX_CMD_FLAG_NONBLOCK))
+        if (cur->flags & (RWNX_CMD_FLAG_NONBLOCK | RWNX_CMD_FLAG_WAIT_PUSH)) {
+            //nobody waits on a nonblock or a never pushed deferred cmd
+            if (cur->flags & RWNX_CMD_FLAG_WAIT_PUSH)
+                kfree(cur->a2e_msg);
+            cmd_mgr->queue_sz--;
+            rwnx_cmd_free(cur);
+        } else {
             complete(&cur->complete);
+        }
     }
     spin_unlock_bh(&cmd_mgr->lock);
     #if 0
@@ -519,6 +934,7 @@ static void cmd_mgr_drain(struct rwnx_cmd_mgr *cmd_mgr)
 	#endif
 
 }
+#endif /* CONFIG_RWNX_CMD_PIPELINE */
 
 void rwnx_cmd_mgr_init(struct rwnx_cmd_mgr *cmd_mgr)
 {
@@ -526,6 +942,12 @@ void rwnx_cmd_mgr_init(struct rwnx_cmd_mgr *cmd_mgr)
 
     INIT_LIST_HEAD(&cmd_mgr->cmds);
 	cmd_mgr->state = RWNX_CMD_MGR_STATE_INITED;
+    bitmap_zero(cmd_mgr->cmd_used, RWNX_CMD_ARRAY_SIZE);
+    init_waitqueue_head(&cmd_mgr->cmd_wait);
+    atomic_set(&cmd_mgr->cmd_inuse, 0);
+    cmd_mgr->cmd_peak = 0;
+    cmd_mgr->cmd_waits = 0;
+    cmd_mgr->cmd_busy = 0;
     spin_lock_init(&cmd_mgr->lock);
     cmd_mgr->max_queue_sz = RWNX_CMD_MAX_QUEUED;
     cmd_mgr->queue  = &cmd_mgr_queue;
@@ -535,6 +957,11 @@ void rwnx_cmd_mgr_init(struct rwnx_cmd_mgr *cmd_mgr)
     cmd_mgr->msgind = &cmd_mgr_msgind;
 
     INIT_WORK(&cmd_mgr->cmdWork, cmd_mgr_task_process);
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+    INIT_DELAYED_WORK(&cmd_mgr->tmoWork, cmd_mgr_timeout_process);
+    mutex_init(&cmd_mgr->push_mutex);
+    cmd_mgr->timeouts = 0;
+#endif
     cmd_mgr->cmd_wq = create_singlethread_workqueue("cmd_wq");
     if (!cmd_mgr->cmd_wq) {
         txrx_err("insufficient memory to create cmd workqueue.\n");
@@ -549,7 +976,17 @@ void rwnx_cmd_mgr_deinit(struct rwnx_cmd_mgr *cmd_mgr)
         cmd_mgr->drain(cmd_mgr);
         cmd_mgr->print(cmd_mgr);
         flush_workqueue(cmd_mgr->cmd_wq);
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+        cancel_delayed_work_sync(&cmd_mgr->tmoWork);
+#endif
         destroy_workqueue(cmd_mgr->cmd_wq);
+        /* woken waiters still own their cmd_array slot until rwnx_cmd_free */
+        if (!wait_event_timeout(cmd_mgr->cmd_wait, !atomic_read(&cmd_mgr->cmd_inuse),
+                                msecs_to_jiffies(RWNX_80211_CMD_TIMEOUT_MS))) {
+            AICWFDBG(LOGERROR, "%s %d cmds still in use\n", __func__,
+                     atomic_read(&cmd_mgr->cmd_inuse));
+            return;
+        }
         memset(cmd_mgr, 0, sizeof(*cmd_mgr));
     }
 }
@@ -571,6 +1008,13 @@ void aicwf_set_cmd_tx(void *dev, struct lmac_msg *msg, uint len)
         return;
     }
 	bus = usbdev->bus_if;
+#endif
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+#ifdef AICWF_SDIO_SUPPORT
+    mutex_lock(&sdiodev->cmd_mgr.push_mutex);
+#else
+    mutex_lock(&usbdev->cmd_mgr.push_mutex);
+#endif
 #endif
     buffer = bus->cmd_buf;
 
@@ -598,5 +1042,12 @@ void aicwf_set_cmd_tx(void *dev, struct lmac_msg *msg, uint len)
     if (ret == -EIO) {
         ret = aicwf_bus_txmsg(bus, buffer, len + 8);
     }
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+#ifdef AICWF_SDIO_SUPPORT
+    mutex_unlock(&sdiodev->cmd_mgr.push_mutex);
+#else
+    mutex_unlock(&usbdev->cmd_mgr.push_mutex);
+#endif
+#endif
 }
 
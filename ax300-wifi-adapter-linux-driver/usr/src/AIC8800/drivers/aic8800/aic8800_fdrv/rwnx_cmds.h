@@ -13,6 +13,8 @@
 
 #include <linux/spinlock.h>
 #include <linux/completion.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
 #include <linux/module.h>
 #include "lmac_msg.h"
 
@@ -30,12 +32,18 @@
 #define RWNX_CMD_FLAG_WAIT_ACK      BIT(3)
 #define RWNX_CMD_FLAG_WAIT_CFM      BIT(4)
 #define RWNX_CMD_FLAG_DONE          BIT(5)
+/* waiter gone before the cfm, the manager frees it */
+#define RWNX_CMD_FLAG_ORPHAN        BIT(6)
 /* ATM IPC design makes it possible to get the CFM before the ACK,
  * otherwise this could have simply been a state enum */
 #define RWNX_CMD_WAIT_COMPLETE(flags) \
     (!(flags & (RWNX_CMD_FLAG_WAIT_ACK | RWNX_CMD_FLAG_WAIT_CFM)))
 
 #define RWNX_CMD_MAX_QUEUED         16//8 AIDEN
+/* cmd slots per device, a cmd is held from rwnx_send_msg until its cfm */
+#define RWNX_CMD_ARRAY_SIZE         40
+/* consecutive cfm timeouts before the manager is considered crashed */
+#define RWNX_CMD_CRASH_TIMEOUTS     3
 
 #ifdef CONFIG_RWNX_FHOST
 #include "ipc_fhost.h"
@@ -58,6 +66,9 @@ struct rwnx_hw;
 struct rwnx_cmd;
 typedef int (*msg_cb_fct)(struct rwnx_hw *rwnx_hw, struct rwnx_cmd *cmd,
                           struct rwnx_cmd_e2amsg *msg);
+/* called from the cmd workqueue or the rx path, without cmd_mgr lock */
+typedef void (*rwnx_cmd_done_fct)(struct rwnx_hw *rwnx_hw, int result,
+                                  void *cfm, void *arg);
 static inline void put_u16(u8 *buf, u16 data)
 {
     buf[0] = (u8)(data&0x00ff);
@@ -81,8 +92,13 @@ struct rwnx_cmd {
 
     struct completion complete;
     u32 result;
-	u8 used;
 	int array_id;
+	struct rwnx_cmd_mgr *cmd_mgr;
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+    unsigned long deadline;
+    rwnx_cmd_done_fct done;
+    void *done_arg;
+#endif
     #ifdef CONFIG_RWNX_FHOST
     struct rwnx_term_stream *stream;
     #endif
@@ -105,6 +121,21 @@ struct rwnx_cmd_mgr {
 
     struct work_struct cmdWork;
     struct workqueue_struct *cmd_wq;
+
+    /* a set bit in cmd_used is a busy cmd_array slot */
+    struct rwnx_cmd cmd_array[RWNX_CMD_ARRAY_SIZE];
+    DECLARE_BITMAP(cmd_used, RWNX_CMD_ARRAY_SIZE);
+    wait_queue_head_t cmd_wait;
+    atomic_t cmd_inuse;
+    u32 cmd_peak;
+    u32 cmd_waits;
+    u32 cmd_busy;
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+    struct delayed_work tmoWork;
+    /* bus cmd_buf is shared by all pushes */
+    struct mutex push_mutex;
+    u32 timeouts;
+#endif
 };
 
 #define WAKE_CMD_WORK(cmd_mgr) \
@@ -114,6 +145,8 @@ struct rwnx_cmd_mgr {
 
 void rwnx_cmd_mgr_init(struct rwnx_cmd_mgr *cmd_mgr);
 void rwnx_cmd_mgr_deinit(struct rwnx_cmd_mgr *cmd_mgr);
+struct rwnx_cmd *rwnx_cmd_malloc(struct rwnx_cmd_mgr *cmd_mgr, gfp_t flags);
+void rwnx_cmd_free(struct rwnx_cmd *cmd);
 int cmd_mgr_queue_force_defer(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd);
 void aicwf_set_cmd_tx(void *dev, struct lmac_msg *msg, uint len);
 
@@ -408,6 +408,18 @@ enum {
 #define NET_NAME_UNKNOWN 0
 #endif
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 2, 0)
+#define rwnx_xmit_more(skb) netdev_xmit_more()
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3, 18, 0)
+#define rwnx_xmit_more(skb) ((skb)->xmit_more)
+#else
+#define rwnx_xmit_more(skb) false
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 4, 0)
+#define gfpflags_allow_blocking(flags) (!!((flags) & __GFP_WAIT))
+#endif
+
 /* TRACE */
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 2, 0)
 #define trace_print_symbols_seq ftrace_print_symbols_seq
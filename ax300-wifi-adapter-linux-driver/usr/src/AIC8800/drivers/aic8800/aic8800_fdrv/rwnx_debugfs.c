@@ -34,7 +34,7 @@ static ssize_t rwnx_dbgfs_stats_read(struct file *file,
     int i, skipped;
     ssize_t read;
     int bufsz = (NX_TXQ_CNT) * 20 + (ARRAY_SIZE(priv->stats.amsdus_rx) + 1) * 40
-        + (ARRAY_SIZE(priv->stats.ampdus_tx) * 30);
+        + (ARRAY_SIZE(priv->stats.ampdus_tx) * 30) + 448;
 
     if (*ppos)
         return 0;
@@ -133,6 +133,51 @@ static ssize_t rwnx_dbgfs_stats_read(struct file *file,
     ret += scnprintf(&buf[ret], bufsz - ret,
                      "#mpdu missed        %9d\n",
                      priv->stats.ampdus_rx_miss);
+#ifdef CONFIG_RWNX_SW_TXHDR_POOL
+    {
+        u32 hit = 0, miss = 0;
+        int cpu;
+
+        for_each_possible_cpu(cpu) {
+            hit += per_cpu_ptr(priv->sw_txhdr_pool, cpu)->hit;
+            miss += per_cpu_ptr(priv->sw_txhdr_pool, cpu)->miss;
+        }
+        ret += scnprintf(&buf[ret], bufsz - ret,
+                         "sw_txhdr pool hit   %9u\n"
+                         "sw_txhdr pool miss  %9u\n", hit, miss);
+    }
+#endif
+#ifdef CONFIG_RWNX_XMIT_MORE
+    ret += scnprintf(&buf[ret], bufsz - ret,
+                     "xmit batches        %9u\n"
+                     "xmit batched frames %9u\n",
+                     priv->xmit_batch.flushes, priv->xmit_batch.frames);
+#endif
+#ifdef CONFIG_RWNX_TXQ_CODEL
+    ret += scnprintf(&buf[ret], bufsz - ret,
+                     "txq codel drops     %9d\n"
+                     "txq codel marks     %9d\n",
+                     priv->stats.codel_drops, priv->stats.codel_marks);
+#endif
+    ret += scnprintf(&buf[ret], bufsz - ret,
+                     "cmds in use/peak    %4d/%4u\n"
+                     "cmd waits/busy      %4u/%4u\n",
+                     atomic_read(&priv->cmd_mgr->cmd_inuse), priv->cmd_mgr->cmd_peak,
+                     priv->cmd_mgr->cmd_waits, priv->cmd_mgr->cmd_busy);
+#ifdef CONFIG_FILTER_TCP_ACK
+    spin_lock_bh(&priv->ack_m.lock);
+    ret += scnprintf(&buf[ret], bufsz - ret,
+                     "tcp ack flows       %9d\n"
+                     "tcp ack held        %9u\n"
+                     "tcp ack dropped     %9u\n"
+                     "tcp ack sent        %9u\n"
+                     "tcp ack timeout     %9u\n"
+                     "tcp ack no flow     %9u\n",
+                     priv->ack_m.nr_flows, priv->ack_m.stats.held,
+                     priv->ack_m.stats.dropped, priv->ack_m.stats.sent,
+                     priv->ack_m.stats.timeout, priv->ack_m.stats.no_flow);
+    spin_unlock_bh(&priv->ack_m.lock);
+#endif
     read = simple_read_from_buffer(user_buf, count, ppos, buf, ret);
 
     kfree(buf);
@@ -1817,6 +1862,272 @@ static ssize_t rwnx_dbgfs_dbg_level_write(struct file *file,
 
 DEBUGFS_READ_WRITE_FILE_OPS(dbg_level);
 
+#ifdef AICWF_USB_SUPPORT
+static ssize_t rwnx_dbgfs_txrx_thread_read(struct file *file,
+			char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	struct rwnx_hw *priv = file->private_data;
+	struct aic_usb_dev *usbdev = priv->usbdev;
+	struct aicwf_thread_stat *stat[2] = {&usbdev->tx_thread_stat, &usbdev->rx_thread_stat};
+	int irq_cpu[2] = {usbdev->tx_irq_cpu, usbdev->rx_irq_cpu};
+	static const char *const name[2] = {"bustx", "busrx"};
+	char buf[512];
+	int len = 0;
+	int i;
+
+	len += scnprintf(buf, sizeof(buf),
+			"policy=%d (0:legacy 1:unbound 2:split 3:follow_irq) tx_cpu=%d rx_cpu=%d\n",
+			txrx_thread_cpu_policy, bustx_thread_cpu, busrx_thread_cpu);
+	for (i = 0; i < 2; i++) {
+		len += scnprintf(&buf[len], sizeof(buf) - len,
+				"%s: bound=%d cpu=%d irq_cpu=%d wakeups=%llu busy_us=%llu migrations=%llu\n",
+				name[i], stat[i]->bound_cpu, stat[i]->cpu, irq_cpu[i],
+				stat[i]->wakeups, div_u64(stat[i]->busy_ns, 1000),
+				stat[i]->migrations);
+	}
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+/* "<policy> [tx_cpu rx_cpu]", also clears the utilization counters */
+static ssize_t rwnx_dbgfs_txrx_thread_write(struct file *file,
+			const char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	struct rwnx_hw *priv = file->private_data;
+	struct aic_usb_dev *usbdev = priv->usbdev;
+	char buf[32];
+	int policy, tx_cpu, rx_cpu, num;
+	size_t len = min_t(size_t, count, sizeof(buf) - 1);
+
+	if (copy_from_user(buf, user_buf, len))
+		return -EFAULT;
+
+	buf[len] = '\0';
+
+	num = sscanf(buf, "%d %d %d", &policy, &tx_cpu, &rx_cpu);
+	if (num < 1 || policy < 0 || policy >= AICWF_THREAD_CPU_MAX)
+		return -EINVAL;
+
+	if (num == 3) {
+		bustx_thread_cpu = tx_cpu;
+		busrx_thread_cpu = rx_cpu;
+	}
+	WRITE_ONCE(txrx_thread_cpu_policy, policy);
+
+	usbdev->tx_thread_stat.wakeups = 0;
+	usbdev->tx_thread_stat.busy_ns = 0;
+	usbdev->tx_thread_stat.migrations = 0;
+	usbdev->rx_thread_stat.wakeups = 0;
+	usbdev->rx_thread_stat.busy_ns = 0;
+	usbdev->rx_thread_stat.migrations = 0;
+
+	/* threads pick up the new placement on their next wakeup */
+	return count;
+}
+
+DEBUGFS_READ_WRITE_FILE_OPS(txrx_thread);
+
+static ssize_t rwnx_dbgfs_rx_urb_read(struct file *file,
+			char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	struct rwnx_hw *priv = file->private_data;
+	struct aic_usb_dev *usbdev = priv->usbdev;
+	char buf[256];
+	int len;
+
+	len = scnprintf(buf, sizeof(buf),
+			"inflight=%d target=%d min=%d max=%d\n"
+			"inflight_hwm=%d target_hwm=%d grow=%u shrink=%u\n",
+			atomic_read(&usbdev->rx_urb_inflight), usbdev->rx_urb_target,
+			usbdev->rx_urbs_min, usbdev->rx_urbs_max,
+			usbdev->rx_urb_inflight_hwm, usbdev->rx_urb_target_hwm,
+			usbdev->rx_urb_grow, usbdev->rx_urb_shrink);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+DEBUGFS_READ_FILE_OPS(rx_urb);
+
+static ssize_t rwnx_dbgfs_tx_urb_read(struct file *file,
+			char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	struct rwnx_hw *priv = file->private_data;
+	struct aic_usb_dev *usbdev = priv->usbdev;
+	struct aicwf_usb_tx_stat *st = &usbdev->tx_stat;
+	u32 post = atomic_read(&st->post);
+	u32 locks = atomic_read(&st->free_get) + atomic_read(&st->flow_lock);
+	char buf[384];
+	int len;
+
+	len = scnprintf(buf, sizeof(buf),
+			"free=%d post=%d\n"
+			"free: get=%u put=%u empty=%u\n"
+			"post: queued=%u splices=%u submitted=%u err=%u batch_max=%u\n"
+			"locks: free=%u flow=%u per 100 pkts=%u\n",
+			atomic_read(&usbdev->tx_free_count), atomic_read(&usbdev->tx_post_count),
+			atomic_read(&st->free_get), atomic_read(&st->free_put),
+			atomic_read(&st->free_empty),
+			post, st->splice, st->submit, st->submit_err, st->batch_max,
+			atomic_read(&st->free_get), atomic_read(&st->flow_lock),
+			post ? (u32)div_u64((u64)locks * 100, post) : 0);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+/* any write clears the counters */
+static ssize_t rwnx_dbgfs_tx_urb_write(struct file *file,
+			const char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	struct rwnx_hw *priv = file->private_data;
+	struct aicwf_usb_tx_stat *st = &priv->usbdev->tx_stat;
+
+	atomic_set(&st->free_get, 0);
+	atomic_set(&st->free_put, 0);
+	atomic_set(&st->free_empty, 0);
+	atomic_set(&st->post, 0);
+	atomic_set(&st->flow_lock, 0);
+	st->splice = 0;
+	st->submit = 0;
+	st->submit_err = 0;
+	st->batch_max = 0;
+
+	return count;
+}
+
+DEBUGFS_READ_WRITE_FILE_OPS(tx_urb);
+
+#ifdef CONFIG_USB_TX_AGGR
+static ssize_t rwnx_dbgfs_tx_aggr_read(struct file *file,
+			char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	struct rwnx_hw *priv = file->private_data;
+	struct aicwf_tx_priv *tx_priv = priv->usbdev->tx_priv;
+	char buf[384];
+	int len;
+
+	len = scnprintf(buf, sizeof(buf),
+			"batches=%u pkts=%llu bytes=%llu max_num=%d timeout_us=%d\n"
+			"per batch: 1=%u 2=%u 3-4=%u 5-8=%u 9-16=%u 17+=%u\n"
+			"closed by: full=%u timeout=%u idle=%u ac=%u\n",
+			tx_priv->aggr_batches, tx_priv->aggr_pkts, tx_priv->aggr_bytes,
+			aicwf_usb_tx_aggr_num, aicwf_usb_tx_aggr_us,
+			tx_priv->aggr_hist[0], tx_priv->aggr_hist[1], tx_priv->aggr_hist[2],
+			tx_priv->aggr_hist[3], tx_priv->aggr_hist[4], tx_priv->aggr_hist[5],
+			tx_priv->aggr_flush[0], tx_priv->aggr_flush[1],
+			tx_priv->aggr_flush[2], tx_priv->aggr_flush[3]);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+/* any write clears the counters */
+static ssize_t rwnx_dbgfs_tx_aggr_write(struct file *file,
+			const char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	struct rwnx_hw *priv = file->private_data;
+	struct aicwf_tx_priv *tx_priv = priv->usbdev->tx_priv;
+
+	tx_priv->aggr_batches = 0;
+	tx_priv->aggr_pkts = 0;
+	tx_priv->aggr_bytes = 0;
+	memset(tx_priv->aggr_hist, 0, sizeof(tx_priv->aggr_hist));
+	memset(tx_priv->aggr_flush, 0, sizeof(tx_priv->aggr_flush));
+
+	return count;
+}
+
+DEBUGFS_READ_WRITE_FILE_OPS(tx_aggr);
+#endif
+
+#if defined(CONFIG_USB_RX_RING) && defined(CONFIG_USB_RX_RING_BENCH)
+/* any write runs the rx ring bench, the result goes to the kernel log */
+static ssize_t rwnx_dbgfs_rx_ring_bench_write(struct file *file,
+			const char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	aicwf_rx_ring_bench();
+
+	return count;
+}
+
+DEBUGFS_WRITE_FILE_OPS(rx_ring_bench);
+#endif
+#endif
+
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+static ssize_t rwnx_dbgfs_airtime_read(struct file *file,
+                                       char __user *user_buf,
+                                       size_t count, loff_t *ppos)
+{
+    struct rwnx_hw *priv = file->private_data;
+    struct rwnx_sta *sta;
+    char *buf;
+    int i, ac, len;
+    ssize_t read;
+    int bufsz = 128 + NX_REMOTE_STA_MAX * (48 + NX_TXQ_CNT * 40);
+
+    if (*ppos)
+        return 0;
+
+    buf = kmalloc(bufsz, GFP_KERNEL);
+    if (buf == NULL)
+        return 0;
+
+    len = scnprintf(buf, bufsz, "quantum=%dus\n"
+                    "sta mac               rate(Mbps) | per AC: deficit(us) tx(us) pkts\n",
+                    READ_ONCE(airtime_quantum));
+
+    spin_lock_bh(&priv->tx_lock);
+    for (i = 0; i < NX_REMOTE_STA_MAX; i++) {
+        sta = &priv->sta_table[i];
+        if (!sta->valid)
+            continue;
+        len += scnprintf(&buf[len], bufsz - len, "%3d %pM %4u.%u |",
+                         i, sta->mac_addr, sta->airtime.rate / 10,
+                         sta->airtime.rate % 10);
+        for (ac = 0; ac < NX_TXQ_CNT; ac++)
+            len += scnprintf(&buf[len], bufsz - len, " %d %llu %u,",
+                             sta->airtime.deficit[ac], sta->airtime.tx_us[ac],
+                             sta->airtime.tx_pkts[ac]);
+        len += scnprintf(&buf[len], bufsz - len, "\n");
+    }
+    spin_unlock_bh(&priv->tx_lock);
+
+    read = simple_read_from_buffer(user_buf, count, ppos, buf, len);
+
+    kfree(buf);
+    return read;
+}
+
+/* any write clears the tx counters, deficits are left to the scheduler */
+static ssize_t rwnx_dbgfs_airtime_write(struct file *file,
+                                        const char __user *user_buf,
+                                        size_t count, loff_t *ppos)
+{
+    struct rwnx_hw *priv = file->private_data;
+    struct rwnx_sta *sta;
+    int i;
+
+    spin_lock_bh(&priv->tx_lock);
+    for (i = 0; i < NX_REMOTE_STA_MAX; i++) {
+        sta = &priv->sta_table[i];
+        memset(sta->airtime.tx_us, 0, sizeof(sta->airtime.tx_us));
+        memset(sta->airtime.tx_pkts, 0, sizeof(sta->airtime.tx_pkts));
+    }
+    spin_unlock_bh(&priv->tx_lock);
+
+    return count;
+}
+
+DEBUGFS_READ_WRITE_FILE_OPS(airtime);
+#endif
+
 
 #ifdef CONFIG_RWNX_FULLMAC
 
@@ -2657,6 +2968,20 @@ int rwnx_dbgfs_register(struct rwnx_hw *rwnx_hw, const char *name)
 	DEBUGFS_ADD_FILE(agg_disable, dir_drv,S_IWUSR);
 	DEBUGFS_ADD_FILE(set_roc, dir_drv,S_IWUSR);
 	DEBUGFS_ADD_FILE(dbg_level, dir_drv, S_IWUSR | S_IRUSR);
+#ifdef AICWF_USB_SUPPORT
+	DEBUGFS_ADD_FILE(txrx_thread, dir_drv, S_IWUSR | S_IRUSR);
+	DEBUGFS_ADD_FILE(rx_urb, dir_drv, S_IRUSR);
+	DEBUGFS_ADD_FILE(tx_urb, dir_drv, S_IWUSR | S_IRUSR);
+#ifdef CONFIG_USB_TX_AGGR
+	DEBUGFS_ADD_FILE(tx_aggr, dir_drv, S_IWUSR | S_IRUSR);
+#endif
+#if defined(CONFIG_USB_RX_RING) && defined(CONFIG_USB_RX_RING_BENCH)
+	DEBUGFS_ADD_FILE(rx_ring_bench, dir_drv, S_IWUSR);
+#endif
+#endif
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+	DEBUGFS_ADD_FILE(airtime, dir_drv, S_IWUSR | S_IRUSR);
+#endif
 
 #ifdef CONFIG_RWNX_P2P_DEBUGFS
     {
@@ -19,6 +19,8 @@
 #include <linux/skbuff.h>
 #include <net/cfg80211.h>
 #include <linux/slab.h>
+#include <linux/hashtable.h>
+#include <linux/etherdevice.h>
 
 #include "rwnx_mod_params.h"
 #include "rwnx_debugfs.h"
@@ -63,6 +65,9 @@
 #define PS_SP_INTERRUPTED  255
 #define MAC_ADDR_LEN 6
 
+/* rwnx_vif.ap.sta_hash buckets, NX_REMOTE_STA_MAX STAs at most */
+#define RWNX_STA_HASH_BITS 4
+
 //because android kernel 5.15 uses kernel 6.0 or 6.1 kernel api
 #ifdef ANDROID_PLATFORM
 #define HIGH_KERNEL_VERSION KERNEL_VERSION(5, 15, 41)
@@ -440,6 +445,7 @@ struct rwnx_vif {
         {
             u16 flags;                 /* see rwnx_ap_flags */
             struct list_head sta_list; /* List of STA connected to the AP */
+            DECLARE_HASHTABLE(sta_hash, RWNX_STA_HASH_BITS); /* sta_list by MAC, RCU */
             struct rwnx_bcn bcn;       /* beacon */
             u8 bcmc_index;             /* Index of the BCMC sta to use */
             #if (defined CONFIG_HE_FOR_OLD_KERNEL) || (defined CONFIG_VHT_FOR_OLD_KERNEL)
@@ -567,11 +573,31 @@ struct aic_sta {
 };
 #endif
 
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+/**
+ * struct rwnx_sta_airtime - Airtime accounting of a STA, per hwq
+ *
+ * @rate: PHY rate estimated from the last rx vector, in 100kbps (0 = unknown)
+ * @deficit: DRR deficit in us, the STA is served while it is positive
+ * @round: hwq->airtime_round of the last refill
+ * @tx_us: estimated airtime charged so far
+ * @tx_pkts: frames charged so far
+ */
+struct rwnx_sta_airtime {
+    u32 rate;
+    s32 deficit[NX_TXQ_CNT];
+    u32 round[NX_TXQ_CNT];
+    u64 tx_us[NX_TXQ_CNT];
+    u32 tx_pkts[NX_TXQ_CNT];
+};
+#endif
+
 /*
  * Structure used to save information relative to the managed stations.
  */
 struct rwnx_sta {
     struct list_head list;
+    struct hlist_node hash_node; /* For rwnx_vif.ap.sta_hash */
     u16 aid;                /* association ID */
     u8 sta_idx;             /* Identifier of the station */
     u8 vif_idx;             /* Identifier of the VIF (fw id) the station
@@ -610,6 +636,9 @@ struct rwnx_sta {
     u32 ac_param[AC_MAX];  /* EDCA parameters */
     struct rwnx_tdls tdls; /* TDLS station information */
     struct rwnx_sta_stats stats;
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+    struct rwnx_sta_airtime airtime;
+#endif
     enum nl80211_mesh_power_mode mesh_pm; /*  link-specific mesh power save mode */
 #ifdef CONFIG_DYNAMIC_PERPWR
 	s8_l rssi_save;
@@ -635,6 +664,50 @@ struct rwnx_amsdu_stats {
 };
 #endif
 
+#ifdef CONFIG_RWNX_SW_TXHDR_POOL
+/* sw_txhdr per CPU, enough for the tx urbs plus a txq of backlog */
+#define RWNX_SW_TXHDR_POOL_SIZE (2 * RWNX_NDEV_FLOW_CTRL_STOP)
+
+/**
+ * struct rwnx_sw_txhdr_pool - Per CPU recycled sw_txhdr
+ *
+ * @free: Free descriptors. Only the owner CPU takes from it (irqs off),
+ * any context gives back with llist_add.
+ * @descs: Descriptors owned by this CPU
+ * @hit: Allocations served from @free
+ * @miss: Allocations that fell back to sw_txhdr_cache
+ */
+struct rwnx_sw_txhdr_pool {
+    struct llist_head free;
+    struct rwnx_sw_txhdr *descs;
+    u32 hit;
+    u32 miss;
+};
+#endif
+
+#ifdef CONFIG_RWNX_XMIT_MORE
+/* hwq pushes deferred while the stack says more are coming */
+#define RWNX_XMIT_BATCH_MAX 32
+
+/**
+ * struct rwnx_xmit_batch - Burst of rwnx_start_xmit
+ *
+ * Frames always go to their txq right away, only the hwq push is deferred
+ * while the stack says more are coming. All fields are protected by tx_lock.
+ *
+ * @hwqs: Bitmap of hwqs with frames queued but not processed yet
+ * @held: Frames queued since the last flush
+ * @flushes: Number of times @hwqs was processed
+ * @frames: Frames pushed by those flushes
+ */
+struct rwnx_xmit_batch {
+    unsigned long hwqs;
+    u32 held;
+    u32 flushes;
+    u32 frames;
+};
+#endif
+
 struct rwnx_stats {
     int cfm_balance[NX_TXQ_CNT];
     unsigned long last_rx, last_tx; /* jiffies */
@@ -646,6 +719,10 @@ struct rwnx_stats {
     struct rwnx_amsdu_stats amsdus[NX_TX_PAYLOAD_MAX];
 #endif
     int amsdus_rx[64];
+#ifdef CONFIG_RWNX_TXQ_CODEL
+    int codel_drops;
+    int codel_marks;
+#endif
 };
 
 struct rwnx_sec_phy_chan {
@@ -782,11 +859,19 @@ struct rwnx_hw {
     u32 roc_cookie_cnt;                         /* Counter used to identify RoC request sent by cfg80211 */
 
     struct rwnx_cmd_mgr *cmd_mgr;
+#ifdef CONFIG_RWNX_MSG_BATCH
+    struct rwnx_msg_batch *msg_batch;           /* open batch, see rwnx_msg_batch_begin() */
+    struct task_struct *msg_batch_owner;        /* only this task may use msg_batch */
+    ktime_t init_start;                         /* rwnx_cfg80211_init() entry, for the init timeline */
+#endif
 
     struct rwnx_plat *plat;
 
     spinlock_t tx_lock;
     spinlock_t cb_lock;
+#ifdef CONFIG_TX_BQL
+    spinlock_t bql_lock;        /* serializes netdev_tx_completed_queue() */
+#endif
     struct mutex mutex;                         /* per-device perimeter lock */
 
     struct tasklet_struct task;
@@ -814,6 +899,12 @@ struct rwnx_hw {
     struct rwnx_ipc_elem_var scan_ie;
 
     struct kmem_cache      *sw_txhdr_cache;
+#ifdef CONFIG_RWNX_SW_TXHDR_POOL
+    struct rwnx_sw_txhdr_pool __percpu *sw_txhdr_pool;
+#endif
+#ifdef CONFIG_RWNX_XMIT_MORE
+    struct rwnx_xmit_batch xmit_batch;
+#endif
 
     struct rwnx_debugfs     debugfs;
     struct rwnx_stats       stats;
@@ -920,6 +1011,61 @@ static inline bool is_multicast_sta(int sta_idx)
 
 }
 struct rwnx_sta *rwnx_get_sta(struct rwnx_hw *rwnx_hw, const u8 *mac_addr);
+void rwnx_vif_sta_hash_add(struct rwnx_vif *vif, struct rwnx_sta *sta);
+#ifdef CONFIG_RWNX_SW_TXHDR_POOL
+int rwnx_sw_txhdr_pool_init(struct rwnx_hw *rwnx_hw);
+void rwnx_sw_txhdr_pool_deinit(struct rwnx_hw *rwnx_hw);
+struct rwnx_sw_txhdr *rwnx_sw_txhdr_alloc(struct rwnx_hw *rwnx_hw);
+void rwnx_sw_txhdr_free(struct rwnx_hw *rwnx_hw, struct rwnx_sw_txhdr *sw_txhdr);
+#else
+static inline int rwnx_sw_txhdr_pool_init(struct rwnx_hw *rwnx_hw)
+{
+    return 0;
+}
+
+static inline void rwnx_sw_txhdr_pool_deinit(struct rwnx_hw *rwnx_hw) {}
+
+static inline struct rwnx_sw_txhdr *rwnx_sw_txhdr_alloc(struct rwnx_hw *rwnx_hw)
+{
+    return kmem_cache_alloc(rwnx_hw->sw_txhdr_cache, GFP_ATOMIC);
+}
+
+static inline void rwnx_sw_txhdr_free(struct rwnx_hw *rwnx_hw,
+                                      struct rwnx_sw_txhdr *sw_txhdr)
+{
+    kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
+}
+#endif
+#ifdef CONFIG_RWNX_XMIT_MORE
+void rwnx_xmit_batch_flush(struct rwnx_hw *rwnx_hw);
+#else
+static inline void rwnx_xmit_batch_flush(struct rwnx_hw *rwnx_hw) {}
+#endif
+void rwnx_vif_sta_hash_del(struct rwnx_sta *sta);
+
+static inline u32 rwnx_sta_hash_key(const u8 *mac_addr)
+{
+    return (mac_addr[2] << 24) | (mac_addr[3] << 16) | (mac_addr[4] << 8) | mac_addr[5];
+}
+
+/**
+ * rwnx_vif_sta_lookup - Find a STA connected to an AP/GO/mesh vif by MAC
+ *
+ * To be called under rcu_read_lock. STAs are never freed (they
+ * live in sta_table), so a STA removed under a reader is just not returned.
+ */
+static inline struct rwnx_sta *rwnx_vif_sta_lookup(struct rwnx_vif *vif,
+                                                   const u8 *mac_addr)
+{
+    struct rwnx_sta *sta;
+
+    hash_for_each_possible_rcu(vif->ap.sta_hash, sta, hash_node,
+                               rwnx_sta_hash_key(mac_addr)) {
+        if (sta->valid && ether_addr_equal(sta->mac_addr, mac_addr))
+            return sta;
+    }
+    return NULL;
+}
 
 static inline uint8_t master_vif_idx(struct rwnx_vif *vif)
 {
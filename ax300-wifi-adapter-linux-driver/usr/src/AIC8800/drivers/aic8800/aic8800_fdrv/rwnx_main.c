@@ -573,9 +573,6 @@ void rwnx_skb_align_8bytes(struct sk_buff *skb){
 #endif
 }
 
-int rwnx_init_cmd_array(void);
-void rwnx_free_cmd_array(void);
-
 void rwnx_data_dump(char* tag, void* data, unsigned long len){
 	unsigned long i = 0;
 	char* data_ = (char* )data;
@@ -772,6 +769,18 @@ struct rwnx_sta *rwnx_get_sta(struct rwnx_hw *rwnx_hw, const u8 *mac_addr)
     return NULL;
 }
 
+/* with ap.sta_list updates, under cb_lock */
+void rwnx_vif_sta_hash_add(struct rwnx_vif *vif, struct rwnx_sta *sta)
+{
+    hash_add_rcu(vif->ap.sta_hash, &sta->hash_node,
+                 rwnx_sta_hash_key(sta->mac_addr));
+}
+
+void rwnx_vif_sta_hash_del(struct rwnx_sta *sta)
+{
+    hash_del_rcu(&sta->hash_node);
+}
+
 void rwnx_enable_wapi(struct rwnx_hw *rwnx_hw)
 {
     //cipher_suites[rwnx_hw->wiphy->n_cipher_suites] = WLAN_CIPHER_SUITE_SMS4;
@@ -1930,10 +1939,12 @@ static struct rwnx_vif *rwnx_interface_add(struct rwnx_hw *rwnx_hw,
         // no break
     case NL80211_IFTYPE_AP:
         INIT_LIST_HEAD(&vif->ap.sta_list);
+        hash_init(vif->ap.sta_hash);
         memset(&vif->ap.bcn, 0, sizeof(vif->ap.bcn));
         break;
     case NL80211_IFTYPE_P2P_GO:
         INIT_LIST_HEAD(&vif->ap.sta_list);
+        hash_init(vif->ap.sta_hash);
         memset(&vif->ap.bcn, 0, sizeof(vif->ap.bcn));
         vif->is_p2p_vif = 1;
         break;
@@ -2356,21 +2367,13 @@ struct rwnx_sta *rwnx_retrieve_sta(struct rwnx_hw *rwnx_hw,
                 /* Returned STA pointer */
                 struct rwnx_sta *rwnx_sta;
 
-                /* Go through list of STAs linked with the provided VIF */
-				spin_lock_bh(&rwnx_vif->rwnx_hw->cb_lock);
-                list_for_each_entry(rwnx_sta, &rwnx_vif->ap.sta_list, list) {
-					AICWFDBG(LOGDEBUG, "%s mac_addr:%x %x %x %x %x %x addr:%x %x %x %x %x %x \r\n", __func__,
-						rwnx_sta->mac_addr[0],rwnx_sta->mac_addr[1],rwnx_sta->mac_addr[2],
-						rwnx_sta->mac_addr[3],rwnx_sta->mac_addr[4],rwnx_sta->mac_addr[5],
-						addr[0],addr[1],addr[2],addr[3],addr[4],addr[5]);
-                    if (rwnx_sta->valid &&
-                        ether_addr_equal(rwnx_sta->mac_addr, addr)) {
-                        /* Return the found STA */
-						spin_unlock_bh(&rwnx_vif->rwnx_hw->cb_lock);
-                        return rwnx_sta;
-                    }
-                }
-				spin_unlock_bh(&rwnx_vif->rwnx_hw->cb_lock);
+                /* Look up the STAs linked with the provided VIF */
+                rcu_read_lock();
+                rwnx_sta = rwnx_vif_sta_lookup(rwnx_vif, addr);
+                rcu_read_unlock();
+                if (rwnx_sta)
+                    return rwnx_sta;
+                AICWFDBG(LOGDEBUG, "%s no sta for %pM\n", __func__, addr);
             }
         }
     } else {
@@ -2530,6 +2533,7 @@ static int rwnx_cfg80211_change_iface(struct wiphy *wiphy,
     case NL80211_IFTYPE_AP:
     case NL80211_IFTYPE_P2P_GO:
         INIT_LIST_HEAD(&vif->ap.sta_list);
+        hash_init(vif->ap.sta_hash);
         memset(&vif->ap.bcn, 0, sizeof(vif->ap.bcn));
         break;
     case NL80211_IFTYPE_AP_VLAN:
@@ -3351,6 +3355,7 @@ static int rwnx_cfg80211_add_station(struct wiphy *wiphy,
             spin_lock_bh(&rwnx_hw->cb_lock);
             rwnx_txq_sta_init(rwnx_hw, sta, rwnx_txq_vif_get_status(rwnx_vif));
             list_add_tail(&sta->list, &rwnx_vif->ap.sta_list);
+            rwnx_vif_sta_hash_add(rwnx_vif, sta);
             sta->valid = true;
             rwnx_ps_bh_enable(rwnx_hw, sta, sta->ps.active || me_sta_add_cfm.pm_state);
             spin_unlock_bh(&rwnx_hw->cb_lock);
@@ -3465,6 +3470,7 @@ static int rwnx_cfg80211_del_station_compat(struct wiphy *wiphy,
             		cur->ps.active = false;
             		cur->valid = false;
             		list_del(&cur->list);
+            		rwnx_vif_sta_hash_del(cur);
         	}
 		spin_unlock_bh(&rwnx_hw->cb_lock);
 
@@ -3595,6 +3601,7 @@ void apm_staloss_work_process(struct work_struct *work)
 		cur->ps.active = false;
         	cur->valid = false;
 	        list_del(&cur->list);
+	        rwnx_vif_sta_hash_del(cur);
 	}
 	spin_unlock_bh(&rwnx_hw->cb_lock);
 
@@ -8415,6 +8422,15 @@ static int start_from_bootrom(struct rwnx_hw *rwnx_hw)
 }
 
 
+#ifdef CONFIG_RWNX_MSG_BATCH
+/* init timeline, relative to rwnx_cfg80211_init() entry */
+#define RWNX_INIT_TRACE(rwnx_hw, step) \
+    AICWFDBG(LOGINFO, "init +%lld us: %s\n", \
+             ktime_us_delta(ktime_get(), (rwnx_hw)->init_start), step)
+#else
+#define RWNX_INIT_TRACE(rwnx_hw, step) do {} while (0)
+#endif
+
 int rwnx_ic_system_init(struct rwnx_hw *rwnx_hw){
 
 	if(rwnx_hw->usbdev->chipid == PRODUCT_ID_AIC8801){
@@ -8456,6 +8472,7 @@ int rwnx_ic_system_init(struct rwnx_hw *rwnx_hw){
 
 int rwnx_ic_rf_init(struct rwnx_hw *rwnx_hw){
 	struct mm_set_rf_calib_cfm cfm;
+	struct rwnx_msg_batch batch;
 	int ret = 0;
 #ifdef CONFIG_5M10M
 	uint32_t hwconfig_id = 4;
@@ -8463,13 +8480,12 @@ int rwnx_ic_rf_init(struct rwnx_hw *rwnx_hw){
 	param[0] = BWMODE10M;
 #endif
 	if(rwnx_hw->usbdev->chipid == PRODUCT_ID_AIC8801){
-		if ((ret = rwnx_send_txpwr_idx_req(rwnx_hw))) {
-			return -1;
-		}
-
-		if ((ret = rwnx_send_txpwr_ofst_req(rwnx_hw))) {
+		rwnx_msg_batch_begin(rwnx_hw, &batch);
+		ret = rwnx_send_txpwr_idx_req(rwnx_hw);
+		if (!ret)
+			ret = rwnx_send_txpwr_ofst_req(rwnx_hw);
+		if (rwnx_msg_batch_end(rwnx_hw, &batch) || ret)
 			return -1;
-		}
 
 		if (testmode == 0) {
 			if ((ret = rwnx_send_rf_calib_req(rwnx_hw, &cfm)))
@@ -8576,6 +8592,9 @@ if((g_rwnx_plat->usbdev->chipid == PRODUCT_ID_AIC8801) ||
 #endif
     rwnx_hw->mod_params = &rwnx_mod_params;
     rwnx_hw->tcp_pacing_shift = 7;
+#ifdef CONFIG_RWNX_MSG_BATCH
+    rwnx_hw->init_start = ktime_get();
+#endif
 
 #ifdef CONFIG_SCHED_SCAN
     rwnx_hw->is_sched_scan = false;
@@ -8594,6 +8613,12 @@ if((g_rwnx_plat->usbdev->chipid == PRODUCT_ID_AIC8801) ||
         ret = -ENOMEM;
         goto err_cache;
     }
+    if (rwnx_sw_txhdr_pool_init(rwnx_hw)) {
+        wiphy_err(wiphy, "Cannot allocate sw TX header pool\n");
+        kmem_cache_destroy(rwnx_hw->sw_txhdr_cache);
+        ret = -ENOMEM;
+        goto err_cache;
+    }
 
 
 #ifdef CONFIG_FILTER_TCP_ACK
@@ -8650,6 +8675,9 @@ if((g_rwnx_plat->usbdev->chipid == PRODUCT_ID_AIC8801) ||
     mutex_init(&rwnx_hw->dbgdump_elem.mutex);
     spin_lock_init(&rwnx_hw->tx_lock);
     spin_lock_init(&rwnx_hw->cb_lock);
+#ifdef CONFIG_TX_BQL
+    spin_lock_init(&rwnx_hw->bql_lock);
+#endif
 
 	INIT_WORK(&rwnx_hw->apmStalossWork, apm_staloss_work_process);
 	rwnx_hw->apmStaloss_wq = create_singlethread_workqueue("apmStaloss_wq");
@@ -8671,6 +8699,7 @@ if((g_rwnx_plat->usbdev->chipid == PRODUCT_ID_AIC8801) ||
 	if((ret = rwnx_ic_system_init(rwnx_hw))){
 		goto err_lmac_reqs;
 	}
+	RWNX_INIT_TRACE(rwnx_hw, "ic system init");
 
 #ifdef USE_5G
 	if(rwnx_hw->usbdev->chipid == PRODUCT_ID_AIC8800DC ||
@@ -8692,6 +8721,7 @@ if((g_rwnx_plat->usbdev->chipid == PRODUCT_ID_AIC8801) ||
     if (ret){
         goto err_lmac_reqs;
     }
+	RWNX_INIT_TRACE(rwnx_hw, "stack start");
 
 	AICWFDBG(LOGINFO, "is 5g support = %d, vendor_info = 0x%02X\n", set_start_cfm.is_5g_support, set_start_cfm.vendor_info);
 	rwnx_hw->band_5g_support = set_start_cfm.is_5g_support;
@@ -8796,6 +8826,7 @@ if((g_rwnx_plat->usbdev->chipid == PRODUCT_ID_AIC8801) ||
 	if((ret = rwnx_ic_rf_init(rwnx_hw))){
 		goto err_lmac_reqs;
 	}
+	RWNX_INIT_TRACE(rwnx_hw, "rf init");
 
     if ((ret = rwnx_send_get_macaddr_req(rwnx_hw, (struct mm_get_mac_addr_cfm *)mac_addr_efuse)))
         goto err_lmac_reqs;
@@ -8822,6 +8853,7 @@ if((g_rwnx_plat->usbdev->chipid == PRODUCT_ID_AIC8801) ||
     if ((ret = rwnx_send_version_req(rwnx_hw, &rwnx_hw->version_cfm)))
         goto err_lmac_reqs;
     rwnx_set_vers(rwnx_hw);
+    RWNX_INIT_TRACE(rwnx_hw, "fw reset");
 
     if ((ret = rwnx_handle_dynparams(rwnx_hw, rwnx_hw->wiphy)))
         goto err_lmac_reqs;
@@ -8856,6 +8888,7 @@ if((g_rwnx_plat->usbdev->chipid == PRODUCT_ID_AIC8801) ||
         wiphy_err(wiphy, "Could not register wiphy device\n");
         goto err_register_wiphy;
     }
+    RWNX_INIT_TRACE(rwnx_hw, "wiphy registered");
 
     if ((rwnx_hw->usbdev->vid == 0x2604 && rwnx_hw->usbdev->pid == 0x001f)
         || (rwnx_hw->usbdev->vid == 0x2604 && rwnx_hw->usbdev->pid == 0x0020)) {
@@ -8966,6 +8999,7 @@ if((g_rwnx_plat->usbdev->chipid == PRODUCT_ID_AIC8801) ||
 	rwnx_hw->iface_idx = CONFIG_IFACE_NUMBER - 1;
 	aicwf_nl_init();
 #endif
+    RWNX_INIT_TRACE(rwnx_hw, "done");
 
     return 0;
 
@@ -8984,6 +9018,7 @@ err_lmac_reqs:
     destroy_workqueue(rwnx_hw->apmStaloss_wq);
     //rwnx_fw_trace_dump(rwnx_hw);
     rwnx_platform_off(rwnx_hw, NULL);
+    rwnx_sw_txhdr_pool_deinit(rwnx_hw);
     kmem_cache_destroy(rwnx_hw->sw_txhdr_cache);
 //err_platon:
 //err_config:
@@ -9051,6 +9086,7 @@ void rwnx_cfg80211_deinit(struct rwnx_hw *rwnx_hw)
 	}
     rwnx_radar_detection_deinit(&rwnx_hw->radar);
     rwnx_platform_off(rwnx_hw, NULL);
+    rwnx_sw_txhdr_pool_deinit(rwnx_hw);
     kmem_cache_destroy(rwnx_hw->sw_txhdr_cache);
 #ifdef CONFIG_FILTER_TCP_ACK
     tcp_ack_deinit(rwnx_hw);
@@ -9093,7 +9129,6 @@ static int __init rwnx_mod_init(void)
     RWNX_DBG(RWNX_FN_ENTRY_STR);
     rwnx_print_version();
 	AICWFDBG(LOGINFO, "RELEASE DATE:%s \r\n", RELEASE_DATE);
-	rwnx_init_cmd_array();
 
 	sema_init(&aicwf_deinit_sem, 1);
 	atomic_set(&aicwf_deinit_atomic, 1);
@@ -9140,7 +9175,6 @@ static void __exit rwnx_mod_exit(void)
 #ifdef AICWF_USB_SUPPORT
     aicwf_usb_exit();
 #endif
-	rwnx_free_cmd_array();
 	AICWFDBG(LOGINFO, "%s exit\r\n", __func__);
 }
 module_param(wifi_mac_addr,charp, 0);
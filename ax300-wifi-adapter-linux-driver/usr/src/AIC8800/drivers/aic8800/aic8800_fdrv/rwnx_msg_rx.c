@@ -1379,6 +1379,7 @@ static inline int rwnx_rx_mesh_peer_update_ind(struct rwnx_hw *rwnx_hw,
                 /* Add the station in the list of VIF's stations */
                 INIT_LIST_HEAD(&rwnx_sta->list);
                 list_add_tail(&rwnx_sta->list, &rwnx_vif->ap.sta_list);
+                rwnx_vif_sta_hash_add(rwnx_vif, rwnx_sta);
 
                 /* Initialize the TX queues */
                 if (rwnx_sta->ch_idx == rwnx_hw->cur_chanctx) {
@@ -1409,6 +1410,7 @@ static inline int rwnx_rx_mesh_peer_update_ind(struct rwnx_hw *rwnx_hw,
 
                 /* Remove the station from the list of VIF's station */
                 list_del_init(&rwnx_sta->list);
+                rwnx_vif_sta_hash_del(rwnx_sta);
 
                 rwnx_txq_sta_deinit(rwnx_hw, rwnx_sta);
 #ifdef CONFIG_DEBUG_FS
@@ -1427,6 +1429,7 @@ static inline int rwnx_rx_mesh_peer_update_ind(struct rwnx_hw *rwnx_hw,
 
             /* Remove the station from the list of VIF's station */
             list_del_init(&rwnx_sta->list);
+            rwnx_vif_sta_hash_del(rwnx_sta);
 
             rwnx_txq_sta_deinit(rwnx_hw, rwnx_sta);
 #ifdef CONFIG_DEBUG_FS
@@ -71,18 +71,6 @@ const int chnl2bw[] = {
     [PHY_CHNL_BW_80P80]   = NL80211_CHAN_WIDTH_80P80,
 };
 
-#define RWNX_CMD_ARRAY_SIZE 40
-#define RWNX_CMD_HIGH_WATER_SIZE RWNX_CMD_ARRAY_SIZE/2
-//#define RWNX_MSG_ARRAY_SIZE 20
-
-struct rwnx_cmd cmd_array[RWNX_CMD_ARRAY_SIZE];
-//struct lmac_msg msg_array[RWNX_MSG_ARRAY_SIZE];
-
-static spinlock_t cmd_array_lock;
-//static spinlock_t msg_array_lock;
-
-//int msg_array_index = 0;
-int cmd_array_index = 0;
 
 
 
@@ -171,72 +159,6 @@ static inline void limit_chan_bw(u8_l *bw, u16_l primary, u16_l *center1)
     *center1 = primary + new_oft;
 }
 
-struct rwnx_cmd *rwnx_cmd_malloc(void){
-	struct rwnx_cmd *cmd = NULL;
-	unsigned long flags = 0;
-
-	spin_lock_irqsave(&cmd_array_lock, flags);
-
-	for(cmd_array_index = 0; cmd_array_index < RWNX_CMD_ARRAY_SIZE; cmd_array_index++){
-		if(cmd_array[cmd_array_index].used == 0){
-			AICWFDBG(LOGTRACE, "%s get cmd_array[%d]:%p \r\n", __func__, cmd_array_index,&cmd_array[cmd_array_index]);
-			cmd = &cmd_array[cmd_array_index];
-			cmd_array[cmd_array_index].used = 1;
-			break;
-		}
-	}
-
-	if(cmd_array_index >= RWNX_CMD_HIGH_WATER_SIZE){
-		AICWFDBG(LOGERROR, "%s cmd(%d) was pending...\r\n", __func__, cmd_array_index);
-		mdelay(100);
-	}
-
-	if(!cmd){
-		AICWFDBG(LOGERROR, "%s array is empty...\r\n", __func__);
-	}
-
-	spin_unlock_irqrestore(&cmd_array_lock, flags);
-
-	return cmd;
-}
-
-void rwnx_cmd_free(struct rwnx_cmd *cmd){
-	unsigned long flags = 0;
-
-	spin_lock_irqsave(&cmd_array_lock, flags);
-	cmd->used = 0;
-	AICWFDBG(LOGTRACE, "%s cmd_array[%d]:%p \r\n", __func__, cmd->array_id, cmd);
-	spin_unlock_irqrestore(&cmd_array_lock, flags);
-}
-
-
-int rwnx_init_cmd_array(void){
-
-	AICWFDBG(LOGTRACE, "%s Enter \r\n", __func__);
-	spin_lock_init(&cmd_array_lock);
-
-	for(cmd_array_index = 0; cmd_array_index < RWNX_CMD_ARRAY_SIZE; cmd_array_index++){
-		AICWFDBG(LOGTRACE, "%s cmd_queue[%d]:%p \r\n", __func__, cmd_array_index, &cmd_array[cmd_array_index]);
-		cmd_array[cmd_array_index].used = 0;
-		cmd_array[cmd_array_index].array_id = cmd_array_index;
-	}
-	AICWFDBG(LOGTRACE, "%s Exit \r\n", __func__);
-
-	return 0;
-}
-
-void rwnx_free_cmd_array(void){
-
-	AICWFDBG(LOGTRACE, "%s Enter \r\n", __func__);
-
-	for(cmd_array_index = 0; cmd_array_index < RWNX_CMD_ARRAY_SIZE; cmd_array_index++){
-		cmd_array[cmd_array_index].used = 0;
-	}
-
-	AICWFDBG(LOGTRACE, "%s Exit \r\n", __func__);
-}
-
-
 #if 0
 int rwnx_init_msg_array(void){
 
@@ -383,6 +305,11 @@ static void rwnx_msg_free(struct rwnx_hw *rwnx_hw, const void *msg_params)
 
 
 
+#ifdef CONFIG_RWNX_MSG_BATCH
+static int rwnx_msg_batch_add(struct rwnx_hw *rwnx_hw, const void *msg_params,
+                              lmac_msg_id_t reqid);
+#endif
+
 static int rwnx_send_msg(struct rwnx_hw *rwnx_hw, const void *msg_params,
                          int reqcfm, lmac_msg_id_t reqid, void *cfm)
 {
@@ -410,6 +337,12 @@ static int rwnx_send_msg(struct rwnx_hw *rwnx_hw, const void *msg_params,
     }
 #endif
 
+#ifdef CONFIG_RWNX_MSG_BATCH
+    /* only the owner dereferences msg_batch, it lives on the owner's stack */
+    if (reqcfm && !cfm && READ_ONCE(rwnx_hw->msg_batch_owner) == current)
+        return rwnx_msg_batch_add(rwnx_hw, msg_params, reqid);
+#endif
+
     msg = container_of((void *)msg_params, struct lmac_msg, param);
 
     #if 0
@@ -437,14 +370,20 @@ static int rwnx_send_msg(struct rwnx_hw *rwnx_hw, const void *msg_params,
 
     //nonblock = is_non_blocking_msg(msg->id);
     nonblock = 0;//AIDEN
-    cmd = rwnx_cmd_malloc();//kzalloc(sizeof(struct rwnx_cmd), nonblock ? GFP_ATOMIC : GFP_KERNEL);
+    /* reqcfm senders may still be atomic, e.g. traffic ind under tx_lock */
+    cmd = rwnx_cmd_malloc(rwnx_hw->cmd_mgr,
+                          (reqcfm && !in_softirq() && !in_atomic()) ? GFP_KERNEL : GFP_ATOMIC);//kzalloc(sizeof(struct rwnx_cmd), nonblock ? GFP_ATOMIC : GFP_KERNEL);
+    if (!cmd) {
+        rwnx_msg_free(rwnx_hw, msg_params);
+        return -EBUSY;
+    }
     cmd->result  = -EINTR;
     cmd->id      = msg->id;
     cmd->reqid   = reqid;
     cmd->a2e_msg = msg;
     cmd->e2a_msg = cfm;
-    if (nonblock)
-        cmd->flags = RWNX_CMD_FLAG_NONBLOCK;
+    /* array cmds keep the flags of their previous use */
+    cmd->flags = nonblock ? RWNX_CMD_FLAG_NONBLOCK : 0;
     if (reqcfm)
         cmd->flags |= RWNX_CMD_FLAG_REQ_CFM;
 #if 0
@@ -483,12 +422,134 @@ static int rwnx_send_msg(struct rwnx_hw *rwnx_hw, const void *msg_params,
 #endif
     }
 
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+    /* a queued cmd belongs to the cmd manager, even on error */
+    if (!reqcfm)
+#else
     if(!reqcfm || ret)
+#endif
         rwnx_cmd_free(cmd);//kfree(cmd);
 
     return ret;//0;
 }
 
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+/* Queue a request without waiting for its cfm. done is called once, with the
+ * cfm copied to cfm (which must stay valid until then), or with an error on
+ * timeout/teardown. It is not called if this returns an error. gfp tells
+ * whether the caller may sleep for a free cmd. */
+int rwnx_send_msg_async(struct rwnx_hw *rwnx_hw, const void *msg_params,
+                        lmac_msg_id_t reqid, void *cfm, gfp_t gfp,
+                        rwnx_cmd_done_fct done, void *arg)
+{
+    struct rwnx_cmd *cmd;
+
+#ifdef AICWF_USB_SUPPORT
+    if (rwnx_hw->usbdev->state == USB_DOWN_ST) {
+        rwnx_msg_free(rwnx_hw, msg_params);
+        AICWFDBG(LOGERROR, "%s bus is down\n", __func__);
+        return -EIO;
+    }
+#endif
+#ifdef AICWF_SDIO_SUPPORT
+    if (rwnx_hw->sdiodev->bus_if->state == BUS_DOWN_ST) {
+        rwnx_msg_free(rwnx_hw, msg_params);
+        sdio_err("bus is down\n");
+        return -EIO;
+    }
+#endif
+
+    cmd = rwnx_cmd_malloc(rwnx_hw->cmd_mgr, gfp);
+    if (!cmd) {
+        rwnx_msg_free(rwnx_hw, msg_params);
+        return -EBUSY;
+    }
+    cmd->a2e_msg  = container_of((void *)msg_params, struct lmac_msg, param);
+    cmd->id       = cmd->a2e_msg->id;
+    cmd->reqid    = reqid;
+    cmd->e2a_msg  = cfm;
+    cmd->result   = -EINTR;
+    cmd->flags    = RWNX_CMD_FLAG_NONBLOCK | RWNX_CMD_FLAG_REQ_CFM;
+    cmd->done     = done;
+    cmd->done_arg = arg;
+
+    return rwnx_hw->cmd_mgr->queue(rwnx_hw->cmd_mgr, cmd);
+}
+#endif
+
+#ifdef CONFIG_RWNX_MSG_BATCH
+static void rwnx_msg_batch_done(struct rwnx_hw *rwnx_hw, int result, void *cfm, void *arg)
+{
+    struct rwnx_msg_batch *batch = arg;
+    unsigned long flags;
+
+    /* batch may be gone as soon as the lock is dropped */
+    spin_lock_irqsave(&batch->lock, flags);
+    if (result && !batch->error)
+        batch->error = result;
+    batch->pending--;
+    wake_up(&batch->wait);
+    spin_unlock_irqrestore(&batch->lock, flags);
+}
+
+static int rwnx_msg_batch_add(struct rwnx_hw *rwnx_hw, const void *msg_params,
+                              lmac_msg_id_t reqid)
+{
+    struct rwnx_msg_batch *batch = rwnx_hw->msg_batch;
+    int ret;
+
+    /* leave room in the cmd queue for the synchronous requests */
+    wait_event(batch->wait, READ_ONCE(batch->pending) < RWNX_MSG_BATCH_MAX);
+
+    spin_lock_irq(&batch->lock);
+    batch->pending++;
+    spin_unlock_irq(&batch->lock);
+    ret = rwnx_send_msg_async(rwnx_hw, msg_params, reqid, NULL, GFP_KERNEL,
+                              rwnx_msg_batch_done, batch);
+    if (ret) {
+        spin_lock_irq(&batch->lock);
+        batch->pending--;
+        spin_unlock_irq(&batch->lock);
+        return ret;
+    }
+    batch->nb++;
+    return 0;
+}
+
+/* Until rwnx_msg_batch_end(), requests of this task that only need their
+ * cfm status are queued without waiting for it. */
+void rwnx_msg_batch_begin(struct rwnx_hw *rwnx_hw, struct rwnx_msg_batch *batch)
+{
+    spin_lock_init(&batch->lock);
+    batch->pending = 0;
+    batch->error = 0;
+    batch->nb = 0;
+    batch->start = ktime_get();
+    init_waitqueue_head(&batch->wait);
+    rwnx_hw->msg_batch = batch;
+    WRITE_ONCE(rwnx_hw->msg_batch_owner, current);
+}
+
+/* Waits for every batched cfm, returns the first error reported */
+int rwnx_msg_batch_end(struct rwnx_hw *rwnx_hw, struct rwnx_msg_batch *batch)
+{
+    int error;
+
+    WRITE_ONCE(rwnx_hw->msg_batch_owner, NULL);
+    rwnx_hw->msg_batch = NULL;
+    /* each batched cmd gets its done call, at worst on its timeout */
+    wait_event(batch->wait, READ_ONCE(batch->pending) == 0);
+    /* the last done may still be waking us, wait for it to let go */
+    spin_lock_irq(&batch->lock);
+    error = batch->error;
+    spin_unlock_irq(&batch->lock);
+
+    AICWFDBG(LOGINFO, "%s: %d msgs in %lld us, err %d\n", __func__, batch->nb,
+             ktime_us_delta(ktime_get(), batch->start), error);
+    return error;
+}
+#endif
+
 
 static int rwnx_send_msg1(struct rwnx_hw *rwnx_hw, const void *msg_params,
                          int reqcfm, lmac_msg_id_t reqid, void *cfm, bool defer)
@@ -514,14 +575,18 @@ static int rwnx_send_msg1(struct rwnx_hw *rwnx_hw, const void *msg_params,
 
     //nonblock = is_non_blocking_msg(msg->id);
 	nonblock = 0;
-    cmd = rwnx_cmd_malloc();//kzalloc(sizeof(struct rwnx_cmd), nonblock ? GFP_ATOMIC : GFP_KERNEL);
+    /* deferred senders may be atomic, only a waiting sender may sleep */
+    cmd = rwnx_cmd_malloc(rwnx_hw->cmd_mgr, (reqcfm && !defer) ? GFP_KERNEL : GFP_ATOMIC);//kzalloc(sizeof(struct rwnx_cmd), nonblock ? GFP_ATOMIC : GFP_KERNEL);
+    if (!cmd) {
+        rwnx_msg_free(rwnx_hw, msg_params);
+        return -EBUSY;
+    }
     cmd->result  = -EINTR;
     cmd->id      = msg->id;
     cmd->reqid   = reqid;
     cmd->a2e_msg = msg;
     cmd->e2a_msg = cfm;
-    if (nonblock)
-        cmd->flags = RWNX_CMD_FLAG_NONBLOCK;
+    cmd->flags = nonblock ? RWNX_CMD_FLAG_NONBLOCK : 0;
     if (reqcfm)
         cmd->flags |= RWNX_CMD_FLAG_REQ_CFM;
 
@@ -533,6 +598,11 @@ static int rwnx_send_msg1(struct rwnx_hw *rwnx_hw, const void *msg_params,
             ret = cmd_mgr_queue_force_defer(rwnx_hw->cmd_mgr, cmd);
     }
 
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+    if (!reqcfm) {
+        rwnx_cmd_free(cmd);//kfree(cmd);
+    }
+#else
     if (!reqcfm || ret) {
         rwnx_cmd_free(cmd);//kfree(cmd);
     }
@@ -540,6 +610,7 @@ static int rwnx_send_msg1(struct rwnx_hw *rwnx_hw, const void *msg_params,
     if (!ret) {
         ret = cmd->result;
     }
+#endif
 
     //return ret;
     return 0;
@@ -19,6 +19,55 @@
 #define	FW_RF_CALIB_FILE "aic_rf_calib.bin"
 #endif
 
+#ifdef CONFIG_RWNX_CMD_PIPELINE
+int rwnx_send_msg_async(struct rwnx_hw *rwnx_hw, const void *msg_params,
+                        lmac_msg_id_t reqid, void *cfm, gfp_t gfp,
+                        rwnx_cmd_done_fct done, void *arg);
+#endif
+
+#ifdef CONFIG_RWNX_MSG_BATCH
+#ifndef CONFIG_RWNX_CMD_PIPELINE
+#error CONFIG_RWNX_MSG_BATCH needs CONFIG_RWNX_CMD_PIPELINE
+#endif
+/* most batched requests waiting for their cfm at once */
+#define RWNX_MSG_BATCH_MAX          (RWNX_CMD_MAX_QUEUED / 2)
+
+/**
+ * struct rwnx_msg_batch - requests sent between rwnx_msg_batch_begin() and
+ * rwnx_msg_batch_end() by the same task
+ *
+ * Requests that need no cfm data are queued without waiting, their cfm
+ * are collected by rwnx_msg_batch_end(). Requests with a cfm buffer are
+ * still sent synchronously, after the ones already batched.
+ *
+ * The batch lives on the stack of its owner, so cfm callbacks only touch it
+ * under @lock, which rwnx_msg_batch_end() takes once before returning.
+ *
+ * @lock    protects @pending, @error and the wake up of @wait
+ * @pending requests waiting for their cfm
+ * @error   first error reported by a cfm (or timeout)
+ * @nb      number of batched requests
+ * @start   time rwnx_msg_batch_begin() was called
+ * @wait    woken at each cfm
+ */
+struct rwnx_msg_batch {
+    spinlock_t lock;
+    int pending;
+    int error;
+    int nb;
+    ktime_t start;
+    wait_queue_head_t wait;
+};
+
+void rwnx_msg_batch_begin(struct rwnx_hw *rwnx_hw, struct rwnx_msg_batch *batch);
+int rwnx_msg_batch_end(struct rwnx_hw *rwnx_hw, struct rwnx_msg_batch *batch);
+#else
+struct rwnx_msg_batch {};
+static inline void rwnx_msg_batch_begin(struct rwnx_hw *rwnx_hw,
+                                        struct rwnx_msg_batch *batch) {}
+static inline int rwnx_msg_batch_end(struct rwnx_hw *rwnx_hw,
+                                     struct rwnx_msg_batch *batch) { return 0; }
+#endif
 
 int rwnx_send_reset(struct rwnx_hw *rwnx_hw);
 int rwnx_send_start(struct rwnx_hw *rwnx_hw);
@@ -784,16 +784,19 @@ void rwnx_release_firmware_common(u32** buffer)
  * @fw_addr: Address where the fw must be loaded
  * @filename: Name of the fw.
  *
- * Load a fw, stored as a binary file, into the specified address
+ * Load a fw, stored as a binary file, into the specified address.
+ * With CONFIG_RWNX_MSG_BATCH the block writes are sent without waiting
+ * each cfm, rwnx_msg_batch_end() collects them.
  */
 
 int rwnx_plat_bin_fw_upload_2(struct rwnx_hw *rwnx_hw, u32 fw_addr,
                                char *filename)
 {
-    int err = 0;
+    int err = 0, batch_err;
     unsigned int i = 0, size;
 //    u32 *src;
 	u32 *dst = NULL;
+    struct rwnx_msg_batch batch;
 
     /* Copy the file on the Embedded side */
     AICWFDBG(LOGINFO, "### Upload %s firmware, @ = %x\n", filename, fw_addr);
@@ -811,6 +814,8 @@ int rwnx_plat_bin_fw_upload_2(struct rwnx_hw *rwnx_hw, u32 fw_addr,
     }
 
 	AICWFDBG(LOGINFO, "size=%d, dst[0]=%x\n", size, dst[0]);
+    //each block is copied into its msg, dst may go once the batch is done
+    rwnx_msg_batch_begin(rwnx_hw, &batch);
     if (size > 512) {
         for (; i < (size - 512); i += 512) {
             //printk("wr blk 0: %p -> %x\r\n", dst + i / 4, fw_addr + i);
@@ -828,6 +833,12 @@ int rwnx_plat_bin_fw_upload_2(struct rwnx_hw *rwnx_hw, u32 fw_addr,
             AICWFDBG(LOGERROR, "bin upload fail: %x, err:%d\r\n", fw_addr + i, err);
         }
     }
+    batch_err = rwnx_msg_batch_end(rwnx_hw, &batch);
+    if (batch_err) {
+        AICWFDBG(LOGERROR, "bin upload fail: %s, cfm err:%d\r\n", filename, batch_err);
+        if (!err)
+            err = batch_err;
+    }
 
     if (dst) {
         rwnx_release_firmware_common(&dst);
@@ -230,6 +230,43 @@ static void rwnx_rx_vector_convert(struct rwnx_hw *rwnx_hw,
     rx_vect2->evm4 = rx_vect2_leg.evm4;
 }
 
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+/* 1SS 20MHz long GI rates in 100kbps, scaled by nss and bandwidth below */
+static const u16 rwnx_vht_rate_20[10] = {65, 130, 195, 260, 390, 520, 585, 650, 780, 867};
+static const u16 rwnx_he_rate_20[12] = {86, 172, 258, 344, 516, 688, 774, 860, 1032, 1147, 1290, 1434};
+
+/**
+ * rwnx_rx_rate_est - Rough PHY rate of a rx vector, in 100kbps
+ *
+ * Used as the tx rate estimate of the peer by the airtime scheduler, the
+ * exact rate is only known by the fw rate control.
+ */
+static u32 rwnx_rx_rate_est(struct rx_vector_1 *rxvect)
+{
+    u32 rate, nss;
+
+    switch (rxvect->format_mod) {
+    case FORMATMOD_NON_HT:
+    case FORMATMOD_NON_HT_DUP_OFDM:
+        return legrates_lut[rxvect->leg_rate].rate;
+    case FORMATMOD_HT_MF:
+    case FORMATMOD_HT_GF:
+        rate = rwnx_vht_rate_20[rxvect->ht.mcs % 8];
+        nss = rxvect->ht.mcs / 8;
+        break;
+    case FORMATMOD_VHT:
+        rate = rwnx_vht_rate_20[min_t(u32, rxvect->vht.mcs, 9)];
+        nss = rxvect->vht.nss;
+        break;
+    default:
+        rate = rwnx_he_rate_20[min_t(u32, rxvect->he.mcs, 11)];
+        nss = rxvect->he.nss;
+        break;
+    }
+    return (rate * (nss + 1)) << min_t(u32, rxvect->ch_bw, 3);
+}
+#endif
+
 /**
  * rwnx_rx_statistic - save some statistics about received frames
  *
@@ -248,6 +285,9 @@ static void rwnx_rx_statistic(struct rwnx_hw *rwnx_hw, struct hw_rxhdr *hw_rxhdr
 
     /* save complete hwvect */
     sta->stats.last_rx = hw_rxhdr->hwvect;
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+    WRITE_ONCE(sta->airtime.rate, rwnx_rx_rate_est(rxvect));
+#endif
 
     /* update ampdu rx stats */
     mpdu = hw_rxhdr->hwvect.mpdu_cnt;
@@ -429,10 +469,13 @@ static void rwnx_rx_data_skb_forward(struct rwnx_hw *rwnx_hw, struct rwnx_vif *r
 
 
 #ifdef CONFIG_FILTER_TCP_ACK
-	filter_rx_tcp_ack(rwnx_hw, rx_skb->data, cpu_to_le16(rx_skb->len));
+	filter_rx_tcp_ack(rwnx_hw, skb_mac_header(rx_skb),
+			  skb_tail_pointer(rx_skb) - skb_mac_header(rx_skb));
 #endif
 
-	#ifdef CONFIG_RX_NETIF_RECV_SKB //modify by aic
+	#if defined(CONFIG_RX_NAPI)
+	aicwf_rx_napi_queue(rwnx_hw->usbdev->rx_priv, rx_skb);
+	#elif defined(CONFIG_RX_NETIF_RECV_SKB) //modify by aic
 	local_bh_disable();
 	netif_receive_skb(rx_skb);
 	local_bh_enable();
@@ -621,10 +664,13 @@ static bool rwnx_rx_data_skb(struct rwnx_hw *rwnx_hw, struct rwnx_vif *rwnx_vif,
 
 
 #ifdef CONFIG_FILTER_TCP_ACK
-            filter_rx_tcp_ack(rwnx_hw, rx_skb->data, cpu_to_le16(rx_skb->len));
+            filter_rx_tcp_ack(rwnx_hw, skb_mac_header(rx_skb),
+                              skb_tail_pointer(rx_skb) - skb_mac_header(rx_skb));
 #endif
 
-            #ifdef CONFIG_RX_NETIF_RECV_SKB //modify by aic
+            #if defined(CONFIG_RX_NAPI)
+            aicwf_rx_napi_queue(rwnx_hw->usbdev->rx_priv, rx_skb);
+            #elif defined(CONFIG_RX_NETIF_RECV_SKB) //modify by aic
             local_bh_disable();
             netif_receive_skb(rx_skb);
             local_bh_enable();
@@ -1412,7 +1458,8 @@ static int rwnx_rx_monitor(struct rwnx_hw *rwnx_hw, struct rwnx_vif *rwnx_vif,
     skb->protocol = htons(ETH_P_802_2);
 
 #ifdef CONFIG_FILTER_TCP_ACK
-    filter_rx_tcp_ack(rwnx_hw, skb->data, cpu_to_le16(skb->len));
+    filter_rx_tcp_ack(rwnx_hw, skb_mac_header(skb),
+                      skb_tail_pointer(skb) - skb_mac_header(skb));
 #endif
 
     local_bh_disable();
@@ -1487,6 +1534,117 @@ struct recv_msdu *reord_rxframe_alloc(spinlock_t *lock, struct list_head *q)
     return rxframe;
 }
 
+int reorder_winsize = AICWF_REORDER_WINSIZE;
+module_param(reorder_winsize, int, 0660);
+
+//hole timeout in ms, reorder_timeout covers BE/BK
+int reorder_timeout = REORDER_UPDATE_TIME;
+int reorder_timeout_vi = 100;
+int reorder_timeout_vo = 50;
+module_param(reorder_timeout, int, 0660);
+module_param(reorder_timeout_vi, int, 0660);
+module_param(reorder_timeout_vo, int, 0660);
+
+static inline u16 reord_wsize(void)
+{
+    int wsize = READ_ONCE(reorder_winsize);
+
+    return (wsize > 0 && wsize <= AICWF_REORDER_RING) ? wsize : AICWF_REORDER_WINSIZE;
+}
+
+/* detach the frame parked at a ring slot, called with reord_list_lock held */
+static struct recv_msdu *reord_ring_take(struct reord_ctrl *preorder_ctrl, u16 slot)
+{
+    if (!test_bit(slot, preorder_ctrl->reord_bitmap))
+        return NULL;
+
+    __clear_bit(slot, preorder_ctrl->reord_bitmap);
+    preorder_ctrl->reord_cnt--;
+    return &preorder_ctrl->rx_priv->recv_frames[preorder_ctrl->reord_slot[slot]];
+}
+
+static inline bool reord_ring_has(struct reord_ctrl *preorder_ctrl, u16 sn)
+{
+    u16 slot = sn & (AICWF_REORDER_RING - 1);
+
+    return test_bit(slot, preorder_ctrl->reord_bitmap) &&
+        preorder_ctrl->rx_priv->recv_frames[preorder_ctrl->reord_slot[slot]].seq_num == sn;
+}
+
+static unsigned long reord_expire_time(struct reord_ctrl *preorder_ctrl)
+{
+    int timeout;
+
+    switch (rwnx_tid2hwq[preorder_ctrl->tid]) {
+    case RWNX_HWQ_VO:
+        timeout = READ_ONCE(reorder_timeout_vo);
+        break;
+    case RWNX_HWQ_VI:
+        timeout = READ_ONCE(reorder_timeout_vi);
+        break;
+    default:
+        timeout = READ_ONCE(reorder_timeout);
+        break;
+    }
+
+    return jiffies + msecs_to_jiffies(timeout);
+}
+
+/* called with reord_expire_lock held, a disabled TID is never queued again */
+static void __reord_expire_update(struct aicwf_rx_priv *rx_priv, struct reord_ctrl *preorder_ctrl, bool pending)
+{
+    if (pending && preorder_ctrl->enable && list_empty(&preorder_ctrl->expire_list)) {
+        preorder_ctrl->expire = reord_expire_time(preorder_ctrl);
+        list_add_tail(&preorder_ctrl->expire_list, &rx_priv->reord_expire_list);
+        if (!timer_pending(&rx_priv->reord_timer) ||
+            time_before(preorder_ctrl->expire, rx_priv->reord_timer.expires))
+            mod_timer(&rx_priv->reord_timer, preorder_ctrl->expire);
+    } else if (!pending) {
+        list_del_init(&preorder_ctrl->expire_list);
+    }
+}
+
+/* start or stop the hole timeout of a TID, called without reord_list_lock */
+static void reord_expire_update(struct aicwf_rx_priv *rx_priv, struct reord_ctrl *preorder_ctrl, bool pending)
+{
+    spin_lock_bh(&rx_priv->reord_expire_lock);
+    __reord_expire_update(rx_priv, preorder_ctrl, pending);
+    spin_unlock_bh(&rx_priv->reord_expire_lock);
+}
+
+/* unlink a disabled TID and wait out a timeout handler still working on it */
+static void reord_expire_detach(struct aicwf_rx_priv *rx_priv, struct reord_ctrl *preorder_ctrl)
+{
+    bool busy;
+
+    for (;;) {
+        spin_lock_bh(&rx_priv->reord_expire_lock);
+        list_del_init(&preorder_ctrl->expire_list);
+        busy = preorder_ctrl->in_timeout;
+        spin_unlock_bh(&rx_priv->reord_expire_lock);
+        if (!busy)
+            break;
+        cpu_relax();
+    }
+}
+
+static inline u8 reord_sta_hash(const u8 *mac_addr)
+{
+    return (mac_addr[3] ^ mac_addr[4] ^ mac_addr[5]) & (AICWF_REORD_STA_HASH - 1);
+}
+
+/* called with stas_reord_lock held */
+static struct reord_ctrl_info *reord_find_sta(struct aicwf_rx_priv *rx_priv, const u8 *mac_addr)
+{
+    struct reord_ctrl_info *reord_info = rx_priv->stas_reord_hash[reord_sta_hash(mac_addr)];
+
+    while (reord_info && !ether_addr_equal(reord_info->mac_addr, mac_addr))
+        reord_info = reord_info->hash_next;
+
+    return reord_info;
+}
+
+/* called with stas_reord_lock held, the context is taken from the preallocated pool */
 struct reord_ctrl_info *reord_init_sta(struct aicwf_rx_priv* rx_priv, const u8 *mac_addr)
 {
     u8 i = 0;
@@ -1504,29 +1662,33 @@ struct reord_ctrl_info *reord_init_sta(struct aicwf_rx_priv* rx_priv, const u8 *
     }
 
     AICWFDBG(LOGINFO, "reord_init_sta:%pM\n", mac_addr);
-    reord_info = kmalloc(sizeof(struct reord_ctrl_info), GFP_ATOMIC);
-    if (!reord_info)
+    if (list_empty(&rx_priv->stas_reord_freeq)) {
+        AICWFDBG(LOGERROR, "reord sta pool exhausted\n");
         return NULL;
+    }
+    reord_info = list_first_entry(&rx_priv->stas_reord_freeq, struct reord_ctrl_info, list);
+    list_del(&reord_info->list);
 
     memcpy(reord_info->mac_addr, mac_addr, ETH_ALEN);
     for (i=0; i < 8; i++) {
         preorder_ctrl = &reord_info->preorder_ctrl[i];
         preorder_ctrl->enable = true;
         preorder_ctrl->ind_sn = 0xffff;
-        preorder_ctrl->wsize_b = AICWF_REORDER_WINSIZE;
+        preorder_ctrl->wsize_b = reord_wsize();
         preorder_ctrl->rx_priv= rx_priv;
-        INIT_LIST_HEAD(&preorder_ctrl->reord_list);
+        preorder_ctrl->head_sn = 0;
+        preorder_ctrl->reord_cnt = 0;
+        bitmap_zero(preorder_ctrl->reord_bitmap, AICWF_REORDER_RING);
+        preorder_ctrl->tid = i;
         spin_lock_init(&preorder_ctrl->reord_list_lock);
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4,14,0)
-        init_timer(&preorder_ctrl->reord_timer);
-        preorder_ctrl->reord_timer.data = (ulong) preorder_ctrl;
-        preorder_ctrl->reord_timer.function = reord_timeout_handler;
-#else
-        timer_setup(&preorder_ctrl->reord_timer, reord_timeout_handler, 0);
-#endif
-        INIT_WORK(&preorder_ctrl->reord_timer_work, reord_timeout_worker);
+        INIT_LIST_HEAD(&preorder_ctrl->expire_list);
+        preorder_ctrl->in_timeout = false;
     }
 
+    list_add_tail(&reord_info->list, &rx_priv->stas_reord_list);
+    reord_info->hash_next = rx_priv->stas_reord_hash[reord_sta_hash(mac_addr)];
+    rx_priv->stas_reord_hash[reord_sta_hash(mac_addr)] = reord_info;
+
     return reord_info;
 }
 
@@ -1538,10 +1700,8 @@ int reord_flush_tid(struct aicwf_rx_priv *rx_priv, struct sk_buff *skb, u8 tid)
     struct ethhdr *eh = (struct ethhdr *)(skb->data);
     u8 *mac;
     unsigned long flags;
-    u8 found = 0;
-    struct list_head *phead, *plist;
     struct recv_msdu *prframe;
-    int ret;
+    int i;
 
     if((rwnx_vif->wdev.iftype == NL80211_IFTYPE_STATION) || (rwnx_vif->wdev.iftype == NL80211_IFTYPE_P2P_CLIENT))
         mac = eh->h_dest;
@@ -1554,39 +1714,27 @@ int reord_flush_tid(struct aicwf_rx_priv *rx_priv, struct sk_buff *skb, u8 tid)
     }
 
     spin_lock_bh(&rx_priv->stas_reord_lock);
-    list_for_each_entry(reord_info, &rx_priv->stas_reord_list, list) {
-        if (!memcmp(mac, reord_info->mac_addr, ETH_ALEN)) {
-            found = 1;
-            preorder_ctrl = &reord_info->preorder_ctrl[tid];
-            break;
-        }
-    }
-    if (!found) {
+    reord_info = reord_find_sta(rx_priv, mac);
+    if (!reord_info) {
         spin_unlock_bh(&rx_priv->stas_reord_lock);
         return 0;
     }
+    preorder_ctrl = &reord_info->preorder_ctrl[tid];
     spin_unlock_bh(&rx_priv->stas_reord_lock);
 
     if(preorder_ctrl->enable == false)
         return 0;
     spin_lock_irqsave(&preorder_ctrl->reord_list_lock, flags);
-    phead = &preorder_ctrl->reord_list;
-    while (1) {
-        if (list_empty(phead)) {
-            break;
-        }
-        plist = phead->next;
-        prframe = list_entry(plist, struct recv_msdu, reord_pending_list);
-        reord_single_frame_ind(rx_priv, prframe);
-        list_del_init(&(prframe->reord_pending_list));
+    for (i = 0; preorder_ctrl->reord_cnt && i < AICWF_REORDER_RING; i++) {
+        prframe = reord_ring_take(preorder_ctrl, (preorder_ctrl->head_sn + i) & (AICWF_REORDER_RING - 1));
+        if (prframe)
+            reord_single_frame_ind(rx_priv, prframe);
     }
 
 	AICWFDBG(LOGINFO, "flush:tid=%d", tid);
     preorder_ctrl->enable = false;
     spin_unlock_irqrestore(&preorder_ctrl->reord_list_lock, flags);
-    if (timer_pending(&preorder_ctrl->reord_timer))
-        ret = del_timer_sync(&preorder_ctrl->reord_timer);
-    cancel_work_sync(&preorder_ctrl->reord_timer_work);
+    reord_expire_update(rx_priv, preorder_ctrl, false);
 
     return 0;
 }
@@ -1596,7 +1744,7 @@ void reord_deinit_sta(struct aicwf_rx_priv* rx_priv, struct reord_ctrl_info *reo
     u8 i = 0;
     //unsigned long flags;
     struct reord_ctrl *preorder_ctrl = NULL;
-    int ret;
+    struct reord_ctrl_info **pprev;
 
     if (rx_priv == NULL) {
         txrx_err("bad rx_priv!\n");
@@ -1606,19 +1754,16 @@ void reord_deinit_sta(struct aicwf_rx_priv* rx_priv, struct reord_ctrl_info *reo
 	AICWFDBG(LOGINFO, "%s\n", __func__);
 
     for (i=0; i < 8; i++) {
-        struct recv_msdu *req, *next;
+        struct recv_msdu *req;
+        u16 slot;
         preorder_ctrl = &reord_info->preorder_ctrl[i];
-		if(preorder_ctrl->enable){
-			preorder_ctrl->enable = false;
-	        if (timer_pending(&preorder_ctrl->reord_timer)) {
-	            ret = del_timer_sync(&preorder_ctrl->reord_timer);
-	        }
-	        cancel_work_sync(&preorder_ctrl->reord_timer_work);
-		}
 
         spin_lock_bh(&preorder_ctrl->reord_list_lock);
-        list_for_each_entry_safe(req, next, &preorder_ctrl->reord_list, reord_pending_list) {
-            list_del_init(&req->reord_pending_list);
+        preorder_ctrl->enable = false;
+        for (slot = 0; preorder_ctrl->reord_cnt && slot < AICWF_REORDER_RING; slot++) {
+            req = reord_ring_take(preorder_ctrl, slot);
+            if (!req)
+                continue;
             if(req->pkt != NULL)
                 dev_kfree_skb(req->pkt);
             req->pkt = NULL;
@@ -1628,12 +1773,18 @@ void reord_deinit_sta(struct aicwf_rx_priv* rx_priv, struct reord_ctrl_info *reo
 		AICWFDBG(LOGINFO, "reord dinit in_irq():%d in_atomic:%d in_softirq:%d\r\n", (int)in_irq()
 			,(int)in_atomic(), (int)in_softirq());
         spin_unlock_bh(&preorder_ctrl->reord_list_lock);
+        //the context goes back to the pool, nothing may queue it again
+        reord_expire_detach(rx_priv, preorder_ctrl);
     }
 
     spin_lock_bh(&rx_priv->stas_reord_lock);
-    list_del(&reord_info->list);
+    pprev = &rx_priv->stas_reord_hash[reord_sta_hash(reord_info->mac_addr)];
+    while (*pprev && *pprev != reord_info)
+        pprev = &(*pprev)->hash_next;
+    if (*pprev)
+        *pprev = reord_info->hash_next;
+    list_move(&reord_info->list, &rx_priv->stas_reord_freeq);
     spin_unlock_bh(&rx_priv->stas_reord_lock);
-    kfree(reord_info);
 }
 
 int reord_single_frame_ind(struct aicwf_rx_priv *rx_priv, struct recv_msdu *prframe)
@@ -1748,10 +1899,13 @@ int reord_single_frame_ind(struct aicwf_rx_priv *rx_priv, struct recv_msdu *prfr
         memset(rx_skb->cb, 0, sizeof(rx_skb->cb));
 
 #ifdef CONFIG_FILTER_TCP_ACK
-         filter_rx_tcp_ack(rwnx_vif->rwnx_hw, rx_skb->data, cpu_to_le16(rx_skb->len));
+         filter_rx_tcp_ack(rwnx_vif->rwnx_hw, skb_mac_header(rx_skb),
+                           skb_tail_pointer(rx_skb) - skb_mac_header(rx_skb));
 #endif
 
-#ifdef CONFIG_RX_NETIF_RECV_SKB//AIDEN test
+#if defined(CONFIG_RX_NAPI)
+        aicwf_rx_napi_queue(rx_priv, rx_skb);
+#elif defined(CONFIG_RX_NETIF_RECV_SKB)//AIDEN test
         local_bh_disable();
         netif_receive_skb(rx_skb);
         local_bh_enable();
@@ -1784,74 +1938,51 @@ int reord_single_frame_ind(struct aicwf_rx_priv *rx_priv, struct recv_msdu *prfr
 
 bool reord_rxframes_process(struct aicwf_rx_priv *rx_priv, struct reord_ctrl *preorder_ctrl, int bforced)
 {
-    struct list_head *phead, *plist;
-    struct recv_msdu *prframe;
-    bool bPktInBuf = false;
+    u16 sn, slot;
+    int below = 0;
 
-    if (bforced == true) {
-        phead = &preorder_ctrl->reord_list;
-        if (list_empty(phead)) {
-            return false;
-        }
+    if (!preorder_ctrl->reord_cnt)
+        return false;
 
-        plist = phead->next;
-        prframe = list_entry(plist, struct recv_msdu, reord_pending_list);
-        preorder_ctrl->ind_sn = prframe->seq_num;
+    if (bforced == true) {
+        //give up on the hole, jump to the oldest pending frame
+        slot = find_next_bit(preorder_ctrl->reord_bitmap, AICWF_REORDER_RING,
+                             preorder_ctrl->head_sn & (AICWF_REORDER_RING - 1));
+        if (slot >= AICWF_REORDER_RING)
+            slot = find_first_bit(preorder_ctrl->reord_bitmap, AICWF_REORDER_RING);
+        preorder_ctrl->ind_sn = rx_priv->recv_frames[preorder_ctrl->reord_slot[slot]].seq_num;
     }
 
-    phead = &preorder_ctrl->reord_list;
-    if (list_empty(phead)) {
-        return bPktInBuf;
-    }
+    while (reord_ring_has(preorder_ctrl, preorder_ctrl->ind_sn))
+        preorder_ctrl->ind_sn = (preorder_ctrl->ind_sn + 1) & 0xFFF;
 
-    list_for_each_entry(prframe, phead, reord_pending_list) {
-        if (!SN_LESS(preorder_ctrl->ind_sn, prframe->seq_num)) {
-            if (SN_EQUAL(preorder_ctrl->ind_sn, prframe->seq_num)) {
-                preorder_ctrl->ind_sn = (preorder_ctrl->ind_sn + 1) & 0xFFF;
-            }
-        } else {
-            bPktInBuf = true;
-            break;
-        }
+    //frames below ind_sn go up now, anything else is still waiting for a hole
+    for (sn = preorder_ctrl->head_sn; below < preorder_ctrl->reord_cnt && SN_LESS(sn, preorder_ctrl->ind_sn);
+         sn = (sn + 1) & 0xFFF) {
+        if (test_bit(sn & (AICWF_REORDER_RING - 1), preorder_ctrl->reord_bitmap))
+            below++;
     }
 
-    return bPktInBuf;
+    return preorder_ctrl->reord_cnt > below;
 }
 
 void reord_rxframes_ind(struct aicwf_rx_priv *rx_priv,
     struct reord_ctrl *preorder_ctrl)
 {
-    struct list_head *phead, *plist;
     struct recv_msdu *prframe;
 
-	//spin_lock_bh(&preorder_ctrl->reord_list_lock);//AIDEN
-    phead = &preorder_ctrl->reord_list;
-    while (1) {
-        //spin_lock_bh(&preorder_ctrl->reord_list_lock);
-        if (list_empty(phead)) {
-            //spin_unlock_bh(&preorder_ctrl->reord_list_lock);
-            break;
-        }
-
-        plist = phead->next;
-        prframe = list_entry(plist, struct recv_msdu, reord_pending_list);
-
-        if (!SN_LESS(preorder_ctrl->ind_sn, prframe->seq_num)) {
-            list_del_init(&(prframe->reord_pending_list));
-            //spin_unlock_bh(&preorder_ctrl->reord_list_lock);
-			reord_single_frame_ind(rx_priv, prframe);
-        } else {
-            //spin_unlock_bh(&preorder_ctrl->reord_list_lock);
-            break;
-        }
+    while (preorder_ctrl->reord_cnt && SN_LESS(preorder_ctrl->head_sn, preorder_ctrl->ind_sn)) {
+        prframe = reord_ring_take(preorder_ctrl, preorder_ctrl->head_sn & (AICWF_REORDER_RING - 1));
+        preorder_ctrl->head_sn = (preorder_ctrl->head_sn + 1) & 0xFFF;
+        if (prframe)
+            reord_single_frame_ind(rx_priv, prframe);
     }
-	//spin_unlock_bh(&preorder_ctrl->reord_list_lock);//AIDEN
-}
-
-int reorder_timeout = REORDER_UPDATE_TIME;
-module_param(reorder_timeout, int, 0660);
 
+    if (!preorder_ctrl->reord_cnt)
+        preorder_ctrl->head_sn = preorder_ctrl->ind_sn;
+}
 
+/* per-device hole expiry: only TIDs holding frames sit on reord_expire_list */
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4,14,0)
 void reord_timeout_handler (ulong data)
 #else
@@ -1859,52 +1990,72 @@ void reord_timeout_handler (struct timer_list *t)
 #endif
 {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4,14,0)
-	struct reord_ctrl *preorder_ctrl = (struct reord_ctrl *)data;
+	struct aicwf_rx_priv *rx_priv = (struct aicwf_rx_priv *)data;
 #else
-	struct reord_ctrl *preorder_ctrl = from_timer(preorder_ctrl, t, reord_timer);
+	struct aicwf_rx_priv *rx_priv = from_timer(rx_priv, t, reord_timer);
 #endif
+    struct reord_ctrl *preorder_ctrl, *tmp;
+    LIST_HEAD(expired);
+    unsigned long next = 0;
+    bool rearm = false;
+    bool pending;
 
 	AICWFDBG(LOGTRACE, "%s Enter \r\n", __func__);
 
-
-	if (g_rwnx_plat->usbdev->state == USB_DOWN_ST) {
+	if (rx_priv->usbdev->state == USB_DOWN_ST) {
         usb_err("bus is down\n");
         return;
 	}
-#if 0//AIDEN
-    struct aicwf_rx_priv *rx_priv = preorder_ctrl->rx_priv;
 
-    if (reord_rxframes_process(rx_priv, preorder_ctrl, true)==true) {
-        mod_timer(&preorder_ctrl->reord_timer, jiffies + msecs_to_jiffies(reorder_timeout/*REORDER_UPDATE_TIME*/));
-    }
-#endif
-
-    if(!work_pending(&preorder_ctrl->reord_timer_work))
-        schedule_work(&preorder_ctrl->reord_timer_work);
+    //only pick the expired TIDs here, frames go up without reord_expire_lock
+    spin_lock(&rx_priv->reord_expire_lock);
+    list_for_each_entry_safe(preorder_ctrl, tmp, &rx_priv->reord_expire_list, expire_list) {
+        if (time_before(jiffies, preorder_ctrl->expire)) {
+            if (!rearm || time_before(preorder_ctrl->expire, next))
+                next = preorder_ctrl->expire;
+            rearm = true;
+            continue;
+        }
+        list_move_tail(&preorder_ctrl->expire_list, &expired);
+    }
+    if (rearm)
+        mod_timer(&rx_priv->reord_timer, next);
+    spin_unlock(&rx_priv->reord_expire_lock);
+
+    for (;;) {
+        //reord_expire_update() may still unlink them, pop under the lock
+        spin_lock(&rx_priv->reord_expire_lock);
+        preorder_ctrl = list_first_entry_or_null(&expired, struct reord_ctrl, expire_list);
+        if (preorder_ctrl) {
+            list_del_init(&preorder_ctrl->expire_list);
+            preorder_ctrl->in_timeout = true;
+        }
+        spin_unlock(&rx_priv->reord_expire_lock);
+        if (!preorder_ctrl)
+            break;
 
-}
+        spin_lock(&preorder_ctrl->reord_list_lock);
+        pending = preorder_ctrl->enable &&
+                  reord_rxframes_process(rx_priv, preorder_ctrl, true);
+        reord_rxframes_ind(rx_priv, preorder_ctrl);
+        spin_unlock(&preorder_ctrl->reord_list_lock);
 
-void reord_timeout_worker(struct work_struct *work)
-{
-    struct reord_ctrl *preorder_ctrl = container_of(work, struct reord_ctrl, reord_timer_work);
-    struct aicwf_rx_priv *rx_priv = preorder_ctrl->rx_priv;
+        //holes left: a new countdown, as a frame arriving would start
+        spin_lock(&rx_priv->reord_expire_lock);
+        __reord_expire_update(rx_priv, preorder_ctrl, pending);
+        preorder_ctrl->in_timeout = false;
+        spin_unlock(&rx_priv->reord_expire_lock);
+    }
 
-	spin_lock_bh(&preorder_ctrl->reord_list_lock);
-#if 1//AIDEN
-	if (reord_rxframes_process(rx_priv, preorder_ctrl, true)==true) {
-		mod_timer(&preorder_ctrl->reord_timer, jiffies + msecs_to_jiffies(reorder_timeout/*REORDER_UPDATE_TIME*/));
-	}
+#ifdef CONFIG_RX_NAPI
+    aicwf_rx_napi_kick(rx_priv);
 #endif
-
-    reord_rxframes_ind(rx_priv, preorder_ctrl);
-	spin_unlock_bh(&preorder_ctrl->reord_list_lock);
-
-    return ;
 }
 
 int reord_process_unit(struct recv_msdu *pframe, struct aicwf_rx_priv *rx_priv, struct sk_buff *skb, u16 seq_num, u8 tid, u8 forward, u8 is_amsdu)
 {
     int ret=0;
+    bool pending;
     u8 *mac;
     struct reord_ctrl *preorder_ctrl;
     struct reord_ctrl_info *reord_info;
@@ -1922,7 +2073,6 @@ int reord_process_unit(struct recv_msdu *pframe, struct aicwf_rx_priv *rx_priv,
     }
     #endif
 
-    INIT_LIST_HEAD(&pframe->reord_pending_list);
     pframe->seq_num = seq_num;
     pframe->tid = tid;
     pframe->rx_data = skb->data;
@@ -1945,15 +2095,11 @@ int reord_process_unit(struct recv_msdu *pframe, struct aicwf_rx_priv *rx_priv,
     }
 
     spin_lock_bh(&rx_priv->stas_reord_lock);
-    list_for_each_entry(reord_info, &rx_priv->stas_reord_list, list) {
-        if (!memcmp(mac, reord_info->mac_addr, ETH_ALEN)) {
-            preorder_ctrl = &reord_info->preorder_ctrl[pframe->tid];
-            break;
-        }
-    }
-
+    reord_info = reord_find_sta(rx_priv, mac);
+    if (reord_info)
+        preorder_ctrl = &reord_info->preorder_ctrl[pframe->tid];
 
-    if (&reord_info->list == &rx_priv->stas_reord_list) {//first time???
+    if (!reord_info) {//first time???
         reord_info = reord_init_sta(rx_priv, mac);
         //reord_info has 8 preorder_ctrl,
         //There is a one-to-one matched preorder_ctrl and tid
@@ -1962,13 +2108,12 @@ int reord_process_unit(struct recv_msdu *pframe, struct aicwf_rx_priv *rx_priv,
             reord_single_frame_ind(rx_priv, pframe);
             return -1;
         }
-        list_add_tail(&reord_info->list, &rx_priv->stas_reord_list);
         preorder_ctrl = &reord_info->preorder_ctrl[pframe->tid];
     } else {
         if(preorder_ctrl->enable == false) {
             preorder_ctrl->enable = true;
             preorder_ctrl->ind_sn = 0xffff;
-            preorder_ctrl->wsize_b = AICWF_REORDER_WINSIZE;
+            preorder_ctrl->wsize_b = reord_wsize();
             preorder_ctrl->rx_priv= rx_priv;
         }
     }
@@ -2015,20 +2160,15 @@ int reord_process_unit(struct recv_msdu *pframe, struct aicwf_rx_priv *rx_priv,
         goto fail;
     }
 
-    if (reord_rxframes_process(rx_priv, preorder_ctrl, false) == true) {
-        if (!timer_pending(&preorder_ctrl->reord_timer)) {//if this timer not countdown, mod_timer timer to start count down
-            ret = mod_timer(&preorder_ctrl->reord_timer, jiffies + msecs_to_jiffies(reorder_timeout/*REORDER_UPDATE_TIME*/));
-        }
-    } else {
-		if(timer_pending(&preorder_ctrl->reord_timer)) {
-	        	ret = del_timer(&preorder_ctrl->reord_timer);
-		}
-    }
+    pending = reord_rxframes_process(rx_priv, preorder_ctrl, false);
 
 	reord_rxframes_ind(rx_priv, preorder_ctrl);
 
     spin_unlock_bh(&preorder_ctrl->reord_list_lock);
 
+    //a running countdown is kept, like the per-TID timer used to be
+    reord_expire_update(rx_priv, preorder_ctrl, pending);
+
 
 
     return 0;
@@ -2044,7 +2184,7 @@ fail:
 
 int reord_need_check(struct reord_ctrl *preorder_ctrl, u16 seq_num)
 {
-    u8 wsize = preorder_ctrl->wsize_b;
+    u16 wsize = preorder_ctrl->wsize_b;
     u16 wend = (preorder_ctrl->ind_sn + wsize -1) & 0xFFF;//0xFFF: 12 bits for seq num
 
 	//first time: wend = 0 + 64 - 1= 63
@@ -2064,6 +2204,8 @@ int reord_need_check(struct reord_ctrl *preorder_ctrl, u16 seq_num)
             preorder_ctrl->ind_sn = seq_num-(wsize-1);
         else
             preorder_ctrl->ind_sn = 0xFFF - (wsize - (seq_num + 1)) + 1;
+        //window moved, hand up what fell behind it before the ring slots get reused
+        reord_rxframes_ind(preorder_ctrl->rx_priv, preorder_ctrl);
     }
 
     return 0;
@@ -2071,28 +2213,18 @@ int reord_need_check(struct reord_ctrl *preorder_ctrl, u16 seq_num)
 
 int reord_rxframe_enqueue(struct reord_ctrl *preorder_ctrl, struct recv_msdu *prframe)
 {
-    struct list_head *preord_list = &preorder_ctrl->reord_list;
-    struct list_head *phead, *plist;
-    struct recv_msdu *pnextrframe;
-
-//first time:not any prframe in preord_list, so phead = phead->next
-    phead = preord_list;
-    plist = phead->next;
-
-    while(phead != plist) {
-        pnextrframe = list_entry(plist, struct recv_msdu, reord_pending_list);
-        if(SN_LESS(pnextrframe->seq_num, prframe->seq_num))	{
-            plist = plist->next;
-            continue;
-        } else if(SN_EQUAL(pnextrframe->seq_num, prframe->seq_num)) {
-            return -1;
-        } else {
-            break;
-        }
-    }
+    u16 slot = prframe->seq_num & (AICWF_REORDER_RING - 1);
 
-	//link prframe in plist
-    list_add_tail(&(prframe->reord_pending_list), plist);
+    if (test_bit(slot, preorder_ctrl->reord_bitmap))
+        return -1;//duplicate
+
+    if (!preorder_ctrl->reord_cnt)
+        preorder_ctrl->head_sn = SN_LESS(prframe->seq_num, preorder_ctrl->ind_sn) ?
+            prframe->seq_num : preorder_ctrl->ind_sn;
+
+    preorder_ctrl->reord_slot[slot] = prframe - preorder_ctrl->rx_priv->recv_frames;
+    __set_bit(slot, preorder_ctrl->reord_bitmap);
+    preorder_ctrl->reord_cnt++;
 
     return 0;
 }
@@ -2199,6 +2331,23 @@ void defrag_timeout_cb(struct timer_list *t)
 
 extern void rwnx_data_dump(char* tag, void* data, unsigned long len);
 
+#if defined(CONFIG_USB_RX_PAGE_FRAG) || defined(CONFIG_USB_RX_SG)
+/* monitor, mgmt, amsdu and fragmented frames are parsed in place over skb->len */
+static bool rwnx_rx_need_linear(struct hw_rxhdr *hw_rxhdr, u8 *frm)
+{
+    if (hw_rxhdr->is_monitor_vif || hw_rxhdr->flags_is_80211_mpdu)
+        return true;
+    if ((frm[0] & 0x0c) != 0x08)
+        return true;
+    if ((frm[1] & 0x04) || (frm[22] & 0x0f))
+        return true;
+    //qos control follows addr4 in a 4-address frame
+    if ((frm[0] & 0x80) && (frm[((frm[1] & 0x03) == 0x03) ? 30 : 24] & 0x80))
+        return true;
+    return false;
+}
+#endif
+
 u8 rwnx_rxdataind_aicwf(struct rwnx_hw *rwnx_hw, void *hostid, void *rx_priv)
 {
     struct hw_rxhdr *hw_rxhdr;
@@ -2231,6 +2380,16 @@ u8 rwnx_rxdataind_aicwf(struct rwnx_hw *rwnx_hw, void *hostid, void *rx_priv)
     REG_SW_SET_PROFILING(rwnx_hw, SW_PROF_RWNXDATAIND);
     hw_rxhdr = (struct hw_rxhdr *)skb->data;
 
+#if defined(CONFIG_USB_RX_PAGE_FRAG) || defined(CONFIG_USB_RX_SG)
+    if (skb_is_nonlinear(skb) && rwnx_rx_need_linear(hw_rxhdr, skb->data + msdu_offset + 2)) {
+        if (skb_linearize(skb)) {
+            dev_kfree_skb(skb);
+            goto end;
+        }
+        hw_rxhdr = (struct hw_rxhdr *)skb->data;
+    }
+#endif
+
 #ifdef AICWF_RX_REORDER
     if(hw_rxhdr->is_monitor_vif) {
         status = RX_STAT_MONITOR;
@@ -2684,16 +2843,10 @@ check_len_update:
 								forward = false;
 							}
 						} else {
-                            struct rwnx_sta *cur, *tmp;
-                            bool found = false;
-                            spin_lock_bh(&rwnx_hw->cb_lock);
-                            list_for_each_entry_safe(cur, tmp, &rwnx_vif->ap.sta_list, list) {
-                                if (!memcmp(cur->mac_addr, eth->h_dest, ETH_ALEN)) {
-                                    found = true;
-                                    break;
-                                }
-                            }
-                            spin_unlock_bh(&rwnx_hw->cb_lock);
+                            bool found;
+                            rcu_read_lock();
+                            found = rwnx_vif_sta_lookup(rwnx_vif, eth->h_dest) != NULL;
+                            rcu_read_unlock();
                             if(found) {
                                 //printk("amsdu found da\n");
                                 resend = true;
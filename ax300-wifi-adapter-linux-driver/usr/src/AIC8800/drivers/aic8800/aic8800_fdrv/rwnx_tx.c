@@ -287,6 +287,85 @@ static void rwnx_downgrade_ac(struct rwnx_sta *sta, struct sk_buff *skb)
     }
 }
 
+#ifdef CONFIG_RWNX_SW_TXHDR_POOL
+void rwnx_sw_txhdr_pool_deinit(struct rwnx_hw *rwnx_hw)
+{
+    int cpu;
+
+    if (!rwnx_hw->sw_txhdr_pool)
+        return;
+
+    for_each_possible_cpu(cpu)
+        kfree(per_cpu_ptr(rwnx_hw->sw_txhdr_pool, cpu)->descs);
+    free_percpu(rwnx_hw->sw_txhdr_pool);
+    rwnx_hw->sw_txhdr_pool = NULL;
+}
+
+int rwnx_sw_txhdr_pool_init(struct rwnx_hw *rwnx_hw)
+{
+    struct rwnx_sw_txhdr_pool *pool;
+    int cpu, i;
+
+    rwnx_hw->sw_txhdr_pool = alloc_percpu(struct rwnx_sw_txhdr_pool);
+    if (!rwnx_hw->sw_txhdr_pool)
+        return -ENOMEM;
+
+    for_each_possible_cpu(cpu) {
+        pool = per_cpu_ptr(rwnx_hw->sw_txhdr_pool, cpu);
+        init_llist_head(&pool->free);
+        pool->descs = kcalloc(RWNX_SW_TXHDR_POOL_SIZE, sizeof(*pool->descs),
+                              GFP_KERNEL);
+        if (!pool->descs) {
+            rwnx_sw_txhdr_pool_deinit(rwnx_hw);
+            return -ENOMEM;
+        }
+        for (i = 0; i < RWNX_SW_TXHDR_POOL_SIZE; i++) {
+            pool->descs[i].pool_cpu = cpu;
+            llist_add(&pool->descs[i].pool_node, &pool->free);
+        }
+    }
+
+    return 0;
+}
+
+struct rwnx_sw_txhdr *rwnx_sw_txhdr_alloc(struct rwnx_hw *rwnx_hw)
+{
+    struct rwnx_sw_txhdr_pool *pool;
+    struct rwnx_sw_txhdr *sw_txhdr;
+    struct llist_node *node;
+    unsigned long flags;
+
+    /* single consumer per list: the owner CPU with irqs off */
+    local_irq_save(flags);
+    pool = this_cpu_ptr(rwnx_hw->sw_txhdr_pool);
+    node = llist_del_first(&pool->free);
+    if (node)
+        pool->hit++;
+    else
+        pool->miss++;
+    local_irq_restore(flags);
+
+    if (node)
+        return llist_entry(node, struct rwnx_sw_txhdr, pool_node);
+
+    sw_txhdr = kmem_cache_alloc(rwnx_hw->sw_txhdr_cache, GFP_ATOMIC);
+    if (sw_txhdr)
+        sw_txhdr->pool_cpu = -1;
+    return sw_txhdr;
+}
+
+void rwnx_sw_txhdr_free(struct rwnx_hw *rwnx_hw, struct rwnx_sw_txhdr *sw_txhdr)
+{
+    if (sw_txhdr->pool_cpu < 0) {
+        kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
+        return;
+    }
+    /* back to the CPU that owns it, whatever CPU completes the frame */
+    llist_add(&sw_txhdr->pool_node,
+              &per_cpu_ptr(rwnx_hw->sw_txhdr_pool, sw_txhdr->pool_cpu)->free);
+}
+#endif
+
 u16 rwnx_select_txq(struct rwnx_vif *rwnx_vif, struct sk_buff *skb)
 {
     struct rwnx_hw *rwnx_hw = rwnx_vif->rwnx_hw;
@@ -332,20 +411,14 @@ u16 rwnx_select_txq(struct rwnx_vif *rwnx_vif, struct sk_buff *skb)
     case NL80211_IFTYPE_AP:
     case NL80211_IFTYPE_P2P_GO:
     {
-        struct rwnx_sta *cur;
         struct ethhdr *eth = (struct ethhdr *)skb->data;
 
         if (is_multicast_ether_addr(eth->h_dest)) {
             sta = &rwnx_hw->sta_table[rwnx_vif->ap.bcmc_index];
         } else {
-        	spin_lock_bh(&rwnx_vif->rwnx_hw->cb_lock);
-            list_for_each_entry(cur, &rwnx_vif->ap.sta_list, list) {
-                if (!memcmp(cur->mac_addr, eth->h_dest, ETH_ALEN)) {
-                    sta = cur;
-                    break;
-                }
-            }
-			spin_unlock_bh(&rwnx_vif->rwnx_hw->cb_lock);
+            rcu_read_lock();
+            sta = rwnx_vif_sta_lookup(rwnx_vif, eth->h_dest);
+            rcu_read_unlock();
         }
 
         break;
@@ -1236,14 +1309,10 @@ int aic_br_client_tx(struct rwnx_vif *vif, struct sk_buff **pskb)
 
 
 #ifdef CONFIG_FILTER_TCP_ACK
-/* return:
- *      0, msg buf freed by the real driver
- *      others, skb need free by the caller,remember not use msg->skb!
- */
-
-int intf_tx(struct rwnx_hw *priv,struct msg_buf *msg)
+/* sends an ack the filter held back, the skb is always consumed */
+int intf_tx(struct rwnx_hw *priv, struct sk_buff *skb)
 {
-	struct rwnx_vif *rwnx_vif = msg->rwnx_vif;
+	struct rwnx_vif *rwnx_vif = netdev_priv(skb->dev);
 	struct rwnx_hw *rwnx_hw = rwnx_vif->rwnx_hw;
 	struct rwnx_txhdr *txhdr;
 	struct rwnx_sw_txhdr *sw_txhdr;
@@ -1257,12 +1326,8 @@ int intf_tx(struct rwnx_hw *priv,struct msg_buf *msg)
 	u16 frame_len;
 	u16 frame_oft;
 	u8 tid;
-	struct sk_buff *skb=msg->skb;
 	struct ethhdr eth_t;
 
-	move_tcpack_msg(rwnx_hw,msg);
-	kfree(msg);
-
 	memcpy(&eth_t, skb->data, sizeof(struct ethhdr));
 
 	/* Get the STA id and TID information */
@@ -1312,7 +1377,7 @@ int intf_tx(struct rwnx_hw *priv,struct msg_buf *msg)
 	skb_push(skb, headroom);
 
 	txhdr = (struct rwnx_txhdr *)skb->data;
-	sw_txhdr = kmem_cache_alloc(rwnx_hw->sw_txhdr_cache, GFP_ATOMIC);
+	sw_txhdr = rwnx_sw_txhdr_alloc(rwnx_hw);
 	if (unlikely(sw_txhdr == NULL))
 		goto free;
 	txhdr->sw_hdr = sw_txhdr;
@@ -1374,7 +1439,7 @@ int intf_tx(struct rwnx_hw *priv,struct msg_buf *msg)
 	txhdr->hw_hdr.cfm.status.value = 0;
 
 	if (unlikely(rwnx_prep_tx(rwnx_hw, txhdr))) {
-		kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
+		rwnx_sw_txhdr_free(rwnx_hw, sw_txhdr);
 		skb_pull(skb, headroom);
 		dev_kfree_skb_any(skb);
 		return NETDEV_TX_BUSY;
@@ -1407,6 +1472,129 @@ free:
 }
 #endif
 
+#ifdef CONFIG_TX_BQL
+/*
+ * dql_completed() needs its callers serialized, completions come from urb
+ * completion, the cfm path and the flush/drop paths: all go through bql_lock.
+ */
+void rwnx_tx_bql_done(struct sk_buff *skb)
+{
+    struct rwnx_vif *rwnx_vif;
+    unsigned long flags;
+    u32 len = RWNX_TX_CB(skb)->bql_len;
+
+    if (!len)
+        return;
+    RWNX_TX_CB(skb)->bql_len = 0;
+    rwnx_vif = netdev_priv(skb->dev);
+    spin_lock_irqsave(&rwnx_vif->rwnx_hw->bql_lock, flags);
+    netdev_tx_completed_queue(netdev_get_tx_queue(skb->dev, skb_get_queue_mapping(skb)), 1, len);
+    spin_unlock_irqrestore(&rwnx_vif->rwnx_hw->bql_lock, flags);
+}
+
+/* move the accounting of skb to a bus buffer, completed with its urb */
+void rwnx_tx_bql_take(struct sk_buff *skb, struct rwnx_tx_bql *bql, int nb)
+{
+    struct netdev_queue *txq;
+    u32 len = RWNX_TX_CB(skb)->bql_len;
+    int i;
+
+    if (!len)
+        return;
+    txq = netdev_get_tx_queue(skb->dev, skb_get_queue_mapping(skb));
+    //slots are filled in order and emptied all at once
+    for (i = 0; i < nb; i++) {
+        if (bql[i].len && bql[i].txq != txq)
+            continue;
+        bql[i].txq = txq;
+        bql[i].len += len;
+        bql[i].pkts++;
+        RWNX_TX_CB(skb)->bql_len = 0;
+        return;
+    }
+    //more netdev queues in one buffer than slots, complete it now
+    rwnx_tx_bql_done(skb);
+}
+
+void rwnx_tx_bql_complete(struct rwnx_hw *rwnx_hw, struct rwnx_tx_bql *bql, int nb)
+{
+    unsigned long flags;
+    int i;
+
+    if (!bql[0].len)
+        return;
+    spin_lock_irqsave(&rwnx_hw->bql_lock, flags);
+    for (i = 0; i < nb && bql[i].len; i++) {
+        netdev_tx_completed_queue(bql[i].txq, bql[i].pkts, bql[i].len);
+        bql[i].len = 0;
+        bql[i].pkts = 0;
+    }
+    spin_unlock_irqrestore(&rwnx_hw->bql_lock, flags);
+}
+#endif
+
+#ifdef CONFIG_RWNX_XMIT_MORE
+/* Call with tx_lock held */
+static void __rwnx_xmit_batch_flush(struct rwnx_hw *rwnx_hw)
+{
+    struct rwnx_xmit_batch *batch = &rwnx_hw->xmit_batch;
+    int hwq;
+
+    if (batch->held) {
+        batch->flushes++;
+        batch->frames += batch->held;
+        batch->held = 0;
+    }
+    for_each_set_bit(hwq, &batch->hwqs, NX_TXQ_CNT)
+        rwnx_hwq_process(rwnx_hw, &rwnx_hw->hwq[hwq]);
+    batch->hwqs = 0;
+}
+
+/**
+ * rwnx_xmit_batch_flush - Push the hwqs left behind by a burst
+ *
+ * @rwnx_hw: Driver main data
+ *
+ * The frames are already in their txq, so this only matters when the
+ * netdev queue got stopped by another context in the middle of a burst
+ * and the stack will not call rwnx_start_xmit again. Called from the
+ * bustx thread, which tx completions kick while a burst is pending.
+ */
+void rwnx_xmit_batch_flush(struct rwnx_hw *rwnx_hw)
+{
+    if (!READ_ONCE(rwnx_hw->xmit_batch.hwqs))
+        return;
+
+    spin_lock_bh(&rwnx_hw->tx_lock);
+    __rwnx_xmit_batch_flush(rwnx_hw);
+    spin_unlock_bh(&rwnx_hw->tx_lock);
+}
+
+/**
+ * rwnx_xmit_batch_end - Push the hwqs touched by rwnx_start_xmit
+ *
+ * @rwnx_hw: Driver main data
+ * @dev: Netdev of the current frame
+ * @queue: Netdev queue of the current frame
+ * @more: rwnx_xmit_more() of the current frame
+ *
+ * Called on every exit of rwnx_start_xmit. Keeps deferring the push while
+ * the stack has more frames for this netdev queue, it is not stopped and
+ * the burst is short enough. Otherwise processes each touched hwq once.
+ */
+static void rwnx_xmit_batch_end(struct rwnx_hw *rwnx_hw, struct net_device *dev,
+                                u16 queue, bool more)
+{
+    if (more && READ_ONCE(rwnx_hw->xmit_batch.held) < RWNX_XMIT_BATCH_MAX &&
+        !netif_xmit_stopped(netdev_get_tx_queue(dev, queue)))
+        return;
+
+    spin_lock_bh(&rwnx_hw->tx_lock);
+    __rwnx_xmit_batch_flush(rwnx_hw);
+    spin_unlock_bh(&rwnx_hw->tx_lock);
+}
+#endif
+
 
 /**
  * netdev_tx_t (*ndo_start_xmit)(struct sk_buff *skb,
@@ -1420,7 +1608,11 @@ free:
  *  - If possible (i.e. credit available and not in PS) the pkt is pushed
  *    to fw
  */
+#ifdef CONFIG_RWNX_XMIT_MORE
+static netdev_tx_t rwnx_start_xmit_one(struct sk_buff *skb, struct net_device *dev)
+#else
 netdev_tx_t rwnx_start_xmit(struct sk_buff *skb, struct net_device *dev)
+#endif
 {
     struct rwnx_vif *rwnx_vif = netdev_priv(dev);
     struct rwnx_hw *rwnx_hw = rwnx_vif->rwnx_hw;
@@ -1438,9 +1630,6 @@ netdev_tx_t rwnx_start_xmit(struct sk_buff *skb, struct net_device *dev)
     u8 tid;
     
     struct ethhdr eth_t;
-#ifdef CONFIG_FILTER_TCP_ACK
-    struct msg_buf *msgbuf;
-#endif
 
 #ifdef CONFIG_ONE_TXQ
     skb->queue_mapping = rwnx_select_txq(rwnx_vif, skb);
@@ -1462,22 +1651,17 @@ netdev_tx_t rwnx_start_xmit(struct sk_buff *skb, struct net_device *dev)
 
         skb = newskb;
     }
+#ifdef CONFIG_TX_BQL
+    //cb still holds the stack's data, nothing accounted yet
+    RWNX_TX_CB(skb)->bql_len = 0;
+#endif
 
 	if(skb->priority < 3)
 		skb->priority = 0;
 
 #ifdef CONFIG_FILTER_TCP_ACK
-	if(cpu_to_le16(skb->len) <= MAX_TCP_ACK){
-        msgbuf=intf_tcp_alloc_msg(msgbuf);
-        msgbuf->rwnx_vif=rwnx_vif;
-        msgbuf->skb=skb;
-        if(filter_send_tcp_ack(rwnx_hw,msgbuf,skb->data,cpu_to_le16(skb->len))){
-            return NETDEV_TX_OK;
-        }else{
-            move_tcpack_msg(rwnx_hw,msgbuf);
-            kfree(msgbuf);
-        }
-	}
+	if (skb->len <= MAX_TCP_ACK && filter_send_tcp_ack(rwnx_hw, skb))
+		return NETDEV_TX_OK;
 #endif
     memcpy(&eth_t, skb->data, sizeof(struct ethhdr));
 
@@ -1527,7 +1711,7 @@ netdev_tx_t rwnx_start_xmit(struct sk_buff *skb, struct net_device *dev)
     skb_push(skb, headroom);
 
     txhdr = (struct rwnx_txhdr *)skb->data;
-    sw_txhdr = kmem_cache_alloc(rwnx_hw->sw_txhdr_cache, GFP_ATOMIC);
+    sw_txhdr = rwnx_sw_txhdr_alloc(rwnx_hw);
 
     if (unlikely(sw_txhdr == NULL))
         goto free;
@@ -1589,7 +1773,7 @@ netdev_tx_t rwnx_start_xmit(struct sk_buff *skb, struct net_device *dev)
     txhdr->hw_hdr.cfm.status.value = 0;
 
     if (unlikely(rwnx_prep_tx(rwnx_hw, txhdr))) {
-        kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
+        rwnx_sw_txhdr_free(rwnx_hw, sw_txhdr);
         skb_pull(skb, headroom);
         dev_kfree_skb_any(skb);
         return NETDEV_TX_BUSY;
@@ -1608,9 +1792,17 @@ netdev_tx_t rwnx_start_xmit(struct sk_buff *skb, struct net_device *dev)
 #endif
     desc->host.status_desc_addr = sw_txhdr->dma_addr;
 
+    rwnx_tx_bql_sent(skb);
     spin_lock_bh(&rwnx_hw->tx_lock);
+#ifdef CONFIG_RWNX_XMIT_MORE
+    /* hwq pushed by rwnx_xmit_batch_end */
+    if (rwnx_txq_queue_skb(skb, txq, rwnx_hw, false))
+        __set_bit(txq->hwq->id, &rwnx_hw->xmit_batch.hwqs);
+    rwnx_hw->xmit_batch.held++;
+#else
     if (rwnx_txq_queue_skb(skb, txq, rwnx_hw, false))
         rwnx_hwq_process(rwnx_hw, txq->hwq);
+#endif
     spin_unlock_bh(&rwnx_hw->tx_lock);
 
     return NETDEV_TX_OK;
@@ -1621,6 +1813,24 @@ free:
     return NETDEV_TX_OK;
 }
 
+#ifdef CONFIG_RWNX_XMIT_MORE
+netdev_tx_t rwnx_start_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+    struct rwnx_vif *rwnx_vif = netdev_priv(dev);
+    bool more = rwnx_xmit_more(skb);
+    u16 queue = skb_get_queue_mapping(skb);
+    netdev_tx_t ret;
+
+    ret = rwnx_start_xmit_one(skb, dev);
+    /* the stack stops the burst on busy */
+    if (ret != NETDEV_TX_OK)
+        more = false;
+    rwnx_xmit_batch_end(rwnx_vif->rwnx_hw, dev, queue, more);
+
+    return ret;
+}
+#endif
+
 /**
  * rwnx_start_mgmt_xmit - Transmit a management frame
  *
@@ -1758,7 +1968,7 @@ int rwnx_start_mgmt_xmit(struct rwnx_vif *vif, struct rwnx_sta *sta,
     //----------------------------------------------------------------------
 
     /* Fill the SW TX Header */
-    sw_txhdr = kmem_cache_alloc(rwnx_hw->sw_txhdr_cache, GFP_ATOMIC);
+    sw_txhdr = rwnx_sw_txhdr_alloc(rwnx_hw);
 	
     if (unlikely(sw_txhdr == NULL)) {
         dev_kfree_skb(skb);
@@ -1806,7 +2016,7 @@ int rwnx_start_mgmt_xmit(struct rwnx_vif *vif, struct rwnx_sta *sta,
 
     /* Get DMA Address */
     if (unlikely(rwnx_prep_tx(rwnx_hw, txhdr))) {
-        kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
+        rwnx_sw_txhdr_free(rwnx_hw, sw_txhdr);
         dev_kfree_skb(skb);
         return -EBUSY;
     }
@@ -1914,7 +2124,7 @@ void rwnx_probersp_work(struct work_struct *work)
 	skb_push(skb, headroom);
 	txhdr = (struct rwnx_txhdr *)skb->data;
 	txhdr->hw_hdr.cfm.status.value = 0;
-	sw_txhdr = kmem_cache_alloc(rwnx_hw->sw_txhdr_cache, GFP_ATOMIC);
+	sw_txhdr = rwnx_sw_txhdr_alloc(rwnx_hw);
 	if (unlikely(sw_txhdr == NULL)) {
 		AICWFDBG(LOGERROR, "%s cache fail\n", __func__);
 		goto fail;
@@ -1960,7 +2170,7 @@ void rwnx_probersp_work(struct work_struct *work)
 
 fail:
 	if (sw_txhdr)
-		kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
+		rwnx_sw_txhdr_free(rwnx_hw, sw_txhdr);
 	dev_kfree_skb(skb);
 free_use:
 	if (rsp->in_use)
@@ -2264,7 +2474,7 @@ netdev_tx_t rwnx_start_monitor_if_xmit(struct sk_buff *skb, struct net_device *d
     txhdr = (struct rwnx_txhdr *)skb_mgmt->data;
     txhdr->hw_hdr.cfm.status.value = 0;
     /* Fill the SW TX Header */
-    sw_txhdr = kmem_cache_alloc(rwnx_hw->sw_txhdr_cache, GFP_ATOMIC);
+    sw_txhdr = rwnx_sw_txhdr_alloc(rwnx_hw);
     if (unlikely(sw_txhdr == NULL)) {
         dev_kfree_skb(skb_mgmt);
         AICWFDBG(LOGERROR, "sw_txhdr alloc fail\n");
@@ -2353,8 +2563,9 @@ int rwnx_txdatacfm(void *pthis, void *host_id)
 #ifdef AICWF_USB_SUPPORT
     if (rwnx_hw->usbdev->state == USB_DOWN_ST) {
         headroom = sw_txhdr->headroom;
-        kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
+        rwnx_sw_txhdr_free(rwnx_hw, sw_txhdr);
         skb_pull(skb, headroom);
+        rwnx_tx_bql_done(skb);
         consume_skb(skb);
         return 0;
     }
@@ -2362,8 +2573,9 @@ int rwnx_txdatacfm(void *pthis, void *host_id)
 #ifdef AICWF_SDIO_SUPPORT
     if(rwnx_hw->sdiodev->bus_if->state == BUS_DOWN_ST) {
         headroom = sw_txhdr->headroom;
-        kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
+        rwnx_sw_txhdr_free(rwnx_hw, sw_txhdr);
         skb_pull(skb, headroom);
+        rwnx_tx_bql_done(skb);
         consume_skb(skb);
         return 0;
     }
@@ -2449,8 +2661,9 @@ int rwnx_txdatacfm(void *pthis, void *host_id)
 #endif /* CONFIG_RWNX_AMSDUS_TX */
 
     headroom = sw_txhdr->headroom;
-    kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
+    rwnx_sw_txhdr_free(rwnx_hw, sw_txhdr);
     skb_pull(skb, headroom);
+    rwnx_tx_bql_done(skb);
     consume_skb(skb);
 
     return 0;
@@ -13,6 +13,7 @@
 #include <linux/ieee80211.h>
 #include <net/cfg80211.h>
 #include <linux/netdevice.h>
+#include <linux/llist.h>
 #include "lmac_types.h"
 #include "ipc_shared.h"
 #include "rwnx_txq.h"
@@ -136,6 +137,10 @@ struct rwnx_sw_txhdr {
     u8 raw_frame;
     u8 fixed_rate;
     u16 rate_config;
+#ifdef CONFIG_RWNX_SW_TXHDR_POOL
+    struct llist_node pool_node;
+    s16 pool_cpu;       /* -1 when allocated from sw_txhdr_cache */
+#endif
 };
 
 /**
@@ -198,5 +203,41 @@ void rwnx_tx_push(struct rwnx_hw *rwnx_hw, struct rwnx_txhdr *txhdr, int flags);
 void rwnx_probersp_work(struct work_struct *work);
 #endif
 
+#if defined(CONFIG_TX_BQL) || defined(CONFIG_RWNX_TXQ_CODEL)
+/* skb->cb on the data path */
+struct rwnx_tx_cb {
+#ifdef CONFIG_TX_BQL
+    u32 bql_len;        /* only set by rwnx_start_xmit */
+#endif
+#ifdef CONFIG_RWNX_TXQ_CODEL
+    u32 enqueue_us;     /* set by rwnx_txq_queue_skb */
+#endif
+};
+#define RWNX_TX_CB(skb) ((struct rwnx_tx_cb *)(skb)->cb)
+#endif
+
+#ifdef CONFIG_TX_BQL
+/* bytes of one netdev queue handed to a bus buffer, completed with it */
+struct rwnx_tx_bql {
+    struct netdev_queue *txq;
+    u32 len;
+    u32 pkts;
+};
+
+static inline void rwnx_tx_bql_sent(struct sk_buff *skb)
+{
+    RWNX_TX_CB(skb)->bql_len = skb->len;
+    netdev_tx_sent_queue(netdev_get_tx_queue(skb->dev, skb_get_queue_mapping(skb)), skb->len);
+}
+
+/* every accounted skb must come through here or rwnx_tx_bql_take() exactly once */
+void rwnx_tx_bql_done(struct sk_buff *skb);
+void rwnx_tx_bql_take(struct sk_buff *skb, struct rwnx_tx_bql *bql, int nb);
+void rwnx_tx_bql_complete(struct rwnx_hw *rwnx_hw, struct rwnx_tx_bql *bql, int nb);
+#else
+static inline void rwnx_tx_bql_sent(struct sk_buff *skb) {}
+static inline void rwnx_tx_bql_done(struct sk_buff *skb) {}
+#endif
+
 
 #endif /* _RWNX_TX_H_ */
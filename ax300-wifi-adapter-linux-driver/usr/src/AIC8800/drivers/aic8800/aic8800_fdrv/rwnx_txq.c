@@ -8,6 +8,9 @@
  ******************************************************************************
  */
 
+#ifdef CONFIG_RWNX_TXQ_CODEL
+#include <net/inet_ecn.h>
+#endif
 #include "rwnx_defs.h"
 #include "rwnx_tx.h"
 #include "ipc_host.h"
@@ -143,40 +146,54 @@ static void rwnx_txq_init(struct rwnx_txq *txq, int idx, u8 status,
     txq->amsdu_len = 0;
 #endif /* CONFIG_RWNX_AMSDUS_TX */
 #endif /* CONFIG_RWNX_FULLMAC */
+#ifdef CONFIG_RWNX_TXQ_CODEL
+    memset(&txq->codel, 0, sizeof(txq->codel));
+#endif
 }
 
 /**
- * rwnx_txq_flush - Flush all buffers queued for a TXQ
+ * rwnx_txq_free_skb - Free a buffer that was queued but never pushed
  *
- * @rwnx_hw: main driver data
- * @txq: txq to flush
+ * @rwnx_hw: Driver main data
+ * @skb: Buffer, with its rwnx_txhdr in headroom
  */
-void rwnx_txq_flush(struct rwnx_hw *rwnx_hw, struct rwnx_txq *txq)
+static void rwnx_txq_free_skb(struct rwnx_hw *rwnx_hw, struct sk_buff *skb)
 {
-    struct sk_buff *skb;
-
-
-    while((skb = skb_dequeue(&txq->sk_list)) != NULL) {
-        struct rwnx_sw_txhdr *sw_txhdr = ((struct rwnx_txhdr *)skb->data)->sw_hdr;
+    struct rwnx_sw_txhdr *sw_txhdr = ((struct rwnx_txhdr *)skb->data)->sw_hdr;
 
 #ifdef CONFIG_RWNX_AMSDUS_TX
-        if (sw_txhdr->desc.host.packet_cnt > 1) {
-            struct rwnx_amsdu_txhdr *amsdu_txhdr;
-            list_for_each_entry(amsdu_txhdr, &sw_txhdr->amsdu.hdrs, list) {
-                //dma_unmap_single(rwnx_hw->dev, amsdu_txhdr->dma_addr,
-                  //               amsdu_txhdr->map_len, DMA_TO_DEVICE);
-                dev_kfree_skb_any(amsdu_txhdr->skb);
-            }
+    if (sw_txhdr->desc.host.packet_cnt > 1) {
+        struct rwnx_amsdu_txhdr *amsdu_txhdr;
+        list_for_each_entry(amsdu_txhdr, &sw_txhdr->amsdu.hdrs, list) {
+            //dma_unmap_single(rwnx_hw->dev, amsdu_txhdr->dma_addr,
+              //               amsdu_txhdr->map_len, DMA_TO_DEVICE);
+            dev_kfree_skb_any(amsdu_txhdr->skb);
         }
+    }
 #endif
-        kmem_cache_free(rwnx_hw->sw_txhdr_cache, sw_txhdr);
-        //dma_unmap_single(rwnx_hw->dev, sw_txhdr->dma_addr, sw_txhdr->map_len,
-          //               DMA_TO_DEVICE);
+    rwnx_sw_txhdr_free(rwnx_hw, sw_txhdr);
+    //dma_unmap_single(rwnx_hw->dev, sw_txhdr->dma_addr, sw_txhdr->map_len,
+      //               DMA_TO_DEVICE);
 
 #ifdef CONFIG_RWNX_FULLMAC
-        dev_kfree_skb_any(skb);
+    rwnx_tx_bql_done(skb);
+    dev_kfree_skb_any(skb);
 #endif /* CONFIG_RWNX_FULLMAC */
-    }
+}
+
+/**
+ * rwnx_txq_flush - Flush all buffers queued for a TXQ
+ *
+ * @rwnx_hw: main driver data
+ * @txq: txq to flush
+ */
+void rwnx_txq_flush(struct rwnx_hw *rwnx_hw, struct rwnx_txq *txq)
+{
+    struct sk_buff *skb;
+
+
+    while((skb = skb_dequeue(&txq->sk_list)) != NULL)
+        rwnx_txq_free_skb(rwnx_hw, skb);
 }
 
 /**
@@ -281,6 +298,9 @@ void rwnx_txq_sta_init(struct rwnx_hw *rwnx_hw, struct rwnx_sta *rwnx_sta,
         txq->ps_id = rwnx_sta->uapsd_tids & (1 << tid) ? UAPSD_ID : LEGACY_PS_ID;
         idx++;
     }
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+    memset(&rwnx_sta->airtime, 0, sizeof(rwnx_sta->airtime));
+#endif
 
 #endif /* CONFIG_RWNX_FULLMAC*/
 }
@@ -841,6 +861,9 @@ int rwnx_txq_queue_skb(struct sk_buff *skb, struct rwnx_txq *txq,
 #endif
 
     if (!retry) {
+#ifdef CONFIG_RWNX_TXQ_CODEL
+        RWNX_TX_CB(skb)->enqueue_us = (u32)ktime_to_us(ktime_get());
+#endif
         /* add buffer in the sk_list */
         skb_queue_tail(&txq->sk_list, skb);
     } else {
@@ -1200,6 +1223,199 @@ bool rwnx_txq_select_user(struct rwnx_hw *rwnx_hw, bool mu_lock,
     return true;
 }
 
+#ifdef RWNX_HWQ_BACKPRESSURE
+/* Frames pushed past this point only wait in the bus queue, out of reach of
+ * the DRR order and of CoDel. Stop there, rwnx_hwq_resume() goes on from tx
+ * completion. */
+static inline bool rwnx_hwq_bus_busy(struct rwnx_hw *rwnx_hw)
+{
+    return READ_ONCE(rwnx_hw->usbdev->tbusy) ||
+           atomic_read(&rwnx_hw->usbdev->tx_free_count) < AICWF_USB_TX_LOW_WATER;
+}
+#endif
+
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+/* deficit added per DRR round, in us of estimated airtime */
+int airtime_quantum = 300;
+module_param(airtime_quantum, int, 0660);
+MODULE_PARM_DESC(airtime_quantum, "airtime DRR quantum in us, 0 disables airtime fairness");
+
+/* rate assumed until a frame has been received from the STA, 100kbps */
+#define RWNX_AIRTIME_DEFAULT_RATE   540
+
+static inline struct rwnx_sta *rwnx_txq_airtime_sta(struct rwnx_txq *txq)
+{
+    /* PS service periods are served as requested, bcmc/unknown txqs always */
+    if (!txq->sta || txq->sta->sta_idx >= NX_REMOTE_STA_MAX || txq->push_limit)
+        return NULL;
+    return txq->sta;
+}
+
+static u32 rwnx_txq_airtime(struct rwnx_sta *sta, struct sk_buff *skb)
+{
+    struct rwnx_txhdr *txhdr = (struct rwnx_txhdr *)skb->data;
+    u32 rate = READ_ONCE(sta->airtime.rate);
+
+    if (!rate)
+        rate = RWNX_AIRTIME_DEFAULT_RATE;
+    /* bytes * 8 / (rate / 10) */
+    return DIV_ROUND_UP(txhdr->sw_hdr->frame_len * 80, rate);
+}
+
+/**
+ * rwnx_hwq_airtime_refill - Start a new DRR round if no STA can be served
+ *
+ * Adds the same multiple of the quantum to every STA with a txq in the list,
+ * enough for the least indebted one to become positive. Equivalent to
+ * skipping all of them round after round, without looping.
+ * txqs not scheduled by airtime (bcmc, PS service period) are ignored.
+ */
+static void rwnx_hwq_airtime_refill(struct rwnx_hwq *hwq, int quantum)
+{
+    struct rwnx_txq *txq;
+    struct rwnx_sta *sta;
+    s32 max = S32_MIN, refill;
+
+    list_for_each_entry(txq, &hwq->list, sched_list) {
+        sta = rwnx_txq_airtime_sta(txq);
+        if (!sta)
+            continue;
+        if (sta->airtime.deficit[hwq->id] > 0)
+            return;
+        max = max(max, sta->airtime.deficit[hwq->id]);
+    }
+    if (max == S32_MIN)
+        return;
+
+    refill = DIV_ROUND_UP(1 - max, quantum) * quantum;
+    hwq->airtime_round++;
+    list_for_each_entry(txq, &hwq->list, sched_list) {
+        sta = rwnx_txq_airtime_sta(txq);
+        /* several tids of a STA may share the hwq */
+        if (!sta || sta->airtime.round[hwq->id] == hwq->airtime_round)
+            continue;
+        sta->airtime.round[hwq->id] = hwq->airtime_round;
+        sta->airtime.deficit[hwq->id] += refill;
+    }
+}
+#endif
+
+#ifdef CONFIG_RWNX_TXQ_CODEL
+/* CoDel on the time buffers wait in a txq, same defaults as mac80211. Under
+ * bus backpressure buffers stay in their txq, so this includes the bus wait */
+static int txq_codel_target = 20000;
+module_param(txq_codel_target, int, 0660);
+MODULE_PARM_DESC(txq_codel_target, "txq CoDel sojourn target in us, 0 disables it");
+
+static int txq_codel_interval = 100000;
+module_param(txq_codel_interval, int, 0660);
+MODULE_PARM_DESC(txq_codel_interval, "txq CoDel interval in us");
+
+static bool txq_codel_ecn = true;
+module_param(txq_codel_ecn, bool, 0660);
+MODULE_PARM_DESC(txq_codel_ecn, "Mark ECN capable frames instead of dropping them");
+
+static inline u32 rwnx_txq_codel_now(void)
+{
+    return (u32)ktime_to_us(ktime_get());
+}
+
+/* PS service periods, mgmt txqs and STAs in PS keep all their buffers */
+static inline bool rwnx_txq_codel_on(struct rwnx_txq *txq)
+{
+    return READ_ONCE(txq_codel_target) > 0 &&
+           txq->ndev_idx != NDEV_NO_TXQ && !txq->push_limit &&
+           !(txq->sta && txq->sta->ps.active);
+}
+
+/* t + interval / sqrt(count) */
+static u32 rwnx_txq_codel_next(u32 t, u32 interval, u32 count)
+{
+    count = min_t(u32, count, 4095);
+    return t + (u32)div_u64((u64)interval << 10, int_sqrt(count << 20));
+}
+
+static bool rwnx_txq_codel_above(struct rwnx_txq_codel *codel, u32 sojourn,
+                                 u32 now, u32 target, u32 interval, bool last)
+{
+    if (sojourn < target || last) {
+        codel->first_above = 0;
+        return false;
+    }
+    if (!codel->first_above) {
+        codel->first_above = (now + interval) ?: 1;
+        return false;
+    }
+    return (s32)(now - codel->first_above) >= 0;
+}
+
+/**
+ * rwnx_txq_codel_drop - CoDel decision for a buffer about to be pushed
+ *
+ * @rwnx_hw: Driver main data
+ * @txq: TX queue the buffer was taken from
+ * @skb: Buffer
+ * @sk_list_push: Buffers still to push after this one
+ * @now: Current time, from rwnx_txq_codel_now()
+ *
+ * @return true if the buffer must be dropped. ECN capable buffers are marked
+ * instead and pushed. The last buffer of the txq, retries and A-MSDU under
+ * construction are never dropped.
+ *
+ * To be called with tx_lock hold
+ */
+static bool rwnx_txq_codel_drop(struct rwnx_hw *rwnx_hw, struct rwnx_txq *txq,
+                                struct sk_buff *skb,
+                                struct sk_buff_head *sk_list_push, u32 now)
+{
+    struct rwnx_txq_codel *codel = &txq->codel;
+    u32 target = READ_ONCE(txq_codel_target);
+    u32 interval = READ_ONCE(txq_codel_interval);
+    bool above;
+
+    if (txq->nb_retry)
+        return false;
+#ifdef CONFIG_RWNX_AMSDUS_TX
+    if (((struct rwnx_txhdr *)skb->data)->sw_hdr == txq->amsdu)
+        return false;
+#endif
+
+    above = rwnx_txq_codel_above(codel, now - RWNX_TX_CB(skb)->enqueue_us,
+                                 now, target, interval,
+                                 skb_queue_empty(sk_list_push) &&
+                                 skb_queue_empty(&txq->sk_list));
+    if (codel->dropping) {
+        if (!above) {
+            codel->dropping = false;
+            return false;
+        }
+        if ((s32)(now - codel->drop_next) < 0)
+            return false;
+        codel->count++;
+        codel->drop_next = rwnx_txq_codel_next(codel->drop_next, interval,
+                                               codel->count);
+    } else {
+        if (!above)
+            return false;
+        codel->dropping = true;
+        /* resume near the drop rate that controlled the queue last time */
+        if (codel->count - codel->lastcount > 1 &&
+            (s32)(now - codel->drop_next) < (s32)(16 * interval))
+            codel->count -= codel->lastcount;
+        else
+            codel->count = 1;
+        codel->lastcount = codel->count;
+        codel->drop_next = rwnx_txq_codel_next(now, interval, codel->count);
+    }
+
+    if (READ_ONCE(txq_codel_ecn) && INET_ECN_set_ce(skb)) {
+        rwnx_hw->stats.codel_marks++;
+        return false;
+    }
+    rwnx_hw->stats.codel_drops++;
+    return true;
+}
+#endif
 
 /**
  * rwnx_hwq_process - Process one HW queue list
@@ -1236,6 +1452,20 @@ void rwnx_hwq_process(struct rwnx_hw *rwnx_hw, struct rwnx_hwq *hwq)
 #ifndef CONFIG_ONE_TXQ
     unsigned long flags;
 #endif
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+    int quantum = READ_ONCE(airtime_quantum);
+    struct rwnx_sta *sta;
+    u32 airtime;
+    bool skipped, pushed;
+#endif
+#ifdef CONFIG_RWNX_TXQ_CODEL
+    struct rwnx_vif *vif;
+    bool codel;
+    u32 now;
+#endif
+#ifdef RWNX_HWQ_BACKPRESSURE
+    bool hold;
+#endif
 #ifdef CREATE_TRACE_POINTS
     trace_process_hw_queue(hwq);
 #endif
@@ -1245,6 +1475,14 @@ void rwnx_hwq_process(struct rwnx_hw *rwnx_hw, struct rwnx_hwq *hwq)
     if (!mu_enable)
         credit_map = ALL_HWQ_MASK - 1;
 
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+    if (quantum > 0)
+        rwnx_hwq_airtime_refill(hwq, quantum);
+again:
+    skipped = false;
+    pushed = false;
+#endif
+
     list_for_each_entry_safe(txq, next, &hwq->list, sched_list) {
         struct rwnx_txhdr *txhdr = NULL;
         struct sk_buff_head sk_list_push;
@@ -1265,17 +1503,78 @@ void rwnx_hwq_process(struct rwnx_hw *rwnx_hw, struct rwnx_hwq *hwq)
         BUG_ON(txq->credits <= 0);
         BUG_ON(!rwnx_txq_skb_ready(txq));
 
+#ifdef RWNX_HWQ_BACKPRESSURE
+        hold = false;
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+        sta = quantum > 0 ? rwnx_txq_airtime_sta(txq) : NULL;
+        hold |= sta != NULL;
+#endif
+#ifdef CONFIG_RWNX_TXQ_CODEL
+        codel = rwnx_txq_codel_on(txq);
+        hold |= codel;
+#endif
+        if (hold && rwnx_hwq_bus_busy(rwnx_hw)) {
+            hwq->need_processing = true;
+            break;
+        }
+#endif
+
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+        /* out of deficit for this round, wait for the next refill */
+        if (sta && sta->airtime.deficit[hwq->id] <= 0) {
+            skipped = true;
+            continue;
+        }
+#endif
+
         if (!rwnx_txq_select_user(rwnx_hw, mu_enable, txq, hwq, &user))
             continue;
 
         txq_empty = rwnx_txq_get_skb_to_push(rwnx_hw, hwq, txq, user,
                                              &sk_list_push);
+#ifdef CONFIG_RWNX_TXQ_CODEL
+        now = codel ? rwnx_txq_codel_now() : 0;
+#endif
 
         while ((skb = __skb_dequeue(&sk_list_push)) != NULL) {
+#ifdef CONFIG_RWNX_TXQ_CODEL
+            if (codel && rwnx_txq_codel_drop(rwnx_hw, txq, skb, &sk_list_push, now)) {
+                vif = netdev_priv(txq->ndev);
+                vif->net_stats.tx_dropped++;
+                rwnx_txq_free_skb(rwnx_hw, skb);
+                continue;
+            }
+#endif
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+            if (sta) {
+                if (sta->airtime.deficit[hwq->id] <= 0 || rwnx_hwq_bus_busy(rwnx_hw)) {
+                    __skb_queue_head(&sk_list_push, skb);
+                    break;
+                }
+                /* before the push, the bus may release the sw header */
+                airtime = rwnx_txq_airtime(sta, skb);
+                sta->airtime.deficit[hwq->id] -= airtime;
+                sta->airtime.tx_us[hwq->id] += airtime;
+                sta->airtime.tx_pkts[hwq->id]++;
+                pushed = true;
+            }
+#endif
             txhdr = (struct rwnx_txhdr *)skb->data;
             rwnx_tx_push(rwnx_hw, txhdr, 0);
         }
 
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+        if (!skb_queue_empty(&sk_list_push)) {
+            /* deficit spent or bus full: give back the rest, the others go first */
+            skb_queue_splice(&sk_list_push, &txq->sk_list);
+            txq_empty = false;
+            if (rwnx_txq_is_scheduled(txq)) {
+                txq->pkt_sent = 0;
+                list_move_tail(&txq->sched_list, &hwq->list);
+            }
+        }
+#endif
+
         if (txq_empty) {
             rwnx_txq_del_from_hw_list(txq);
             txq->pkt_sent = 0;
@@ -1319,11 +1618,38 @@ void rwnx_hwq_process(struct rwnx_hw *rwnx_hw, struct rwnx_hwq *hwq)
 #endif /* CONFIG_RWNX_FULLMAC */
     }
 
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+    /* only indebted txqs are left and the bus still has room: start a new
+       round rather than wait for another event to call us */
+    if (skipped && pushed && !rwnx_hwq_bus_busy(rwnx_hw)) {
+        rwnx_hwq_airtime_refill(hwq, quantum);
+        goto again;
+    }
+#endif
 
     if (mu_enable)
         rwnx_txq_release_mu_lock(rwnx_hw);
 }
 
+#ifdef RWNX_HWQ_BACKPRESSURE
+/**
+ * rwnx_hwq_resume - Go on with the hwqs stopped by bus backpressure
+ *
+ * @rwnx_hw: Driver main data
+ *
+ * Called from the bustx thread once tx completions made room on the bus.
+ */
+void rwnx_hwq_resume(struct rwnx_hw *rwnx_hw)
+{
+    if (rwnx_hwq_bus_busy(rwnx_hw))
+        return;
+
+    spin_lock_bh(&rwnx_hw->tx_lock);
+    rwnx_hwq_process_all(rwnx_hw);
+    spin_unlock_bh(&rwnx_hw->tx_lock);
+}
+#endif
+
 /**
  * rwnx_hwq_process_all - Process all HW queue list
  *
@@ -16,6 +16,12 @@
 
 #include <net/mac80211.h>
 
+/* DRR and CoDel only work on frames still in their txq: keep them there
+ * while the bus is busy, see rwnx_hwq_resume() */
+#if defined(CONFIG_RWNX_AIRTIME_FAIR) || defined(CONFIG_RWNX_TXQ_CODEL)
+#define RWNX_HWQ_BACKPRESSURE
+#endif
+
 #ifdef CONFIG_RWNX_FULLMAC
 /**
  * Fullmac TXQ configuration:
@@ -134,6 +140,9 @@ struct rwnx_hwq {
     u8 size;
     u8 id;
     bool need_processing;
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+    u32 airtime_round;      /* bumped on each deficit refill */
+#endif
 };
 
 /**
@@ -177,6 +186,28 @@ enum rwnx_txq_flags {
 };
 
 
+#ifdef CONFIG_RWNX_TXQ_CODEL
+/**
+ * struct rwnx_txq_codel - CoDel state of a TX queue
+ *
+ * @first_above: Time when sojourn will have been above target for an
+ * interval, 0 while below target
+ * @drop_next: Time of the next drop/mark while dropping
+ * @count: Drops/marks since entering the dropping state
+ * @lastcount: @count when the last dropping state was entered
+ * @dropping: Dropping state
+ *
+ * Times are in us (ktime_to_us truncated to 32 bits).
+ */
+struct rwnx_txq_codel {
+    u32 first_above;
+    u32 drop_next;
+    u32 count;
+    u32 lastcount;
+    bool dropping;
+};
+#endif
+
 /**
  * struct rwnx_txq - Structure used to save information relative to
  *                   a RA/TID TX queue
@@ -235,6 +266,9 @@ struct rwnx_txq {
 #ifdef CONFIG_RWNX_MUMIMO_TX
     u8 mumimo_info;
 #endif
+#ifdef CONFIG_RWNX_TXQ_CODEL
+    struct rwnx_txq_codel codel;
+#endif
 };
 
 struct rwnx_sta;
@@ -393,5 +427,14 @@ void rwnx_txq_confirm_any(struct rwnx_hw *rwnx_hw, struct rwnx_txq *txq,
 void rwnx_hwq_init(struct rwnx_hw *rwnx_hw);
 void rwnx_hwq_process(struct rwnx_hw *rwnx_hw, struct rwnx_hwq *hwq);
 void rwnx_hwq_process_all(struct rwnx_hw *rwnx_hw);
+#ifdef RWNX_HWQ_BACKPRESSURE
+void rwnx_hwq_resume(struct rwnx_hw *rwnx_hw);
+#else
+static inline void rwnx_hwq_resume(struct rwnx_hw *rwnx_hw) {}
+#endif
+
+#ifdef CONFIG_RWNX_AIRTIME_FAIR
+extern int airtime_quantum;
+#endif
 
 #endif /* _RWNX_TXQ_H_ */
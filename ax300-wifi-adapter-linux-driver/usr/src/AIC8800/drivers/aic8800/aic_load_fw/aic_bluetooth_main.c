@@ -3,6 +3,7 @@
 #include <linux/version.h>
 
 #include "aicwf_usb.h"
+#include "aicbluetooth.h"
 #include "rwnx_version_gen.h"
 #include "aicwf_rx_prealloc.h"
 #include "aicwf_debug.h"
@@ -63,6 +64,10 @@ static void __exit aic_bluetooth_mod_exit(void)
 #ifdef CONFIG_PREALLOC_TXQ
     aicwf_prealloc_txq_free();
 #endif
+
+#ifdef CONFIG_FW_IMAGE_CACHE
+    aic_fw_cache_flush();
+#endif
 }
 
 
@@ -1,5 +1,13 @@
 #include <linux/version.h>
 #include <linux/vmalloc.h>
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#endif
+#ifdef CONFIG_FW_IMAGE_CACHE
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#endif
 #include "aicbluetooth_cmds.h"
 #include "aicwf_usb.h"
 #include "aic_txrxif.h"
@@ -186,6 +194,11 @@ module_param_string(aic_fw_path, aic_fw_path, FW_PATH_MAX, 0660);
 char saved_sdk_ver[64];
 module_param_string(saved_sdk_ver, saved_sdk_ver,64, 0660);
 #endif
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+/* block writes kept in flight while uploading to ram, 1 for lock step */
+int fw_upload_window = 4;
+module_param(fw_upload_window, int, 0660);
+#endif
 
 
 
@@ -281,6 +294,150 @@ void aic_bt_platform_deinit(struct aic_usb_dev *usbdev)
 #define MD5(x) x[0],x[1],x[2],x[3],x[4],x[5],x[6],x[7],x[8],x[9],x[10],x[11],x[12],x[13],x[14],x[15]
 #define MD5PINRT "file md5:%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x\r\n"
 
+#ifdef CONFIG_FW_IMAGE_CACHE
+/*
+ * Images read by aic_load_firmware() stay cached, keyed by path and mtime,
+ * so a reprobe or a second dongle does not read and hash them again. The
+ * cache list holds one ref and every aic_load_firmware() caller another,
+ * dropped by aic_release_firmware(). Users must not write to the image.
+ */
+struct aic_fw_image {
+    struct list_head list;
+    struct kref ref;
+    char path[FW_PATH_MAX];
+    s64 mtime_sec;
+    long mtime_nsec;
+    int size;
+    u32 crc;
+    unsigned char md5[16];
+    u32 data[];
+};
+
+static LIST_HEAD(aic_fw_cache);
+static DEFINE_MUTEX(aic_fw_cache_lock);
+
+static void aic_fw_image_free(struct kref *ref)
+{
+    vfree(container_of(ref, struct aic_fw_image, ref));
+}
+
+static void aic_fw_image_mtime(struct file *fp, s64 *sec, long *nsec)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+    struct timespec64 ts = inode_get_mtime(file_inode(fp));
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4, 18, 0)
+    struct timespec64 ts = file_inode(fp)->i_mtime;
+#else
+    struct timespec ts = file_inode(fp)->i_mtime;
+#endif
+
+    *sec = ts.tv_sec;
+    *nsec = ts.tv_nsec;
+}
+
+/* fp is NULL for request_firmware() images, which are keyed by name only */
+static u32 *aic_fw_cache_get(const char *path, struct file *fp, int size)
+{
+    struct aic_fw_image *img, *found = NULL;
+    s64 sec = 0;
+    long nsec = 0;
+
+    if (fp)
+        aic_fw_image_mtime(fp, &sec, &nsec);
+
+    mutex_lock(&aic_fw_cache_lock);
+    list_for_each_entry(img, &aic_fw_cache, list) {
+        if (strcmp(img->path, path))
+            continue;
+        if (fp && (img->size != size || img->mtime_sec != sec || img->mtime_nsec != nsec)) {
+            /* file changed on disk, current users keep their ref */
+            list_del(&img->list);
+            kref_put(&img->ref, aic_fw_image_free);
+        } else {
+            kref_get(&img->ref);
+            found = img;
+        }
+        break;
+    }
+    mutex_unlock(&aic_fw_cache_lock);
+
+    if (!found)
+        return NULL;
+    printk("%s: cached, size=%d crc=%08x\n", path, found->size, found->crc);
+    printk(MD5PINRT, MD5(found->md5));
+    return found->data;
+}
+
+/* takes over buf, returns the cached copy or NULL */
+static u32 *aic_fw_cache_add(const char *path, struct file *fp, void *buf, int size)
+{
+    struct aic_fw_image *img;
+    MD5_CTX md5;
+
+    img = vmalloc(sizeof(*img) + size);
+    if (!img) {
+        vfree(buf);
+        return NULL;
+    }
+    memset(img, 0, sizeof(*img));
+    memcpy(img->data, buf, size);
+    vfree(buf);
+
+    snprintf(img->path, sizeof(img->path), "%s", path);
+    if (fp)
+        aic_fw_image_mtime(fp, &img->mtime_sec, &img->mtime_nsec);
+    img->size = size;
+    img->crc = aic_crc32((u8 *)img->data, size, 0xffffffff);
+    MD5Init(&md5);
+    MD5Update(&md5, (unsigned char *)img->data, size);
+    MD5Final(&md5, img->md5);
+    printk(MD5PINRT, MD5(img->md5));
+
+    /* one ref for the cache, one for the caller */
+    kref_init(&img->ref);
+    kref_get(&img->ref);
+    mutex_lock(&aic_fw_cache_lock);
+    list_add(&img->list, &aic_fw_cache);
+    mutex_unlock(&aic_fw_cache_lock);
+
+    return img->data;
+}
+
+static void aic_release_firmware(void *buf)
+{
+    if (buf)
+        kref_put(&container_of((u32 *)buf, struct aic_fw_image, data[0])->ref,
+                 aic_fw_image_free);
+}
+
+void aic_fw_cache_flush(void)
+{
+    struct aic_fw_image *img, *n;
+
+    mutex_lock(&aic_fw_cache_lock);
+    list_for_each_entry_safe(img, n, &aic_fw_cache, list) {
+        list_del(&img->list);
+        kref_put(&img->ref, aic_fw_image_free);
+    }
+    mutex_unlock(&aic_fw_cache_lock);
+}
+
+/* echo 1 > /sys/module/aic_load_fw/parameters/fw_cache_flush */
+static int aic_fw_cache_flush_set(const char *val, const struct kernel_param *kp)
+{
+    aic_fw_cache_flush();
+    printk("fw image cache flushed\n");
+    return 0;
+}
+
+static const struct kernel_param_ops aic_fw_cache_flush_ops = {
+    .set = aic_fw_cache_flush_set,
+};
+module_param_cb(fw_cache_flush, &aic_fw_cache_flush_ops, NULL, 0220);
+#else
+#define aic_release_firmware(buf) vfree(buf)
+#endif
+
 static int aic_load_firmware(u32 ** fw_buf, const char *name, struct device *device)
 {
 
@@ -295,6 +452,11 @@ static int aic_load_firmware(u32 ** fw_buf, const char *name, struct device *dev
 
 	printk("%s: request firmware = %s \n", __func__ ,name);
 
+#ifdef CONFIG_FW_IMAGE_CACHE
+	*fw_buf = aic_fw_cache_get(name, NULL, 0);
+	if (*fw_buf)
+		return container_of(*fw_buf, struct aic_fw_image, data[0])->size;
+#endif
 
 	ret = request_firmware(&fw, name, NULL);
 	
@@ -318,6 +480,11 @@ static int aic_load_firmware(u32 ** fw_buf, const char *name, struct device *dev
 	memset(buffer, 0, size);
 	memcpy(buffer, dst, size);
 	
+#ifdef CONFIG_FW_IMAGE_CACHE
+	release_firmware(fw);
+	*fw_buf = aic_fw_cache_add(name, NULL, buffer, size);
+	return *fw_buf ? size : -1;
+#endif
 	*fw_buf = buffer;
 
 	MD5Init(&md5);
@@ -402,6 +569,15 @@ static int aic_load_firmware(u32 ** fw_buf, const char *name, struct device *dev
             return -1;
 }
 
+#ifdef CONFIG_FW_IMAGE_CACHE
+    *fw_buf = aic_fw_cache_get(path, fp, size);
+    if (*fw_buf) {
+        __putname(path);
+        filp_close(fp, NULL);
+        return size;
+    }
+#endif
+
     /* start to read from firmware file */
     buffer = vmalloc(size);
     memset(buffer, 0, size);
@@ -435,6 +611,13 @@ static int aic_load_firmware(u32 ** fw_buf, const char *name, struct device *dev
             //printk("f_pos=%d\n", (int)fp->f_pos);
     }
 
+#ifdef CONFIG_FW_IMAGE_CACHE
+    *fw_buf = aic_fw_cache_add(path, fp, buffer, size);
+    __putname(path);
+    filp_close(fp, NULL);
+    return *fw_buf ? size : -1;
+#endif
+
 
 #if 0
    /*start to transform the data format*/
@@ -482,16 +665,21 @@ int rwnx_plat_bin_fw_upload_android(struct aic_usb_dev *usbdev, u32 fw_addr,
                                char *filename)
 {
     struct device *dev = usbdev->dev;
-    unsigned int i=0;
+    unsigned int __maybe_unused i=0;
     int size;
     u32 *dst=NULL;
     int err=0;
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    ktime_t start;
+    u64 us;
+    u32 crc;
+#endif
 
     /* load aic firmware */
     size = aic_load_firmware(&dst, filename, dev);
     if(size<=0){
             printk("wrong size of firmware file\n");
-            vfree(dst);
+            aic_release_firmware(dst);
             dst = NULL;
             return -1;
     }
@@ -499,6 +687,21 @@ int rwnx_plat_bin_fw_upload_android(struct aic_usb_dev *usbdev, u32 fw_addr,
     /* Copy the file on the Embedded side */
     printk("### Upload %s firmware, @ = %x  size=%d\n", filename, fw_addr, size);
 
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    crc = aic_crc32((u8 *)dst, size, 0xffffffff);
+    start = ktime_get();
+    err = rwnx_send_dbg_mem_block_write_bulk(usbdev, fw_addr, size, dst, fw_upload_window);
+    us = max_t(s64, ktime_us_delta(ktime_get(), start), 1);
+    if (err) {
+        printk("bin upload fail: %x, err:%d\r\n", fw_addr, err);
+    } else {
+        /* bytes per us is MB/s */
+        u64 mbps = div64_u64((u64)size * 100, us);
+
+        printk("%s: %d bytes in %llu us, %llu.%02llu MB/s, window %d, crc %08x\n",
+               filename, size, us, mbps / 100, mbps % 100, fw_upload_window, crc);
+    }
+#else
     if (size > 1024) {// > 1KB data
         for (i = 0; i < (size - 1024); i += 1024) {//each time write 1KB
             err = rwnx_send_dbg_mem_block_write_req(usbdev, fw_addr + i, 1024, dst + i / 4);
@@ -515,9 +718,10 @@ int rwnx_plat_bin_fw_upload_android(struct aic_usb_dev *usbdev, u32 fw_addr,
             printk("bin upload fail: %x, err:%d\r\n", fw_addr + i, err);
         }
     }
+#endif
 
     if (dst) {
-        vfree(dst);
+        aic_release_firmware(dst);
         dst = NULL;
     }
 
@@ -557,7 +761,7 @@ int rwnx_plat_m2d_flash_ota_android(struct aic_usb_dev *usbdev, char *filename)
     size = aic_load_firmware(&dst, filename, dev);
     if(size<=0){
             printk("wrong size of m2d file\n");
-            vfree(dst);
+            aic_release_firmware(dst);
             dst = NULL;
             return -1;
     }
@@ -587,7 +791,7 @@ int rwnx_plat_m2d_flash_ota_android(struct aic_usb_dev *usbdev, char *filename)
     }
 
     if (dst) {
-        vfree(dst);
+        aic_release_firmware(dst);
         dst = NULL;
     }
 	testmode = FW_NORMAL_MODE;
@@ -653,7 +857,7 @@ int rwnx_plat_m2d_flash_ota_check(struct aic_usb_dev *usbdev, char *filename)
 	size = aic_load_firmware(&dst, filename, dev);
 	if(size<=0){
 			printk("wrong size of m2d file\n");
-			vfree(dst);
+			aic_release_firmware(dst);
 			dst = NULL;
 			return -1;
 	}
@@ -736,7 +940,7 @@ int rwnx_plat_m2d_flash_ota_check(struct aic_usb_dev *usbdev, char *filename)
     }
 
     if (dst) {
-        vfree(dst);
+        aic_release_firmware(dst);
         dst = NULL;
     }
 	testmode = FW_NORMAL_MODE;
@@ -764,7 +968,7 @@ int rwnx_plat_flash_bin_upload_android(struct aic_usb_dev *usbdev, u32 fw_addr,
     flash_write_size = size;
     if(size<=0){
             printk("wrong size of firmware file\n");
-            vfree(dst);
+            aic_release_firmware(dst);
             dst = NULL;
             return ENOENT;
     }
@@ -772,7 +976,7 @@ int rwnx_plat_flash_bin_upload_android(struct aic_usb_dev *usbdev, u32 fw_addr,
     printk("size %x, flash_erase_len %x\n", size, flash_erase_len);
     if (size != flash_erase_len || (flash_erase_len & 0xFFF)) {
         printk("wrong size of flash_erase_len %d\n", flash_erase_len);
-        vfree(dst);
+        aic_release_firmware(dst);
         dst = NULL;
         return -1;
     }
@@ -825,7 +1029,7 @@ int rwnx_plat_flash_bin_upload_android(struct aic_usb_dev *usbdev, u32 fw_addr,
     }
 
     if (dst) {
-        vfree(dst);
+        aic_release_firmware(dst);
         dst = NULL;
     }
 
@@ -1132,7 +1336,7 @@ int rwnx_plat_userconfig_upload_android(struct aic_usb_dev *usbdev, char *filena
     size = aic_load_firmware(&dst, filename, dev);
     if(size <= 0){
             printk("wrong size of firmware file\n");
-            vfree(dst);
+            aic_release_firmware(dst);
             dst = NULL;
             return 0;
     }
@@ -1143,7 +1347,7 @@ int rwnx_plat_userconfig_upload_android(struct aic_usb_dev *usbdev, char *filena
 	rwnx_plat_userconfig_parsing((char *)dst, size);
 
 	if (dst) {
-        vfree(dst);
+        aic_release_firmware(dst);
         dst = NULL;
     }
 
@@ -1232,14 +1436,14 @@ struct aicbt_patch_table *aicbt_patch_table_alloc(struct aic_usb_dev *usbdev,con
 		}
 	}
 
-	vfree(rawdata);
+	aic_release_firmware(rawdata);
 
 	return head;
 
 err:
 	aicbt_patch_table_free(head);
 	if (rawdata)
-		vfree(rawdata);
+		aic_release_firmware(rawdata);
 	return NULL;
 }
 
@@ -1441,7 +1645,7 @@ int rwnx_plat_bin_fw_patch_table_upload_android(struct aic_usb_dev *usbdev, char
 		}
 	}
 
-	vfree(rawdata);
+	aic_release_firmware(rawdata);
 	aicbt_patch_table_load(usbdev, head);
 	printk("fw_patch_table download complete\n\n");
 
@@ -1450,7 +1654,7 @@ err:
 	//aicbt_patch_table_free(&head);
 
 	if (rawdata){
-		vfree(rawdata);
+		aic_release_firmware(rawdata);
 	}
 	return ret;
 }
@@ -88,9 +88,15 @@ static int cmd_mgr_queue(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd *cmd)
     spin_unlock_bh(&cmd_mgr->lock);
 
     if (!defer_push) {
-        //printk("queue:id=%x, param_len=%u\n",cmd->a2e_msg->id, cmd->a2e_msg->param_len);
-        aicwf_set_cmd_tx((void *)(cmd_mgr->usbdev), cmd->a2e_msg, sizeof(struct lmac_msg) + cmd->a2e_msg->param_len);
-        kfree(cmd->a2e_msg);
+        /* a nonblock cmd may be confirmed and freed as soon as it is pushed */
+        struct lmac_msg *msg = cmd->a2e_msg;
+        bool nonblock = cmd->flags & RWNX_CMD_FLAG_NONBLOCK;
+
+        //printk("queue:id=%x, param_len=%u\n",msg->id, msg->param_len);
+        aicwf_set_cmd_tx((void *)(cmd_mgr->usbdev), msg, sizeof(struct lmac_msg) + msg->param_len);
+        kfree(msg);
+        if (nonblock)
+            return 0;
     } else {
         printk("ERR: never defer push!!!!");
         return 0;
@@ -140,6 +146,9 @@ static int cmd_mgr_msgind(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd_e2amsg *
 {
     struct rwnx_cmd *cmd;
     bool found = false;
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    bool blk_write = false;
+#endif
 
     //printk("cmd->id=%x\n", msg->id);
     spin_lock(&cmd_mgr->lock);
@@ -160,6 +169,17 @@ static int cmd_mgr_msgind(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd_e2amsg *
                 if (cmd->e2a_msg && msg->param_len)
                     memcpy(cmd->e2a_msg, &msg->param, msg->param_len);
 
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+                if (cmd->flags & RWNX_CMD_FLAG_BLK_WRITE) {
+                    struct dbg_mem_block_write_cfm *cfm = (void *)msg->param;
+
+                    blk_write = true;
+                    if (msg->param_len >= sizeof(*cfm) && cfm->wstatus) {
+                        printk("blk write tkn %d wstatus %x\n", cmd->tkn, cfm->wstatus);
+                        atomic_inc(&cmd_mgr->blk_failed);
+                    }
+                }
+#endif
                 if (RWNX_CMD_WAIT_COMPLETE(cmd->flags))
                     cmd_complete(cmd_mgr, cmd);
 
@@ -169,6 +189,13 @@ static int cmd_mgr_msgind(struct rwnx_cmd_mgr *cmd_mgr, struct rwnx_cmd_e2amsg *
     }
     spin_unlock(&cmd_mgr->lock);
 
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    if (blk_write) {
+        atomic_dec(&cmd_mgr->blk_inflight);
+        wake_up(&cmd_mgr->blk_wait);
+    }
+#endif
+
     if (!found)
         cmd_mgr_run_callback(cmd_mgr, NULL, msg, cb);
 
@@ -199,8 +226,17 @@ static void cmd_mgr_drain(struct rwnx_cmd_mgr *cmd_mgr)
         cmd_mgr->queue_sz--;
         if (!(cur->flags & RWNX_CMD_FLAG_NONBLOCK))
             complete(&cur->complete);
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+        else if (cur->flags & RWNX_CMD_FLAG_BLK_WRITE) {
+            atomic_dec(&cmd_mgr->blk_inflight);
+            kfree(cur);
+        }
+#endif
     }
     spin_unlock_bh(&cmd_mgr->lock);
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    wake_up(&cmd_mgr->blk_wait);
+#endif
 }
 
 void rwnx_cmd_mgr_init(struct rwnx_cmd_mgr *cmd_mgr)
@@ -215,6 +251,11 @@ void rwnx_cmd_mgr_init(struct rwnx_cmd_mgr *cmd_mgr)
     cmd_mgr->drain  = &cmd_mgr_drain;
     cmd_mgr->llind  = NULL;//&cmd_mgr_llind;
     cmd_mgr->msgind = &cmd_mgr_msgind;
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    atomic_set(&cmd_mgr->blk_inflight, 0);
+    atomic_set(&cmd_mgr->blk_failed, 0);
+    init_waitqueue_head(&cmd_mgr->blk_wait);
+#endif
 
     #if 0
     INIT_WORK(&cmd_mgr->cmdWork, cmd_mgr_task_process);
@@ -383,6 +424,98 @@ int rwnx_send_dbg_mem_block_write_req(struct aic_usb_dev *usbdev, u32 mem_addr,
     return rwnx_send_msg(usbdev, mem_blk_write_req, 1, DBG_MEM_BLOCK_WRITE_CFM, NULL);
 }
 
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+#define RWNX_BLK_WRITE_SIZE sizeof(((struct dbg_mem_block_write_req *)0)->memdata)
+
+/*
+ * Same as a loop of rwnx_send_dbg_mem_block_write_req() but keeps up to
+ * window blocks pushed before waiting for their cfm. Every cfm wstatus
+ * is checked; blocks are pushed in address order over the single msg ep.
+ */
+int rwnx_send_dbg_mem_block_write_bulk(struct aic_usb_dev *usbdev, u32 mem_addr,
+                                       u32 mem_size, u32 *mem_data, int window)
+{
+    struct rwnx_cmd_mgr *cmd_mgr = &usbdev->cmd_mgr;
+    unsigned long tout = msecs_to_jiffies(RWNX_80211_CMD_TIMEOUT_MS);
+    struct dbg_mem_block_write_req *req;
+    struct lmac_msg *msg;
+    struct rwnx_cmd *cmd;
+    u32 i, len;
+    int err = 0;
+
+    if (usbdev->bus_if->state == BUS_DOWN_ST) {
+        printk("bus is down\n");
+        return 0;
+    }
+
+    window = clamp_t(int, window, 1, cmd_mgr->max_queue_sz);
+    atomic_set(&cmd_mgr->blk_inflight, 0);
+    atomic_set(&cmd_mgr->blk_failed, 0);
+
+    for (i = 0; i < mem_size; i += len) {
+        len = min_t(u32, mem_size - i, RWNX_BLK_WRITE_SIZE);
+
+        if (!wait_event_timeout(cmd_mgr->blk_wait,
+                                atomic_read(&cmd_mgr->blk_inflight) < window, tout)) {
+            err = -ETIMEDOUT;
+            break;
+        }
+        if (atomic_read(&cmd_mgr->blk_failed)) {
+            err = -EIO;
+            break;
+        }
+
+        req = rwnx_msg_zalloc(DBG_MEM_BLOCK_WRITE_REQ, TASK_DBG, DRV_TASK_ID,
+                              sizeof(struct dbg_mem_block_write_req));
+        if (!req) {
+            err = -ENOMEM;
+            break;
+        }
+        req->memaddr = mem_addr + i;
+        req->memsize = len;
+        memcpy(req->memdata, (u8 *)mem_data + i, len);
+        msg = container_of((void *)req, struct lmac_msg, param);
+
+        cmd = kzalloc(sizeof(struct rwnx_cmd), GFP_KERNEL);
+        if (!cmd) {
+            rwnx_msg_free(msg, req);
+            err = -ENOMEM;
+            break;
+        }
+        cmd->id      = msg->id;
+        cmd->reqid   = DBG_MEM_BLOCK_WRITE_CFM;
+        cmd->a2e_msg = msg;
+        cmd->flags   = RWNX_CMD_FLAG_NONBLOCK | RWNX_CMD_FLAG_REQ_CFM |
+                       RWNX_CMD_FLAG_BLK_WRITE;
+
+        atomic_inc(&cmd_mgr->blk_inflight);
+        err = cmd_mgr->queue(cmd_mgr, cmd);
+        if (err) {
+            atomic_dec(&cmd_mgr->blk_inflight);
+            rwnx_msg_free(msg, req);
+            kfree(cmd);
+            break;
+        }
+    }
+
+    if (!wait_event_timeout(cmd_mgr->blk_wait,
+                            atomic_read(&cmd_mgr->blk_inflight) == 0, tout)) {
+        printk(KERN_CRIT "blk write timed-out, %d in flight\n",
+               atomic_read(&cmd_mgr->blk_inflight));
+        cmd_mgr->print(cmd_mgr);
+        spin_lock_bh(&cmd_mgr->lock);
+        cmd_mgr->state = RWNX_CMD_MGR_STATE_CRASHED;
+        spin_unlock_bh(&cmd_mgr->lock);
+        if (!err)
+            err = -ETIMEDOUT;
+    }
+    if (!err && atomic_read(&cmd_mgr->blk_failed))
+        err = -EIO;
+
+    return err;
+}
+#endif
+
 
 int rwnx_send_dbg_mem_read_req(struct aic_usb_dev *usbdev, u32 mem_addr,
                                struct dbg_mem_read_cfm *cfm)
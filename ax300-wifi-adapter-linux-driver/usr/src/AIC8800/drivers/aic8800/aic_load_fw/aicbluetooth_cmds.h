@@ -14,6 +14,9 @@
 #include <linux/spinlock.h>
 #include <linux/completion.h>
 #include <linux/module.h>
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+#include <linux/wait.h>
+#endif
 
 #define RWNX_80211_CMD_TIMEOUT_MS    2000//500//300
 
@@ -23,6 +26,10 @@
 #define RWNX_CMD_FLAG_WAIT_ACK      BIT(3)
 #define RWNX_CMD_FLAG_WAIT_CFM      BIT(4)
 #define RWNX_CMD_FLAG_DONE          BIT(5)
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+/* nonblock block write accounted in cmd_mgr blk_* */
+#define RWNX_CMD_FLAG_BLK_WRITE     BIT(6)
+#endif
 /* ATM IPC design makes it possible to get the CFM before the ACK,
  * otherwise this could have simply been a state enum */
 #define RWNX_CMD_WAIT_COMPLETE(flags) \
@@ -141,6 +148,12 @@ struct rwnx_cmd_mgr {
 
     struct work_struct cmdWork;
     struct workqueue_struct *cmd_wq;
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    /* block writes of the upload in progress */
+    atomic_t blk_inflight;
+    atomic_t blk_failed;
+    wait_queue_head_t blk_wait;
+#endif
 };
 
 
@@ -312,6 +325,10 @@ int rwnx_send_dbg_mem_mask_write_req(struct aic_usb_dev *usbdev, u32 mem_addr,
 
 int rwnx_send_dbg_mem_block_write_req(struct aic_usb_dev *usbdev, u32 mem_addr,
                                       u32 mem_size, u32 *mem_data);
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+int rwnx_send_dbg_mem_block_write_bulk(struct aic_usb_dev *usbdev, u32 mem_addr,
+                                       u32 mem_size, u32 *mem_data, int window);
+#endif
                                       
 int rwnx_send_dbg_mem_write_req(struct aic_usb_dev *usbdev, u32 mem_addr, u32 mem_data);
 int rwnx_send_dbg_mem_read_req(struct aic_usb_dev *usbdev, u32 mem_addr, struct dbg_mem_read_cfm *cfm);
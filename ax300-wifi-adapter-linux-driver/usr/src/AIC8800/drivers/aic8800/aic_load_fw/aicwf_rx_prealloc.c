@@ -3,14 +3,57 @@
 #include <linux/module.h>
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
 #include "aicwf_rx_prealloc.h"
 #include "aicwf_debug.h"
 
 #ifdef CONFIG_PREALLOC_RX_SKB
 
-struct aicwf_rx_buff_list aic_rx_buff_list;
+#define AIC_RXBUFF_POOL_MAX     4   //adapters served at the same time
+#define AIC_RXBUFF_LOW_WATER    10
+#define AIC_RXBUFF_FILL_STEP    32  //buffers added per fill_work run
+
+/*
+ * One pool per adapter. Free buffers sit on a llist: put is lock free, get
+ * takes get_lock only because llist_del_first needs serialized deleters.
+ * Data buffers come from a per-pool kmem_cache and are never zeroed.
+ * The pool starts with aic_rxbuff_num_init buffers, fill_work adds more
+ * when it runs low. Every buffer holds a reference on the pool, so the
+ * cache outlives the buffers still held by the fdrv. The last reference may
+ * go from the rx softirq, the cache is then destroyed from a work.
+ */
+struct aicwf_rxbuff_pool {
+    struct llist_head free_list;
+    spinlock_t get_lock;
+    atomic_t avail;
+    atomic_t num;                   //buffers owned by the pool
+    atomic_t starved;               //an alloc failed, notify on next free
+    atomic_t refs;                  //aic_rxbuff_pools slot + one per buffer
+    bool dead;                      //out of aic_rxbuff_pools, free buffers go back to the cache
+    int size;
+    bool in_use;
+    struct kmem_cache *cache;
+    struct work_struct fill_work;
+    char name[16];
+    spinlock_t notify_lock;         //notify/ctx and the notify call
+    void (*notify)(void *ctx);
+    void *ctx;
+    u32 alloc_fail;
+    u32 low_hits;
+    struct llist_node dead_node;    //on aic_rxbuff_dead_pools once unreferenced
+};
+
+static struct aicwf_rxbuff_pool *aic_rxbuff_pools[AIC_RXBUFF_POOL_MAX];
+static DEFINE_MUTEX(aic_rxbuff_pool_mutex);
+
+static void aicwf_rxbuff_pool_reap(struct work_struct *work);
+static LLIST_HEAD(aic_rxbuff_dead_pools);
+static DECLARE_WORK(aic_rxbuff_reap_work, aicwf_rxbuff_pool_reap);
 
 int aic_rxbuff_num_max = 1000;
+int aic_rxbuff_num_init = 64;
 #ifdef CONFIG_PLATFORM_HI
 int aic_rxbuff_size = (4 * 512) * 1;
 #else
@@ -20,39 +63,139 @@ int aic_rxbuff_size = (4 * 512) * 10;
 int rx_buff_list_ava = 0;
 
 module_param(rx_buff_list_ava, int, 0660);
+//count applies at once (pools grow on demand and shrink on free), size on next adapter attach
+module_param(aic_rxbuff_num_max, int, 0660);
+module_param(aic_rxbuff_num_init, int, 0660);
+module_param(aic_rxbuff_size, int, 0660);
 
 int aicwf_rxbuff_size_get(void)
 {
     return aic_rxbuff_size;
 }
 
-struct rx_buff *aicwf_prealloc_rxbuff_alloc(spinlock_t *lock) 
+int aicwf_prealloc_rxbuff_pool_size(struct aicwf_rxbuff_pool *pool)
 {
-    unsigned long flags;
-    struct rx_buff *rxbuff = NULL;
+    return pool->size;
+}
+
+/* kmem_cache_destroy() may sleep, unref is called from the rx path */
+static void aicwf_rxbuff_pool_reap(struct work_struct *work)
+{
+    struct llist_node *node = llist_del_all(&aic_rxbuff_dead_pools);
+    struct aicwf_rxbuff_pool *pool, *tmp;
 
-    spin_lock_irqsave(lock, flags);
-    rx_buff_list_ava = atomic_read(&aic_rx_buff_list.rxbuff_list_len);
-    if(rx_buff_list_ava < 10){
-        AICWFDBG(LOGERROR, "%s WARNING rxbuff is running out %d\r\n", __func__,
-            rx_buff_list_ava);
-        //msleep(10);
-        mdelay(10);
+    llist_for_each_entry_safe(pool, tmp, node, dead_node) {
+        if (pool->cache)
+            kmem_cache_destroy(pool->cache);
+        kfree(pool);
     }
+}
+
+static void aicwf_rxbuff_pool_unref(struct aicwf_rxbuff_pool *pool)
+{
+    if (!atomic_dec_and_test(&pool->refs))
+        return;
 
-    if (list_empty(&aic_rx_buff_list.rxbuff_list)) {
-        spin_unlock_irqrestore(lock, flags);
-        AICWFDBG(LOGERROR, "%s %d, rxbuff list is empty\r\n", __func__, __LINE__);
+    llist_add(&pool->dead_node, &aic_rxbuff_dead_pools);
+    schedule_work(&aic_rxbuff_reap_work);
+}
+
+static struct rx_buff *aicwf_rxbuff_pool_grow(struct aicwf_rxbuff_pool *pool, gfp_t gfp)
+{
+    struct rx_buff *rxbuff;
+
+    if (atomic_inc_return(&pool->num) > READ_ONCE(aic_rxbuff_num_max)) {
+        atomic_dec(&pool->num);
         return NULL;
+    }
+
+    rxbuff = kzalloc(sizeof(struct rx_buff), gfp);
+    if (rxbuff)
+        rxbuff->data = kmem_cache_alloc(pool->cache, gfp | __GFP_NOWARN);
+    if (!rxbuff || !rxbuff->data) {
+        kfree(rxbuff);
+        atomic_dec(&pool->num);
+        return NULL;
+    }
+    rxbuff->pool = pool;
+    atomic_inc(&pool->refs);
+
+    return rxbuff;
+}
+
+static void aicwf_rxbuff_pool_release(struct aicwf_rxbuff_pool *pool, struct rx_buff *rxbuff)
+{
+    kmem_cache_free(pool->cache, rxbuff->data);
+    kfree(rxbuff);
+    atomic_dec(&pool->num);
+    aicwf_rxbuff_pool_unref(pool);
+}
+
+static void aicwf_rxbuff_pool_fill(struct aicwf_rxbuff_pool *pool, int nb)
+{
+    struct rx_buff *rxbuff;
+
+    while (nb-- > 0 && (rxbuff = aicwf_rxbuff_pool_grow(pool, GFP_KERNEL)) != NULL) {
+        llist_add(&rxbuff->free_node, &pool->free_list);
+        atomic_inc(&pool->avail);
+    }
+}
+
+static void aicwf_rxbuff_pool_fill_work(struct work_struct *work)
+{
+    struct aicwf_rxbuff_pool *pool = container_of(work, struct aicwf_rxbuff_pool, fill_work);
+    void (*notify)(void *ctx);
+    unsigned long flags;
+
+    aicwf_rxbuff_pool_fill(pool, AIC_RXBUFF_FILL_STEP);
+
+    if (atomic_read(&pool->avail) && atomic_xchg(&pool->starved, 0)) {
+        spin_lock_irqsave(&pool->notify_lock, flags);
+        notify = pool->notify;
+        if (notify)
+            notify(pool->ctx);
+        spin_unlock_irqrestore(&pool->notify_lock, flags);
+    }
+}
+
+struct rx_buff *aicwf_prealloc_rxbuff_alloc(struct aicwf_rxbuff_pool *pool)
+{
+    unsigned long flags;
+    struct llist_node *node;
+    struct rx_buff *rxbuff = NULL;
+    int avail;
+
+retry:
+    spin_lock_irqsave(&pool->get_lock, flags);
+    node = llist_del_first(&pool->free_list);
+    spin_unlock_irqrestore(&pool->get_lock, flags);
+
+    if (node) {
+        rxbuff = llist_entry(node, struct rx_buff, free_node);
+        avail = atomic_dec_return(&pool->avail);
+        rx_buff_list_ava = avail;
+        if (avail < AIC_RXBUFF_LOW_WATER) {
+            if (pool->low_hits++ == 0 || avail == 0)
+                AICWFDBG(LOGDEBUG, "%s WARNING rxbuff is running out %d\r\n", __func__, avail);
+            //grow ahead with GFP_KERNEL rather than in atomic context
+            if (atomic_read(&pool->num) < READ_ONCE(aic_rxbuff_num_max))
+                schedule_work(&pool->fill_work);
+        }
     } else {
-		rxbuff = list_first_entry(&aic_rx_buff_list.rxbuff_list,
-					   struct rx_buff, queue);
-		list_del_init(&rxbuff->queue);
-        atomic_dec(&aic_rx_buff_list.rxbuff_list_len);
-	}
-    spin_unlock_irqrestore(lock, flags);
-    //printk("len:%d\n", aic_rx_buff_list.rxbuff_list_len);
-    memset(rxbuff->data, 0, aic_rxbuff_size);
+        rxbuff = aicwf_rxbuff_pool_grow(pool, GFP_ATOMIC);
+        if (rxbuff == NULL) {
+            if (atomic_read(&pool->num) < READ_ONCE(aic_rxbuff_num_max))
+                schedule_work(&pool->fill_work);
+            /* backpressure: the owner is notified once a buffer comes back */
+            pool->alloc_fail++;
+            atomic_set(&pool->starved, 1);
+            smp_mb__after_atomic();
+            if (!llist_empty(&pool->free_list))
+                goto retry;
+            return NULL;
+        }
+    }
+
     rxbuff->len = 0;
     rxbuff->start = NULL;
     rxbuff->read = NULL;
@@ -61,66 +204,214 @@ struct rx_buff *aicwf_prealloc_rxbuff_alloc(spinlock_t *lock)
     return rxbuff;
 }
 
-void aicwf_prealloc_rxbuff_free(struct rx_buff *rxbuff, spinlock_t *lock)
+/* returns the free buffers to the cache, the last one may free the pool */
+static void aicwf_rxbuff_pool_drain(struct aicwf_rxbuff_pool *pool)
+{
+    struct llist_node *node = llist_del_all(&pool->free_list);
+    struct rx_buff *rxbuff, *tmp;
+
+    llist_for_each_entry_safe(rxbuff, tmp, node, free_node) {
+        atomic_dec(&pool->avail);
+        aicwf_rxbuff_pool_release(pool, rxbuff);
+    }
+}
+
+void aicwf_prealloc_rxbuff_free(struct rx_buff *rxbuff)
 {
+    struct aicwf_rxbuff_pool *pool = rxbuff->pool;
+    void (*notify)(void *ctx);
     unsigned long flags;
 
-    spin_lock_irqsave(lock, flags);
-	list_add_tail(&rxbuff->queue, &aic_rx_buff_list.rxbuff_list);
-	atomic_inc(&aic_rx_buff_list.rxbuff_list_len);
-    rx_buff_list_ava = atomic_read(&aic_rx_buff_list.rxbuff_list_len);
-    spin_unlock_irqrestore(lock, flags);
+    if (READ_ONCE(pool->dead) ||
+        atomic_read(&pool->num) > READ_ONCE(aic_rxbuff_num_max)) {
+        aicwf_rxbuff_pool_release(pool, rxbuff);
+        return;
+    }
+
+    /* our buffer keeps the pool alive until it is off the free list */
+    atomic_inc(&pool->refs);
+    llist_add(&rxbuff->free_node, &pool->free_list);
+    atomic_inc(&pool->avail);
+
+    //raced with aicwf_rxbuff_pool_destroy(), nobody else will drain it
+    smp_mb();
+    if (READ_ONCE(pool->dead)) {
+        aicwf_rxbuff_pool_drain(pool);
+        aicwf_rxbuff_pool_unref(pool);
+        return;
+    }
+
+    if (atomic_read(&pool->starved) && atomic_xchg(&pool->starved, 0)) {
+        //pool_put clears notify under the lock, ctx can't go away under us
+        spin_lock_irqsave(&pool->notify_lock, flags);
+        notify = pool->notify;
+        if (notify)
+            notify(pool->ctx);
+        spin_unlock_irqrestore(&pool->notify_lock, flags);
+    }
+    aicwf_rxbuff_pool_unref(pool);
 }
 
-int aicwf_prealloc_init(void)
+/* apply aic_rxbuff_size/aic_rxbuff_num_init, called with the pool unused */
+static int aicwf_rxbuff_pool_setup(struct aicwf_rxbuff_pool *pool)
 {
-    struct rx_buff *rxbuff;
-    int i = 0;
+    int size = READ_ONCE(aic_rxbuff_size);
 
-    AICWFDBG(LOGINFO, "%s enter\n", __func__);
-    INIT_LIST_HEAD(&aic_rx_buff_list.rxbuff_list);
-    
-	for (i = 0 ; i < aic_rxbuff_num_max ; i++) {
-        rxbuff = kzalloc(sizeof(struct rx_buff), GFP_KERNEL);
-        if (rxbuff) {
-            rxbuff->data = kzalloc(aic_rxbuff_size, GFP_KERNEL);
-            if (rxbuff->data == NULL) {
-                AICWFDBG(LOGERROR, "failed to alloc rxbuff data\n");
-                kfree(rxbuff);
-                continue;
-            }
-            rxbuff->len = 0;
-            rxbuff->start = NULL;
-            rxbuff->read = NULL;
-            rxbuff->end = NULL;
-            list_add_tail(&rxbuff->queue, &aic_rx_buff_list.rxbuff_list);
-            atomic_inc(&aic_rx_buff_list.rxbuff_list_len);
-            rx_buff_list_ava = atomic_read(&aic_rx_buff_list.rxbuff_list_len);
+    if (pool->cache && pool->size != size) {
+        if (atomic_read(&pool->avail) != atomic_read(&pool->num)) {
+            AICWFDBG(LOGERROR, "%s %s has buffers in flight, keep size %d\n",
+                __func__, pool->name, pool->size);
+            size = pool->size;
+        } else {
+            aicwf_rxbuff_pool_drain(pool);
+            kmem_cache_destroy(pool->cache);
+            pool->cache = NULL;
         }
     }
 
-	AICWFDBG(LOGINFO, "pre alloc rxbuff list len: %d\n", (int)atomic_read(&aic_rx_buff_list.rxbuff_list_len));
+    if (!pool->cache) {
+        pool->cache = kmem_cache_create(pool->name, size, 0, 0, NULL);
+        if (!pool->cache)
+            return -ENOMEM;
+        pool->size = size;
+    }
+
+    aicwf_rxbuff_pool_fill(pool, READ_ONCE(aic_rxbuff_num_init) - atomic_read(&pool->avail));
+
+    AICWFDBG(LOGINFO, "%s %s: %d buffers of %d\n", __func__, pool->name,
+        atomic_read(&pool->num), pool->size);
     return 0;
 }
 
+/* drops the aic_rxbuff_pools reference, buffers still out keep the cache */
+static void aicwf_rxbuff_pool_destroy(struct aicwf_rxbuff_pool *pool)
+{
+    if (pool->in_use || atomic_read(&pool->avail) != atomic_read(&pool->num))
+        AICWFDBG(LOGERROR, "%s %s still has %d buffers in use\n", __func__, pool->name,
+            atomic_read(&pool->num) - atomic_read(&pool->avail));
+
+    cancel_work_sync(&pool->fill_work);
+    WRITE_ONCE(pool->dead, true);
+    smp_mb();
+    aicwf_rxbuff_pool_drain(pool);
+    aicwf_rxbuff_pool_unref(pool);
+}
+
+static struct aicwf_rxbuff_pool *aicwf_rxbuff_pool_create(int idx)
+{
+    struct aicwf_rxbuff_pool *pool;
+
+    pool = kzalloc(sizeof(struct aicwf_rxbuff_pool), GFP_KERNEL);
+    if (!pool)
+        return NULL;
+
+    init_llist_head(&pool->free_list);
+    spin_lock_init(&pool->get_lock);
+    atomic_set(&pool->avail, 0);
+    atomic_set(&pool->num, 0);
+    atomic_set(&pool->starved, 0);
+    atomic_set(&pool->refs, 1);
+    spin_lock_init(&pool->notify_lock);
+    INIT_WORK(&pool->fill_work, aicwf_rxbuff_pool_fill_work);
+    snprintf(pool->name, sizeof(pool->name), "aic_rxbuff%d", idx);
+
+    if (aicwf_rxbuff_pool_setup(pool)) {
+        AICWFDBG(LOGERROR, "failed to create %s\n", pool->name);
+        aicwf_rxbuff_pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+struct aicwf_rxbuff_pool *aicwf_prealloc_rxbuff_pool_get(void (*notify)(void *ctx), void *ctx)
+{
+    struct aicwf_rxbuff_pool *pool = NULL;
+    int i;
+
+    mutex_lock(&aic_rxbuff_pool_mutex);
+    for (i = 0; i < AIC_RXBUFF_POOL_MAX; i++) {
+        if (!aic_rxbuff_pools[i]) {
+            aic_rxbuff_pools[i] = aicwf_rxbuff_pool_create(i);
+            pool = aic_rxbuff_pools[i];
+            break;
+        }
+        if (!aic_rxbuff_pools[i]->in_use) {
+            pool = aic_rxbuff_pools[i];
+            if (aicwf_rxbuff_pool_setup(pool))
+                pool = NULL;
+            break;
+        }
+    }
+
+    if (pool) {
+        spin_lock_irq(&pool->notify_lock);
+        pool->notify = notify;
+        pool->ctx = ctx;
+        spin_unlock_irq(&pool->notify_lock);
+        pool->alloc_fail = 0;
+        pool->low_hits = 0;
+        atomic_set(&pool->starved, 0);
+        pool->in_use = true;
+    } else {
+        AICWFDBG(LOGERROR, "%s no rxbuff pool available\n", __func__);
+    }
+    mutex_unlock(&aic_rxbuff_pool_mutex);
+
+    return pool;
+}
+
+void aicwf_prealloc_rxbuff_pool_put(struct aicwf_rxbuff_pool *pool)
+{
+    mutex_lock(&aic_rxbuff_pool_mutex);
+    //waits for a notify in progress, ctx is gone after we return
+    spin_lock_irq(&pool->notify_lock);
+    pool->notify = NULL;
+    pool->ctx = NULL;
+    spin_unlock_irq(&pool->notify_lock);
+    cancel_work_sync(&pool->fill_work);
+    pool->in_use = false;
+    AICWFDBG(LOGINFO, "%s %s: num %d avail %d alloc_fail %u low_hits %u\n", __func__,
+        pool->name, atomic_read(&pool->num), atomic_read(&pool->avail),
+        pool->alloc_fail, pool->low_hits);
+    mutex_unlock(&aic_rxbuff_pool_mutex);
+}
+
+int aicwf_prealloc_init(void)
+{
+    AICWFDBG(LOGINFO, "%s enter\n", __func__);
+
+    //the first adapter's pool gets its initial buffers at load time, before memory fragments
+    mutex_lock(&aic_rxbuff_pool_mutex);
+    aic_rxbuff_pools[0] = aicwf_rxbuff_pool_create(0);
+    mutex_unlock(&aic_rxbuff_pool_mutex);
+
+    return aic_rxbuff_pools[0] ? 0 : -ENOMEM;
+}
+
 void aicwf_prealloc_exit(void)
 {
-    struct rx_buff *rxbuff;
-    struct rx_buff *pos;
-    
+    int i;
+
     AICWFDBG(LOGINFO, "%s enter\n", __func__);
 
-	AICWFDBG(LOGINFO, "free pre alloc rxbuff list %d\n", (int)atomic_read(&aic_rx_buff_list.rxbuff_list_len));
-    list_for_each_entry_safe(rxbuff, pos, &aic_rx_buff_list.rxbuff_list, queue) {
-        list_del_init(&rxbuff->queue);
-        kfree(rxbuff->data);
-        kfree(rxbuff);
+    mutex_lock(&aic_rxbuff_pool_mutex);
+    for (i = 0; i < AIC_RXBUFF_POOL_MAX; i++) {
+        if (aic_rxbuff_pools[i]) {
+            aicwf_rxbuff_pool_destroy(aic_rxbuff_pools[i]);
+            aic_rxbuff_pools[i] = NULL;
+        }
     }
+    mutex_unlock(&aic_rxbuff_pool_mutex);
+    flush_work(&aic_rxbuff_reap_work);
 }
 
 EXPORT_SYMBOL(aicwf_rxbuff_size_get);
 EXPORT_SYMBOL(aicwf_prealloc_rxbuff_alloc);
 EXPORT_SYMBOL(aicwf_prealloc_rxbuff_free);
+EXPORT_SYMBOL(aicwf_prealloc_rxbuff_pool_get);
+EXPORT_SYMBOL(aicwf_prealloc_rxbuff_pool_put);
+EXPORT_SYMBOL(aicwf_prealloc_rxbuff_pool_size);
 
 #endif
 
@@ -20,6 +20,9 @@
 #include <linux/usb.h>
 #include <linux/kthread.h>
 #include <linux/version.h>
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+#include <linux/ktime.h>
+#endif
 #include "aic_txrxif.h"
 #include "aicwf_usb.h"
 #include "aicbluetooth.h"
@@ -1669,6 +1672,9 @@ static int aicwf_usb_probe(struct usb_interface *intf, const struct usb_device_i
     struct device *dev = NULL;
     struct aicwf_rx_priv* rx_priv = NULL;
     struct aic_usb_dev *usb_dev = NULL;
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    ktime_t load_start;
+#endif
     
 
 	AICWFDBG(LOGINFO, "%s vid:0x%X pid:0x%X icl:0x%X isc:0x%X ipr:0x%X \r\n", __func__,
@@ -1765,6 +1771,9 @@ static int aicwf_usb_probe(struct usb_interface *intf, const struct usb_device_i
 		goto out_free_bus;
 	}
 
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    load_start = ktime_get();
+#endif
     if (system_config(usb_dev)) {
         goto out_free_bus;
     }
@@ -1772,6 +1781,9 @@ static int aicwf_usb_probe(struct usb_interface *intf, const struct usb_device_i
     if (aicfw_download_fw(usb_dev)){
         goto out_free_bus;
     }
+#ifdef CONFIG_FW_UPLOAD_PIPELINE
+    printk("fw load done in %lld ms\n", ktime_to_ms(ktime_sub(ktime_get(), load_start)));
+#endif
     
     usb_dev->app_cmp = true;
 	fw_loaded = 1;